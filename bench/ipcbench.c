@@ -0,0 +1,672 @@
+// Замер IPC: канал (ЛР1, ./child) против shared memory + семафоры и
+// сокетов (ЛР3, ./child_shm через ../ipc). Стенд сам играет роль родителя: запускает настоящего
+// ребёнка, шлёт ему синтетические строки и ждёт ответов, проверяя каждый.
+//
+//   ipcbench [--transport pipe,pipe-bin,shm,memfd,seqpacket,ring,eventfd] [--nums 1,16,128] [--digits 8]
+//            [--window 1,64] [--count N] [--pipe-child PATH]
+//            [--shm-child PATH] [--out FILE]
+//   ipcbench --startup N [--transport ...] [--pipe-child PATH] [--shm-child PATH] [--out FILE]
+//
+// Транспорты:
+//   pipe     — текстовые строки через пару каналов, как parent (-w N);
+//   pipe-bin — то же с двоичным протоколом (proto.h), как parent -b;
+//   shm      — одна строка в shared memory и пара семафоров, как parent_shm
+//              (только окно 1: буфер у ЛР3 на одну строку);
+//   memfd    — то же без именованных объектов (parent_shm -T memfd);
+//   seqpacket — то же через UNIX-сокеты SOCK_SEQPACKET (parent_shm -T seqpacket);
+//   ring     — кольца запросов и ответов в shared memory (parent_shm -T ring),
+//              окно — сколько строк в полёте, пока их принимает кольцо;
+//   eventfd  — те же кольца, будят eventfd (parent_shm -T eventfd).
+// Для каждого сочетания транспорт × чисел в строке × окно (строк в полёте)
+// измеряются: пропускная способность, задержка ответа (от отправки строки
+// до получения ответа) p50/p99/p99.9/max, переключения контекста и время
+// CPU на сообщение (стенд + ребёнок, getrusage/wait4).
+// Результат — таблица в stdout и, с --out, по строке JSON на прогон.
+//
+// --startup N меряет другое: время от ввода имени файла до первого ответа
+// у родителя целиком (../lab1/parent, ../lab3/parent_shm; у ЛР3 — и без -W,
+// и с тёплым ребёнком -W), N запусков на вариант.
+#define _GNU_SOURCE
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/mman.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <poll.h>
+#include <signal.h>
+#include <errno.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "../lab1/proto.h"
+#include "../lab1/agg.h"
+#include "../ipc/ipc.h"
+
+#define POOL 256           // разных строк в нагрузке (ходят по кругу)
+#define MAX_WINDOW 4096
+#define MAX_LIST 16
+
+static void* map_anon(size_t n) {
+    void* p = mmap(NULL, n, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED) die("ipcbench: mmap failed");
+    return p;
+}
+
+static int64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// ---- вывод: строка собирается в буфере ----
+struct out {
+    char buf[1024];
+    size_t len;
+};
+
+static void o_str(struct out* o, const char* s) {
+    size_t n = strlen(s);
+    memcpy(o->buf + o->len, s, n);
+    o->len += n;
+}
+
+static void o_num(struct out* o, long long v) {
+    o->len += (size_t)ll_to_buf(v, o->buf + o->len);
+}
+
+// число, выровненное вправо по ширине w
+static void o_col(struct out* o, long long v, size_t w) {
+    char tmp[32];
+    size_t n = (size_t)ll_to_buf(v, tmp);
+    while (n < w--) o->buf[o->len++] = ' ';
+    memcpy(o->buf + o->len, tmp, n);
+    o->len += n;
+}
+
+static void o_scol(struct out* o, const char* s, size_t w) {
+    size_t n = strlen(s);
+    o_str(o, s);
+    while (n++ < w) o->buf[o->len++] = ' ';
+}
+
+// ---- нагрузка ----
+struct msg {
+    char* wire;          // что уходит ребёнку: строка или кадр FR_TEXT
+    size_t wire_len;
+    char* line;          // сама строка с '\n'
+    size_t line_len;
+    char reply[64];      // ожидаемый текстовый ответ
+    size_t reply_len;
+    struct frame_reply rep;  // ожидаемый двоичный ответ
+};
+
+static uint64_t rng = 0x9E3779B97F4A7C15ULL;
+
+static uint64_t next_rand(void) { // xorshift64
+    rng ^= rng << 13;
+    rng ^= rng >> 7;
+    rng ^= rng << 17;
+    return rng;
+}
+
+static void build_pool(struct msg* pool, size_t nums, size_t digits, int bin) {
+    size_t cap = nums * (digits + 2) + 1;
+    for (size_t i = 0; i < POOL; ++i) {
+        struct msg* m = &pool[i];
+        m->wire = (char*)map_anon(cap + sizeof(struct frame_hdr));
+        m->line = m->wire + (bin ? sizeof(struct frame_hdr) : 0);
+        size_t k = 0;
+        long long sum = 0;
+        int ovf = 0;
+        for (size_t j = 0; j < nums; ++j) {
+            long long v = 0;
+            for (size_t d = 0; d < digits; ++d)
+                v = v * 10 + (long long)(d == 0 ? 1 + next_rand() % 9 : next_rand() % 10);
+            if (next_rand() & 1) v = -v;
+            if (__builtin_add_overflow(sum, v, &sum)) ovf = 1;
+            if (j) m->line[k++] = ' ';
+            k += (size_t)ll_to_buf(v, m->line + k);
+        }
+        m->line[k++] = '\n';
+        m->line_len = k;
+        if (ovf) {
+            memcpy(m->reply, MSG_OVERFLOW, sizeof(MSG_OVERFLOW) - 1);
+            m->reply_len = sizeof(MSG_OVERFLOW) - 1;
+        } else {
+            size_t r = 0;
+            memcpy(m->reply, "sum=", 4); r = 4;
+            r += (size_t)ll_to_buf(sum, m->reply + r);
+            m->reply[r++] = '\n';
+            m->reply_len = r;
+        }
+        memset(&m->rep, 0, sizeof(m->rep));
+        m->rep.status = ovf ? RS_OVERFLOW : RS_OK;
+        m->rep.value = ovf ? 0 : sum;
+        if (bin) {
+            struct frame_hdr h = { FR_TEXT, (uint32_t)k };
+            memcpy(m->wire, &h, sizeof(h));
+            m->wire_len = sizeof(h) + k;
+        } else {
+            m->wire_len = k;
+        }
+    }
+}
+
+static void free_pool(struct msg* pool, size_t nums, size_t digits) {
+    size_t cap = nums * (digits + 2) + 1;
+    for (size_t i = 0; i < POOL; ++i) munmap(pool[i].wire, cap + sizeof(struct frame_hdr));
+}
+
+// ---- результат прогона ----
+struct result {
+    int64_t elapsed_ns;
+    int64_t* lat;        // задержка каждого сообщения, нс
+    struct rusage self0, self1, child;
+};
+
+// ---- канал: ./child ----
+struct pipe_child {
+    pid_t pid;
+    int to, from;
+};
+
+static void pipe_spawn(struct pipe_child* c, const char* path, int bin) {
+    int p1[2], p2[2];
+    if (pipe2(p1, O_CLOEXEC) < 0 || pipe2(p2, O_CLOEXEC) < 0) die("ipcbench: pipe failed");
+    pid_t pid = fork();
+    if (pid < 0) die("ipcbench: fork failed");
+    if (pid == 0) {
+        if (dup2(p1[0], 0) < 0 || dup2(p2[1], 1) < 0) die("ipcbench: dup2 failed");
+        char* args[4];
+        int na = 0;
+        args[na++] = (char*)"child";
+        if (bin) args[na++] = (char*)"--proto"; // первым сообщением придёт PROTO_HELLO
+        args[na++] = (char*)"/dev/null";
+        args[na] = NULL;
+        char* envp[] = { NULL };
+        execve(path, args, envp);
+        die("ipcbench: execve(child) failed");
+    }
+    close(p1[0]);
+    close(p2[1]);
+    c->pid = pid;
+    c->to = p1[1];
+    c->from = p2[0];
+}
+
+// согласовать двоичный протокол: ответ на PROTO_HELLO — ровно PROTO_HELLO_OK
+static void pipe_hello(struct pipe_child* c) {
+    if (write_all(c->to, PROTO_HELLO, sizeof(PROTO_HELLO) - 1) < 0) die("ipcbench: write(child) failed");
+    char buf[sizeof(PROTO_HELLO_OK) - 1];
+    size_t got = 0;
+    while (got < sizeof(buf)) {
+        ssize_t r = read(c->from, buf + got, sizeof(buf) - got);
+        if (r < 0 && errno == EINTR) continue;
+        if (r <= 0) die("ipcbench: ребёнок закрыл канал");
+        got += (size_t)r;
+    }
+    if (memcmp(buf, PROTO_HELLO_OK, sizeof(buf)) != 0) die("ipcbench: ребёнок не согласился на двоичный протокол");
+}
+
+// ответы копятся в rbuf; разбираются целиком по одному
+struct replies {
+    char buf[1 << 16];
+    size_t pos, len;
+};
+
+// Взять готовый ответ и сверить с ожидаемым. 1 — взят, 0 — ещё не пришёл.
+static int take_reply(struct replies* r, const struct msg* m, int bin) {
+    size_t avail = r->len - r->pos;
+    const char* p = r->buf + r->pos;
+    if (bin) {
+        if (avail < sizeof(struct frame_reply)) return 0;
+        if (memcmp(p, &m->rep, sizeof(m->rep)) != 0) die("ipcbench: неверный двоичный ответ");
+        r->pos += sizeof(struct frame_reply);
+        return 1;
+    }
+    const char* nl = memchr(p, '\n', avail);
+    if (!nl) return 0;
+    size_t n = (size_t)(nl - p) + 1;
+    if (n != m->reply_len || memcmp(p, m->reply, n) != 0) die("ipcbench: неверный ответ");
+    r->pos += n;
+    return 1;
+}
+
+static ssize_t fill(int fd, struct replies* r) {
+    if (r->pos == r->len) r->pos = r->len = 0;
+    else if (r->pos > sizeof(r->buf) / 2) {
+        memmove(r->buf, r->buf + r->pos, r->len - r->pos);
+        r->len -= r->pos;
+        r->pos = 0;
+    }
+    for (;;) {
+        ssize_t n = read(fd, r->buf + r->len, sizeof(r->buf) - r->len);
+        if (n < 0 && errno == EINTR) continue;
+        if (n > 0) r->len += (size_t)n;
+        return n;
+    }
+}
+
+static void set_nonblock(int fd) {
+    int fl = fcntl(fd, F_GETFL);
+    if (fl < 0 || fcntl(fd, F_SETFL, fl | O_NONBLOCK) < 0) die("ipcbench: fcntl failed");
+}
+
+static void run_pipe(const char* path, const struct msg* pool, size_t count, size_t window,
+                     int bin, struct result* res) {
+    static struct replies rb;
+    rb.pos = rb.len = 0;
+    struct pipe_child c;
+    pipe_spawn(&c, path, bin);
+    if (bin) pipe_hello(&c);
+
+    static int64_t sent_at[MAX_WINDOW];
+    getrusage(RUSAGE_SELF, &res->self0);
+    int64_t t0 = now_ns();
+
+    if (window == 1) {
+        // построчный обмен, как у parent без -w: запись и блокирующее чтение
+        for (size_t i = 0; i < count; ++i) {
+            const struct msg* m = &pool[i % POOL];
+            int64_t ts = now_ns();
+            if (write_all(c.to, m->wire, m->wire_len) < 0) die("ipcbench: write(child) failed");
+            while (!take_reply(&rb, m, bin))
+                if (fill(c.from, &rb) <= 0) die("ipcbench: ребёнок закрыл канал");
+            res->lat[i] = now_ns() - ts;
+        }
+    } else {
+        // конвейер, как parent -w: до window строк в полёте, poll()
+        set_nonblock(c.to);
+        set_nonblock(c.from);
+        size_t sent = 0, acked = 0, wpos = 0;
+        while (acked < count) {
+            int progress = 0;
+            while (sent < count && sent - acked < window) {
+                const struct msg* m = &pool[sent % POOL];
+                if (wpos == 0) sent_at[sent % window] = now_ns();
+                ssize_t w = write(c.to, m->wire + wpos, m->wire_len - wpos);
+                if (w < 0 && (errno == EAGAIN || errno == EINTR)) break;
+                if (w < 0) die("ipcbench: write(child) failed");
+                progress = 1;
+                wpos += (size_t)w;
+                if (wpos == m->wire_len) { sent++; wpos = 0; }
+            }
+            ssize_t r = fill(c.from, &rb);
+            if (r == 0) die("ipcbench: ребёнок закрыл канал");
+            if (r < 0 && errno != EAGAIN) die("ipcbench: read(child) failed");
+            if (r > 0) {
+                int64_t t = now_ns();
+                while (acked < sent && take_reply(&rb, &pool[acked % POOL], bin)) {
+                    res->lat[acked] = t - sent_at[acked % window];
+                    acked++;
+                }
+                progress = 1;
+            }
+            if (!progress) {
+                struct pollfd pfd[2];
+                nfds_t n = 0;
+                pfd[n].fd = c.from; pfd[n].events = POLLIN; n++;
+                if (sent < count && sent - acked < window) { pfd[n].fd = c.to; pfd[n].events = POLLOUT; n++; }
+                if (poll(pfd, n, -1) < 0 && errno != EINTR) die("ipcbench: poll failed");
+            }
+        }
+    }
+
+    res->elapsed_ns = now_ns() - t0;
+    getrusage(RUSAGE_SELF, &res->self1);
+    close(c.to);
+    close(c.from);
+    int st;
+    if (wait4(c.pid, &st, 0, &res->child) < 0) die("ipcbench: wait4 failed");
+}
+
+// ---- канал ../ipc (shm, seqpacket): ./child_shm ----
+// Ребёнок уже дождан в ipc_finish, поэтому его время и переключения —
+// приращение RUSAGE_CHILDREN за прогон.
+static void sub_rusage(struct rusage* d, const struct rusage* a, const struct rusage* b) {
+    timersub(&a->ru_utime, &b->ru_utime, &d->ru_utime);
+    timersub(&a->ru_stime, &b->ru_stime, &d->ru_stime);
+    d->ru_nvcsw = a->ru_nvcsw - b->ru_nvcsw;
+    d->ru_nivcsw = a->ru_nivcsw - b->ru_nivcsw;
+}
+
+// окно: до window запросов в полёте (ipc_send), сколько примет канал;
+// задержка — от ipc_send до ipc_take
+static void run_chan(const struct ipc_ops* ops, const char* path, const struct msg* pool,
+                     size_t count, size_t window, struct result* res) {
+    struct rusage ch0, ch1;
+    getrusage(RUSAGE_CHILDREN, &ch0);
+    static struct ipc_chan ch;
+    char* head[] = { (char*)"child_shm", (char*)"/dev/null", NULL };
+    ipc_spawn(&ch, ops, path, head, NULL, environ); // IPC_SPIN — и ребёнку
+
+    static int64_t sent_at[MAX_WINDOW];
+    getrusage(RUSAGE_SELF, &res->self0);
+    int64_t t0 = now_ns();
+    size_t sent = 0, done = 0;
+    while (done < count) {
+        while (sent < count && sent - done < window) {
+            const struct msg* m = &pool[sent % POOL];
+            int64_t ts = now_ns();
+            if (!ipc_send(&ch, m->line, m->line_len)) break; // канал полон
+            sent_at[sent % MAX_WINDOW] = ts;
+            sent++;
+        }
+        const struct msg* m = &pool[done % POOL];
+        const char* rep;
+        size_t n = ipc_take(&ch, &rep);
+        res->lat[done] = now_ns() - sent_at[done % MAX_WINDOW];
+        if (n != m->reply_len || memcmp(rep, m->reply, n) != 0) die("ipcbench: неверный ответ (ipc)");
+        done++;
+    }
+    res->elapsed_ns = now_ns() - t0;
+    getrusage(RUSAGE_SELF, &res->self1);
+
+    ipc_finish(&ch);
+    getrusage(RUSAGE_CHILDREN, &ch1);
+    sub_rusage(&res->child, &ch1, &ch0);
+}
+
+// ---- время до первого ответа ----
+// Родитель запускается в каталоге своей ЛР (ребёнка он ищет как ./child*).
+// Стенд ждёт приглашения, даёт «человеку» STARTUP_THINK_NS на набор имени
+// файла, затем разом отдаёт имя и строку и засекает время до "sum=" в
+// выводе: запуск ребёнка, создание канала и подключение к нему.
+#define STARTUP_THINK_NS 50000000
+
+// читать вывод родителя, пока в нём не встретится pat
+static void wait_for(int fd, char* buf, size_t cap, size_t* len, const char* pat) {
+    size_t m = strlen(pat);
+    while (!memmem(buf, *len, pat, m)) {
+        if (*len > cap / 2) { // хвост мог начать образец
+            memmove(buf, buf + *len - m, m);
+            *len = m;
+        }
+        ssize_t r = read(fd, buf + *len, cap - *len);
+        if (r < 0 && errno == EINTR) continue;
+        if (r <= 0) die("ipcbench: родитель не ответил");
+        *len += (size_t)r;
+    }
+    *len = 0;
+}
+
+static int64_t startup_once(const char* dir, char** args) {
+    int in[2], out[2];
+    if (pipe2(in, O_CLOEXEC) < 0 || pipe2(out, O_CLOEXEC) < 0) die("ipcbench: pipe failed");
+    pid_t pid = fork();
+    if (pid < 0) die("ipcbench: fork failed");
+    if (pid == 0) {
+        if (chdir(dir) < 0) die("ipcbench: chdir failed");
+        if (dup2(in[0], 0) < 0 || dup2(out[1], 1) < 0) die("ipcbench: dup2 failed");
+        char* envp[] = { NULL };
+        execve(args[0], args, envp);
+        die("ipcbench: execve(parent) failed");
+    }
+    close(in[0]);
+    close(out[1]);
+
+    char buf[4096];
+    size_t len = 0;
+    wait_for(out[0], buf, sizeof(buf), &len, "Введите имя файла: ");
+    struct timespec think = { 0, STARTUP_THINK_NS };
+    nanosleep(&think, NULL);
+    static const char input[] = "/dev/null\n1 2 3\n";
+    int64_t t0 = now_ns();
+    if (write_all(in[1], input, sizeof(input) - 1) < 0) die("ipcbench: write(parent) failed");
+    wait_for(out[0], buf, sizeof(buf), &len, "sum=6\n");
+    int64_t t = now_ns() - t0;
+
+    close(in[1]); // EOF: родитель завершает ребёнка и выходит
+    while (read(out[0], buf, sizeof(buf)) > 0) {}
+    close(out[0]);
+    int status = 0;
+    while (waitpid(pid, &status, 0) < 0 && errno == EINTR) {}
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) die("ipcbench: родитель завершился с ошибкой");
+    return t;
+}
+
+// каталог файла path (без завершающего '/'); "." — если пути нет
+static void dir_of(const char* path, char* dst, size_t cap) {
+    const char* slash = strrchr(path, '/');
+    if (!slash) {
+        memcpy(dst, ".", 2);
+        return;
+    }
+    size_t n = slash == path ? 1 : (size_t)(slash - path); // "/child" -> "/"
+    if (n >= cap) die("ipcbench: слишком длинный путь");
+    memcpy(dst, path, n);
+    dst[n] = '\0';
+}
+
+// ---- статистика ----
+static int cmp_i64(const void* a, const void* b) {
+    int64_t x = *(const int64_t*)a, y = *(const int64_t*)b;
+    return (x > y) - (x < y);
+}
+
+// перцентиль q/1000 по отсортированному массиву
+static int64_t pct(const int64_t* v, size_t n, size_t q) {
+    size_t i = (n * q + 999) / 1000;
+    return v[i ? i - 1 : 0];
+}
+
+static int64_t tv_ns(struct timeval t) {
+    return (int64_t)t.tv_sec * 1000000000 + (int64_t)t.tv_usec * 1000;
+}
+
+static void report(int json_fd, const char* transport, size_t nums, size_t digits, size_t line_bytes,
+                   size_t window, size_t count, struct result* res) {
+    qsort(res->lat, count, sizeof(int64_t), cmp_i64);
+    int64_t p50 = pct(res->lat, count, 500), p99 = pct(res->lat, count, 990);
+    int64_t p999 = pct(res->lat, count, 999), pmax = res->lat[count - 1];
+    long long el = res->elapsed_ns > 0 ? res->elapsed_ns : 1;
+    long long mps = (long long)((__int128)count * 1000000000 / el);
+    long long bps = (long long)((__int128)count * line_bytes * 1000000000 / el);
+    long long cs_self = (res->self1.ru_nvcsw - res->self0.ru_nvcsw) + (res->self1.ru_nivcsw - res->self0.ru_nivcsw);
+    long long cs_child = res->child.ru_nvcsw + res->child.ru_nivcsw;
+    long long cpu = tv_ns(res->self1.ru_utime) - tv_ns(res->self0.ru_utime)
+                  + tv_ns(res->self1.ru_stime) - tv_ns(res->self0.ru_stime)
+                  + tv_ns(res->child.ru_utime) + tv_ns(res->child.ru_stime);
+
+    struct out o;
+    o.len = 0;
+    o_scol(&o, transport, 9);
+    o_col(&o, (long long)nums, 5);
+    o_col(&o, (long long)line_bytes, 7);
+    o_col(&o, (long long)window, 7);
+    o_col(&o, mps, 10);
+    o_col(&o, p50, 9);
+    o_col(&o, p99, 9);
+    o_col(&o, p999, 10);
+    o_col(&o, (cs_self + cs_child) * 1000 / (long long)count, 10);
+    o_col(&o, cpu / (long long)count, 10);
+    o_str(&o, "\n");
+    write_all(1, o.buf, o.len);
+
+    if (json_fd < 0) return;
+    o.len = 0;
+    o_str(&o, "{\"transport\":\"");   o_str(&o, transport);
+    o_str(&o, "\",\"nums\":");        o_num(&o, (long long)nums);
+    o_str(&o, ",\"digits\":");        o_num(&o, (long long)digits);
+    o_str(&o, ",\"line_bytes\":");    o_num(&o, (long long)line_bytes);
+    o_str(&o, ",\"window\":");        o_num(&o, (long long)window);
+    o_str(&o, ",\"count\":");         o_num(&o, (long long)count);
+    o_str(&o, ",\"elapsed_ns\":");    o_num(&o, el);
+    o_str(&o, ",\"msgs_per_s\":");    o_num(&o, mps);
+    o_str(&o, ",\"bytes_per_s\":");   o_num(&o, bps);
+    o_str(&o, ",\"lat_p50_ns\":");    o_num(&o, p50);
+    o_str(&o, ",\"lat_p99_ns\":");    o_num(&o, p99);
+    o_str(&o, ",\"lat_p999_ns\":");   o_num(&o, p999);
+    o_str(&o, ",\"lat_max_ns\":");    o_num(&o, pmax);
+    o_str(&o, ",\"ctxsw_self\":");    o_num(&o, cs_self);
+    o_str(&o, ",\"ctxsw_child\":");   o_num(&o, cs_child);
+    o_str(&o, ",\"cpu_ns_per_msg\":"); o_num(&o, cpu / (long long)count);
+    o_str(&o, "}\n");
+    if (write_all(json_fd, o.buf, o.len) < 0) die("ipcbench: write(out) failed");
+}
+
+// ---- аргументы ----
+// "1,16,128" -> v[]; возвращает число элементов, 0 — ошибка
+static void report_startup(int json_fd, const char* transport, const char* mode,
+                           int64_t* t, size_t runs) {
+    qsort(t, runs, sizeof(int64_t), cmp_i64);
+    int64_t p50 = pct(t, runs, 500), p99 = pct(t, runs, 990), pmax = t[runs - 1];
+
+    struct out o;
+    o.len = 0;
+    o_scol(&o, transport, 10);
+    o_scol(&o, mode, 5);
+    o_col(&o, (long long)runs, 6);
+    o_col(&o, p50 / 1000, 9);
+    o_col(&o, p99 / 1000, 9);
+    o_col(&o, pmax / 1000, 9);
+    o_str(&o, "\n");
+    write_all(1, o.buf, o.len);
+
+    if (json_fd < 0) return;
+    o.len = 0;
+    o_str(&o, "{\"startup\":\"");   o_str(&o, transport);
+    o_str(&o, "\",\"mode\":\"");    o_str(&o, mode);
+    o_str(&o, "\",\"runs\":");       o_num(&o, (long long)runs);
+    o_str(&o, ",\"ttfr_p50_ns\":");  o_num(&o, p50);
+    o_str(&o, ",\"ttfr_p99_ns\":");  o_num(&o, p99);
+    o_str(&o, ",\"ttfr_max_ns\":");  o_num(&o, pmax);
+    o_str(&o, "}\n");
+    if (write_all(json_fd, o.buf, o.len) < 0) die("ipcbench: write(out) failed");
+}
+
+// по строке на транспорт: ЛР1 — parent (-b для pipe-bin), ЛР3 — parent_shm
+// -T <транспорт> без -W (cold) и с ним (warm)
+static void run_startup(const char* transports, const char* pipe_child, const char* shm_child,
+                        size_t runs, int json_fd) {
+    char lab1[256], lab3[256];
+    dir_of(pipe_child, lab1, sizeof(lab1));
+    dir_of(shm_child, lab3, sizeof(lab3));
+    int64_t* t = (int64_t*)map_anon(runs * sizeof(int64_t));
+
+    const char* head = "transport  mode   runs   p50,us   p99,us   max,us\n";
+    write_all(1, head, strlen(head));
+    for (const char* s = transports; *s;) {
+        char name[16];
+        size_t k = 0;
+        while (*s && *s != ',' && k + 1 < sizeof(name)) name[k++] = *s++;
+        name[k] = '\0';
+        if (*s == ',') s++;
+        int lab = strcmp(name, "pipe") == 0 || strcmp(name, "pipe-bin") == 0 ? 1 : 3;
+        if (lab == 3 && !ipc_transport(name)) die("ipcbench: неизвестный транспорт");
+
+        for (int warm = 0; warm < (lab == 3 ? 2 : 1); ++warm) {
+            char* args[6];
+            int na = 0;
+            args[na++] = (char*)(lab == 1 ? "./parent" : "./parent_shm");
+            if (strcmp(name, "pipe-bin") == 0) args[na++] = (char*)"-b";
+            if (lab == 3 && strcmp(name, "shm") != 0) { // shm — по умолчанию
+                args[na++] = (char*)"-T";
+                args[na++] = name;
+            }
+            if (warm) args[na++] = (char*)"-W";
+            args[na] = NULL;
+            for (size_t i = 0; i < runs; ++i) t[i] = startup_once(lab == 1 ? lab1 : lab3, args);
+            report_startup(json_fd, name, warm ? "warm" : "cold", t, runs);
+        }
+    }
+    munmap(t, runs * sizeof(int64_t));
+}
+
+static size_t parse_list(const char* s, size_t* v, size_t max) {
+    char tmp[32];
+    size_t n = 0;
+    while (*s) {
+        size_t k = 0;
+        while (*s && *s != ',' && k + 1 < sizeof(tmp)) tmp[k++] = *s++;
+        tmp[k] = '\0';
+        if (*s == ',') s++;
+        if (n == MAX_LIST || (v[n++] = parse_count(tmp, max)) == 0) return 0;
+    }
+    return n;
+}
+
+static void usage(void) {
+    die("usage: ipcbench [--transport pipe,pipe-bin,shm,memfd,seqpacket,ring,eventfd] [--nums 1,16,128] [--digits 8]\n"
+        "                [--window 1,64] [--count N] [--pipe-child PATH] [--shm-child PATH]\n"
+        "                [--startup N] [--out FILE]");
+}
+
+int main(int argc, char** argv) {
+    const char* transports = "pipe,pipe-bin,shm,memfd,seqpacket,ring,eventfd";
+    const char* pipe_child = "../lab1/child";
+    const char* shm_child = "../lab3/child_shm";
+    const char* out_name = NULL;
+    size_t nums[MAX_LIST] = { 1, 16, 128 }, nnums = 3;
+    size_t windows[MAX_LIST] = { 1, 64 }, nwin = 2;
+    size_t digits = 8, count = 100000, startup = 0;
+    for (int a = 1; a < argc; ++a) {
+        const char* v = a + 1 < argc ? argv[a + 1] : NULL;
+        if (!v) usage();
+        if (strcmp(argv[a], "--transport") == 0) transports = v;
+        else if (strcmp(argv[a], "--nums") == 0) { if (!(nnums = parse_list(v, nums, 4096))) usage(); }
+        else if (strcmp(argv[a], "--window") == 0) { if (!(nwin = parse_list(v, windows, MAX_WINDOW))) usage(); }
+        else if (strcmp(argv[a], "--digits") == 0) { if (!(digits = parse_count(v, 18))) usage(); }
+        else if (strcmp(argv[a], "--count") == 0) { if (!(count = parse_count(v, 100000000))) usage(); }
+        else if (strcmp(argv[a], "--pipe-child") == 0) pipe_child = v;
+        else if (strcmp(argv[a], "--shm-child") == 0) shm_child = v;
+        else if (strcmp(argv[a], "--out") == 0) out_name = v;
+        else if (strcmp(argv[a], "--startup") == 0) { if (!(startup = parse_count(v, 100000))) usage(); }
+        else usage();
+        a++;
+    }
+
+    int json_fd = -1;
+    if (out_name) {
+        json_fd = open(out_name, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (json_fd < 0) die("ipcbench: open(out) failed");
+    }
+    signal(SIGPIPE, SIG_IGN);
+    if (startup) {
+        run_startup(transports, pipe_child, shm_child, startup, json_fd);
+        if (json_fd >= 0) close(json_fd);
+        return 0;
+    }
+
+    const char* head = "transport  nums  bytes window     msg/s   p50,ns   p99,ns p99.9,ns  csw/kmsg cpu,ns/msg\n";
+    write_all(1, head, strlen(head));
+
+    static struct msg pool[POOL];
+    struct result res;
+    res.lat = (int64_t*)map_anon(count * sizeof(int64_t));
+
+    // транспорты по списку через запятую
+    for (const char* t = transports; *t;) {
+        char name[16];
+        size_t k = 0;
+        while (*t && *t != ',' && k + 1 < sizeof(name)) name[k++] = *t++;
+        name[k] = '\0';
+        if (*t == ',') t++;
+        int bin = strcmp(name, "pipe-bin") == 0;
+        // shm и seqpacket — через ../ipc к ./child_shm
+        const struct ipc_ops* ops = bin || strcmp(name, "pipe") == 0 ? NULL : ipc_transport(name);
+        if (!bin && !ops && strcmp(name, "pipe") != 0) usage();
+
+        for (size_t i = 0; i < nnums; ++i) {
+            build_pool(pool, nums[i], digits, bin);
+            size_t line_bytes = pool[0].line_len; // длины строк пула почти равны
+            for (size_t j = 0; j < nwin; ++j) {
+                if (ops && !ops->send && windows[j] != 1) continue; // очередь — только у ring и eventfd
+                if (ops && nums[i] * (digits + 2) >= IPC_MSG_MAX) continue; // не влезает в сообщение
+                if (ops) run_chan(ops, shm_child, pool, count, windows[j], &res);
+                else run_pipe(pipe_child, pool, count, windows[j], bin, &res);
+                report(json_fd, name, nums[i], digits, line_bytes, windows[j], count, &res);
+            }
+            free_pool(pool, nums[i], digits);
+        }
+    }
+
+    munmap(res.lat, count * sizeof(int64_t));
+    if (json_fd >= 0) close(json_fd);
+    return 0;
+}
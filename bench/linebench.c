@@ -0,0 +1,151 @@
+// Замер чтения строк: прежний read_line (read() по одному байту) против
+// line_reader (../ipc/util.c: буфер 64 КиБ, поиск '\n' через memchr).
+// Меряется только чтение, без разбора и ответов.
+//
+//   linebench [--mb M] [--old-mb K] [--input FILE]
+//
+// Ввод — M МБ строк по 1–6 чисел в memfd (весь в page cache) или FILE.
+// Старый способ в сотни раз медленнее, поэтому он читает только первые
+// K МБ того же ввода. Печатает тысячи строк/с и МБ/с для обоих.
+#define _GNU_SOURCE
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <errno.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "../ipc/ipc.h"
+
+static uint64_t rng = 0x9E3779B97F4A7C15ULL;
+
+static uint64_t next_rand(void) { // xorshift64
+    rng ^= rng << 13;
+    rng ^= rng >> 7;
+    rng ^= rng << 17;
+    return rng;
+}
+
+static int64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void put(const char* s) {
+    write_all(1, s, strlen(s));
+}
+
+// x / 10 с одним знаком после точки, выровнено вправо по ширине w
+static void put_fix1(long long x10, size_t w) {
+    char tmp[32];
+    size_t n = (size_t)ll_to_buf(x10 / 10, tmp);
+    tmp[n++] = '.';
+    tmp[n++] = (char)('0' + x10 % 10);
+    while (n < w--) put(" ");
+    write_all(1, tmp, n);
+}
+
+// так ребёнок читал строки до line_reader
+static ssize_t read_line(int fd, char* buf, size_t cap) {
+    size_t i = 0;
+    while (i + 1 < cap) {
+        char c;
+        ssize_t r = read(fd, &c, 1);
+        if (r == 0) break; // EOF
+        if (r < 0) { if (errno == EINTR) continue; return -1; }
+        buf[i++] = c;
+        if (c == '\n') break;
+    }
+    buf[i] = '\0';
+    return (ssize_t)i;
+}
+
+// memfd с bytes байт строк
+static int make_input(size_t bytes) {
+    int fd = memfd_create("linebench", MFD_CLOEXEC);
+    if (fd < 0) die("linebench: memfd_create failed");
+    static char chunk[1 << 16];
+    size_t done = 0;
+    while (done < bytes) {
+        size_t k = 0;
+        while (k + 64 < sizeof(chunk)) {
+            size_t nums = next_rand() % 6 + 1;
+            for (size_t i = 0; i < nums; ++i) {
+                if (i) chunk[k++] = ' ';
+                k += (size_t)ll_to_buf((long long)(next_rand() % 100000) - 50000, chunk + k);
+            }
+            chunk[k++] = '\n';
+        }
+        if (write_all(fd, chunk, k) < 0) die("linebench: write failed");
+        done += k;
+    }
+    return fd;
+}
+
+static void report(const char* name, size_t lines, size_t bytes, int64_t ns) {
+    if (ns <= 0) ns = 1;
+    put(name);
+    for (size_t s = strlen(name); s < 12; ++s) put(" ");
+    put_fix1((long long)((double)bytes * 10 / (1 << 20)), 9);
+    char tmp[32];
+    size_t n = (size_t)ll_to_buf((long long)((double)lines * 1e6 / (double)ns), tmp);
+    for (size_t s = n; s < 11; ++s) put(" ");
+    write_all(1, tmp, n);
+    put_fix1((long long)((double)bytes * 1e10 / (double)ns / (1 << 20)), 10);
+    put("\n");
+}
+
+static void usage(void) {
+    die("usage: linebench [--mb M] [--old-mb K] [--input FILE]");
+}
+
+int main(int argc, char** argv) {
+    size_t mb = 256, old_mb = 4;
+    const char* input = NULL;
+    for (int a = 1; a < argc; ++a) {
+        const char* v = a + 1 < argc ? argv[a + 1] : NULL;
+        if (!v) usage();
+        if (strcmp(argv[a], "--mb") == 0) { if (!(mb = parse_count(v, 16384))) usage(); }
+        else if (strcmp(argv[a], "--old-mb") == 0) { if (!(old_mb = parse_count(v, 16384))) usage(); }
+        else if (strcmp(argv[a], "--input") == 0) input = v;
+        else usage();
+        a++;
+    }
+    int fd = input ? open(input, O_RDONLY | O_CLOEXEC) : make_input(mb << 20);
+    if (fd < 0) die("linebench: open(input) failed");
+    put("reader          MB   klines/s      MB/s\n");
+
+    // прежний способ: первые old_mb МБ
+    static char line[LR_BUF_SIZE];
+    size_t lines = 0, bytes = 0, limit = old_mb << 20;
+    if (lseek(fd, 0, SEEK_SET) < 0) die("linebench: lseek failed");
+    int64_t t0 = now_ns();
+    while (bytes < limit) {
+        ssize_t n = read_line(fd, line, sizeof(line));
+        if (n < 0) die("linebench: read failed");
+        if (n == 0) break;
+        bytes += (size_t)n;
+        lines++;
+    }
+    report("read_line", lines, bytes, now_ns() - t0);
+
+    // line_reader: весь ввод
+    static struct line_reader lr;
+    if (lseek(fd, 0, SEEK_SET) < 0) die("linebench: lseek failed");
+    lr_init(&lr, fd);
+    lines = bytes = 0;
+    t0 = now_ns();
+    for (;;) {
+        const char* p;
+        ssize_t n = lr_next(&lr, LR_BUF_SIZE, &p);
+        if (n < 0) die("linebench: read failed");
+        if (n == 0) break;
+        bytes += (size_t)n;
+        lines++;
+    }
+    report("line_reader", lines, bytes, now_ns() - t0);
+    close(fd);
+    return 0;
+}
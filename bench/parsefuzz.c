@@ -0,0 +1,366 @@
+// Проверка и замер разбора строк (../ipc/parse.c): каждая реализация
+// sum_line и vals_line, которую умеет CPU (PARSE_IMPL=scalar|sse42|avx2),
+// против эталона — цикла parse_ll, каким ребёнок разбирал строку раньше.
+//
+//   parsefuzz [--lines N] [--seed S]
+//   parsefuzz --bench [--mb M]
+//
+// Фазз: N случайных строк — числа от 1 до 25 цифр (больше 19 — переполнение),
+// знаки и знаки без цифр, ведущие нули, пределы long long, пробелы,
+// табуляции и '\r', '.' и ',' в числе, чужие символы; короткие строки и
+// длинные, на много 32-байтных блоков; конец — '\n' или '\0'. Каждая
+// строка разбирается дважды: со случайным выравниванием и вплотную к
+// странице без доступа — векторная загрузка за конец строки там упала бы
+// (PAGE_SAFE). Сверяются код, сумма и, у vals_line, сами числа. На первом
+// расхождении печатается реализация и строка, код выхода 1.
+//
+// --bench: МБ/с и млн строк/с на трёх нагрузках (M МБ строк каждая, лучший
+// из BENCH_RUNS прогонов), parse_ll — для сравнения с тем, что было до SIMD.
+#define _GNU_SOURCE
+#include <unistd.h>
+#include <sys/mman.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "../ipc/ipc.h"
+
+#define LINE_MAX_LEN 8192          // длиннее фазз строк не делает
+#define VALS_MAX (LINE_MAX_LEN / 2 + 1)
+#define BENCH_RUNS 5
+
+static uint64_t rng = 0x9E3779B97F4A7C15ULL;
+
+static uint64_t next_rand(void) { // xorshift64
+    rng ^= rng << 13;
+    rng ^= rng >> 7;
+    rng ^= rng << 17;
+    return rng;
+}
+
+static size_t rnd(size_t n) {
+    return (size_t)(next_rand() % n);
+}
+
+static int64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void put(const char* s) {
+    write_all(1, s, strlen(s));
+}
+
+static void put_num(long long v) {
+    char buf[32];
+    write_all(1, buf, (size_t)ll_to_buf(v, buf));
+}
+
+// ---- реализации ----
+struct impl {
+    const char* name;
+    int (*sum)(const char* s, long long* sum);
+    int (*vals)(const char* s, long long* sum, long long* vals, size_t* nvals);
+};
+
+// эталон: parse_ll число за числом, первая ошибка — ответ (как vals_line);
+// vals == NULL — только сумма
+static int ref_vals(const char* s, long long* sum, long long* vals, size_t* nvals) {
+    size_t i = 0, nv = 0;
+    long long v, acc = 0;
+    for (;;) {
+        int st = parse_ll(s, &i, &v);
+        if (st == PARSE_END) break;
+        if (st != PARSE_OK) return st;
+        if (__builtin_add_overflow(acc, v, &acc)) return PARSE_OVERFLOW;
+        if (vals) vals[nv] = v;
+        nv++;
+    }
+    *sum = acc;
+    if (vals) *nvals = nv;
+    return nv ? PARSE_OK : PARSE_END;
+}
+
+static int ref_sum(const char* s, long long* sum) {
+    return ref_vals(s, sum, NULL, NULL);
+}
+
+// все реализации, которые умеет этот CPU: parse_init по очереди с PARSE_IMPL
+static size_t load_impls(struct impl* im) {
+    static const char* names[] = { "scalar", "sse42", "avx2" };
+    __builtin_cpu_init();
+    int have[] = { 1, __builtin_cpu_supports("sse4.2"),
+                   __builtin_cpu_supports("sse4.2") && __builtin_cpu_supports("avx2") };
+    size_t n = 0;
+    for (size_t k = 0; k < 3; ++k) {
+        if (!have[k]) continue;
+        if (setenv("PARSE_IMPL", names[k], 1) < 0) die("parsefuzz: setenv failed");
+        parse_init();
+        im[n].name = names[k];
+        im[n].sum = sum_line;
+        im[n].vals = vals_line;
+        n++;
+    }
+    unsetenv("PARSE_IMPL");
+    parse_init();
+    return n;
+}
+
+// ---- фазз ----
+static size_t put_str(char* p, const char* s) {
+    size_t n = strlen(s);
+    memcpy(p, s, n);
+    return n;
+}
+
+// одно число (или то, что на него похоже)
+static size_t gen_number(char* p) {
+    static const char* edge[] = {
+        "9223372036854775807", "9223372036854775808", "-9223372036854775808",
+        "-9223372036854775809", "0", "-0", "+0", "00000000000000000000001",
+        "99999999999999999999", "18446744073709551616",
+    };
+    size_t k = 0, r = rnd(100);
+    if (r < 5) return put_str(p, edge[rnd(sizeof(edge) / sizeof(edge[0]))]);
+    if (r < 25) p[k++] = rnd(2) ? '-' : '+';
+    if (rnd(10) == 0) // ведущие нули
+        for (size_t z = rnd(6) + 1; z; --z) p[k++] = '0';
+    r = rnd(100);
+    size_t nd = r < 60 ? rnd(8) + 1 : r < 95 ? rnd(11) + 9 : rnd(6) + 20;
+    if (rnd(50) == 0) nd = 0; // знак без цифр
+    for (size_t d = 0; d < nd; ++d) p[k++] = (char)('0' + rnd(10));
+    r = rnd(100);
+    if (r < 3) { // дробное
+        p[k++] = rnd(2) ? '.' : ',';
+        for (size_t d = rnd(4); d; --d) p[k++] = (char)('0' + rnd(10));
+    } else if (r < 5) { // чужой символ вплотную
+        p[k++] = "x#a/-+:"[rnd(7)];
+    }
+    return k;
+}
+
+// строка в p (не длиннее LINE_MAX_LEN вместе с концом); возвращает длину без конца
+static size_t gen_line(char* p) {
+    size_t ntok = rnd(10) < 7 ? rnd(9) : rnd(600);
+    size_t k = 0;
+    if (rnd(4) == 0) p[k++] = ' ';
+    for (size_t t = 0; t < ntok && k + 128 < LINE_MAX_LEN; ++t) { // запас: пробелы и число
+        if (t) {
+            size_t r = rnd(100);
+            if (r < 80) p[k++] = ' ';
+            else if (r < 90) for (size_t s = rnd(40) + 1; s; --s) p[k++] = ' ';
+            else p[k++] = "\t\r \t"[rnd(4)];
+        }
+        if (rnd(200) == 0) p[k++] = "x#?"[rnd(3)]; // мусор вместо числа
+        else k += gen_number(p + k);
+    }
+    if (rnd(4) == 0) p[k++] = ' ';
+    p[k] = rnd(5) ? '\n' : '\0';
+    return k;
+}
+
+static void show_line(const char* s, size_t n) {
+    put("строка (");
+    put_num((long long)n);
+    put(" байт): ");
+    write_all(1, s, n);
+    put("\n");
+}
+
+static void fail(const struct impl* im, const char* fn, const char* where, const char* s, size_t n,
+                 int want_st, long long want, int got_st, long long got) {
+    put("parsefuzz: расхождение: ");
+    put(im->name);
+    put(" ");
+    put(fn);
+    put(", строка ");
+    put(where);
+    put(": ожидалось st=");
+    put_num(want_st);
+    put(" sum=");
+    put_num(want);
+    put(", получено st=");
+    put_num(got_st);
+    put(" sum=");
+    put_num(got);
+    put("\n");
+    show_line(s, n);
+    _exit(1);
+}
+
+// сверить все реализации с эталоном на строке s (n байт без конца)
+static void check(const struct impl* im, size_t nimpl, const char* s, size_t n, const char* where) {
+    static long long want_v[VALS_MAX], got_v[VALS_MAX];
+    long long want = 0, got = 0;
+    size_t want_n = 0, got_n = 0;
+    int want_st = ref_vals(s, &want, want_v, &want_n);
+    for (size_t k = 0; k < nimpl; ++k) {
+        int st = im[k].sum(s, &got);
+        if (st != want_st || (st == PARSE_OK && got != want))
+            fail(&im[k], "sum_line", where, s, n, want_st, want, st, got);
+        st = im[k].vals(s, &got, got_v, &got_n);
+        if (st != want_st || (st == PARSE_OK && got != want))
+            fail(&im[k], "vals_line", where, s, n, want_st, want, st, got);
+        if (st == PARSE_OK && (got_n != want_n || memcmp(got_v, want_v, want_n * sizeof(long long)) != 0))
+            fail(&im[k], "vals_line (числа)", where, s, n, want_st, (long long)want_n, st, (long long)got_n);
+    }
+}
+
+static void run_fuzz(const struct impl* im, size_t nimpl, size_t lines) {
+    // область: страницы под строку и за ними одна без доступа
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    size_t span = (LINE_MAX_LEN + 64 + page - 1) / page * page;
+    char* m = (char*)mmap(NULL, span + page, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (m == MAP_FAILED) die("parsefuzz: mmap failed");
+    if (mprotect(m + span, page, PROT_NONE) < 0) die("parsefuzz: mprotect failed");
+    static char line[LINE_MAX_LEN + 1];
+    size_t stats[4] = { 0 }; // OK, END, BAD, OVERFLOW
+    for (size_t i = 0; i < lines; ++i) {
+        size_t n = gen_line(line);
+        char* a = m + rnd(64); // случайное выравнивание, за строкой — ещё данные
+        memcpy(a, line, n + 1);
+        memset(a + n + 1, "7 \n"[rnd(3)], 32);
+        check(im, nimpl, a, n, "в середине");
+        char* b = m + span - (n + 1); // конец строки — последний байт перед PROT_NONE
+        memmove(b, line, n + 1);
+        check(im, nimpl, b, n, "у границы страницы");
+        long long s;
+        int st = ref_sum(line, &s);
+        stats[st == PARSE_OK ? 0 : st == PARSE_END ? 1 : st == PARSE_BAD ? 2 : 3]++;
+    }
+    munmap(m, span + page);
+    put("parsefuzz: ");
+    put_num((long long)lines);
+    put(" строк, реализации:");
+    for (size_t k = 0; k < nimpl; ++k) {
+        put(" ");
+        put(im[k].name);
+    }
+    put("; ok=");
+    put_num((long long)stats[0]);
+    put(" no_numbers=");
+    put_num((long long)stats[1]);
+    put(" bad_format=");
+    put_num((long long)stats[2]);
+    put(" overflow=");
+    put_num((long long)stats[3]);
+    put(" — расхождений нет\n");
+}
+
+// ---- замер ----
+struct workload {
+    const char* name;
+    size_t nums, digits;     // чисел в строке и цифр в числе
+};
+
+// M МБ строк по w; смещения начал строк — в *offs
+static char* build_load(const struct workload* w, size_t bytes, uint32_t** offs, size_t* nlines) {
+    char* buf = (char*)mmap(NULL, bytes + LINE_MAX_LEN, PROT_READ | PROT_WRITE,
+                            MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    size_t cap = bytes / (w->nums * 2) + 1;
+    uint32_t* o = (uint32_t*)mmap(NULL, cap * sizeof(uint32_t), PROT_READ | PROT_WRITE,
+                                  MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (buf == MAP_FAILED || o == MAP_FAILED) die("parsefuzz: mmap failed");
+    size_t k = 0, n = 0;
+    while (k < bytes && n < cap) {
+        o[n++] = (uint32_t)k;
+        for (size_t i = 0; i < w->nums; ++i) {
+            if (i) buf[k++] = ' ';
+            buf[k++] = (char)('1' + rnd(9));
+            for (size_t d = 1; d < w->digits; ++d) buf[k++] = (char)('0' + rnd(10));
+        }
+        buf[k++] = '\n';
+    }
+    *offs = o;
+    *nlines = n;
+    return buf;
+}
+
+static volatile long long sink;
+
+// лучший из BENCH_RUNS прогонов sum по всем строкам, нс
+static int64_t time_impl(int (*sum)(const char*, long long*), const char* buf, const uint32_t* offs, size_t n) {
+    int64_t best = INT64_MAX;
+    for (int r = 0; r < BENCH_RUNS; ++r) {
+        long long acc = 0, s = 0;
+        int64_t t0 = now_ns();
+        for (size_t i = 0; i < n; ++i)
+            if (sum(buf + offs[i], &s) == PARSE_OK) acc += s;
+        int64_t t = now_ns() - t0;
+        sink = acc;
+        if (t < best) best = t;
+    }
+    return best;
+}
+
+// x / 10 с одним знаком после точки, выровнено вправо по ширине w
+static void put_fix1(long long x10, size_t w) {
+    char tmp[32];
+    size_t n = (size_t)ll_to_buf(x10 / 10, tmp);
+    tmp[n++] = '.';
+    tmp[n++] = (char)('0' + x10 % 10);
+    while (n < w--) put(" ");
+    write_all(1, tmp, n);
+}
+
+static void run_bench(const struct impl* im, size_t nimpl, size_t mb) {
+    static const struct workload loads[] = {
+        { "short", 3, 5 },      // ~18 байт: на строку приходится больше, чем на числа
+        { "wide", 16, 8 },      // 16 чисел по 8 цифр
+        { "long", 8, 16 },      // 16-значные числа
+    };
+    put("impl     load        MB/s  Mlines/s\n");
+    for (size_t l = 0; l < sizeof(loads) / sizeof(loads[0]); ++l) {
+        uint32_t* offs;
+        size_t n;
+        char* buf = build_load(&loads[l], mb << 20, &offs, &n);
+        size_t bytes = offs[n - 1];
+        while (buf[bytes] != '\n') bytes++;
+        bytes++;
+        for (size_t k = 0; k <= nimpl; ++k) {
+            const char* name = k < nimpl ? im[k].name : "parse_ll";
+            int64_t t = time_impl(k < nimpl ? im[k].sum : ref_sum, buf, offs, n);
+            if (t <= 0) t = 1;
+            put(name);
+            for (size_t s = strlen(name); s < 9; ++s) put(" ");
+            put(loads[l].name);
+            for (size_t s = strlen(loads[l].name); s < 6; ++s) put(" ");
+            put_fix1((long long)((double)bytes * 1e10 / (double)t / (1 << 20)), 10);
+            put_fix1((long long)((double)n * 1e4 / (double)t), 10);
+            put("\n");
+        }
+        munmap(buf, (mb << 20) + LINE_MAX_LEN);
+        munmap(offs, ((mb << 20) / (loads[l].nums * 2) + 1) * sizeof(uint32_t));
+    }
+}
+
+static void usage(void) {
+    die("usage: parsefuzz [--lines N] [--seed S]\n"
+        "       parsefuzz --bench [--mb M]");
+}
+
+int main(int argc, char** argv) {
+    size_t lines = 200000, mb = 64;
+    int bench = 0;
+    for (int a = 1; a < argc; ++a) {
+        if (strcmp(argv[a], "--bench") == 0) {
+            bench = 1;
+            continue;
+        }
+        const char* v = a + 1 < argc ? argv[a + 1] : NULL;
+        if (!v) usage();
+        if (strcmp(argv[a], "--lines") == 0) { if (!(lines = parse_count(v, 100000000))) usage(); }
+        else if (strcmp(argv[a], "--seed") == 0) { if (!(rng = parse_count(v, (size_t)-1))) usage(); }
+        else if (strcmp(argv[a], "--mb") == 0) { if (!(mb = parse_count(v, 1024))) usage(); }
+        else usage();
+        a++;
+    }
+
+    struct impl im[3];
+    size_t nimpl = load_impls(im);
+    if (bench) run_bench(im, nimpl, mb);
+    else run_fuzz(im, nimpl, lines);
+    return 0;
+}
@@ -0,0 +1,145 @@
+// Канал запрос-ответ (ipc.h): выбор транспорта, запуск ребёнка и общие
+// вызовы. Всё, что зависит от транспорта, — в его таблице ipc_ops.
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <spawn.h>
+#include <errno.h>
+#include <string.h>
+
+#include "ipc.h"
+
+static const struct ipc_ops* const transports[] = {
+    &ipc_pipe_ops, &ipc_shm_ops, &ipc_memfd_ops, &ipc_seqpacket_ops, &ipc_ring_ops,
+    &ipc_eventfd_ops,
+};
+#define NTRANSPORTS (sizeof(transports) / sizeof(transports[0]))
+
+const struct ipc_ops* ipc_transport(const char* name) {
+    for (size_t k = 0; k < NTRANSPORTS; ++k)
+        if (strcmp(transports[k]->name, name) == 0) return transports[k];
+    return NULL;
+}
+
+const char* ipc_name(const struct ipc_chan* ch) {
+    return ch->ops->name;
+}
+
+static void chan_init(struct ipc_chan* ch, const struct ipc_ops* ops) {
+    memset(ch, 0, sizeof(*ch));
+    ch->ops = ops;
+    for (int k = 0; k < 4; ++k) ch->fd[k] = -1;
+}
+
+#define MAX_ARGS 32
+
+void ipc_spawn(struct ipc_chan* ch, const struct ipc_ops* ops, const char* path,
+               char** head, char** tail, char** envp) {
+    chan_init(ch, ops);
+    ch->owner = 1;
+    char* addr[8] = { NULL }; // у ring — признак и три имени, плюс NULL
+    ops->create(ch, addr);
+
+    // argv: head, адрес канала, tail
+    char* args[MAX_ARGS];
+    int na = 0;
+    for (int k = 0; head[k]; ++k) if (na < MAX_ARGS - 1) args[na++] = head[k];
+    for (int k = 0; addr[k]; ++k) if (na < MAX_ARGS - 1) args[na++] = addr[k];
+    for (int k = 0; tail && tail[k]; ++k) if (na < MAX_ARGS - 1) args[na++] = tail[k];
+    args[na] = NULL;
+
+    // posix_spawn вместо fork+execve: glibc запускает ребёнка через
+    // clone(CLONE_VM | CLONE_VFORK), не копируя таблицы страниц родителя,
+    // а ошибка execve возвращается сюда же. Перестановки дескрипторов
+    // транспорта выполняются file actions.
+    posix_spawn_file_actions_t fa;
+    if (posix_spawn_file_actions_init(&fa) != 0) die("posix_spawn_file_actions_init failed");
+    if (ops->actions) ops->actions(ch, &fa);
+    pid_t pid;
+    int err = posix_spawn(&pid, path, &fa, NULL, args, envp);
+    posix_spawn_file_actions_destroy(&fa);
+    if (err != 0) {
+        char msg[300] = "posix_spawn ";
+        size_t n = strlen(path);
+        if (n > sizeof(msg) - 24) n = sizeof(msg) - 24;
+        memcpy(msg + 12, path, n);
+        memcpy(msg + 12 + n, " failed", 8);
+        die(msg);
+    }
+    ch->pid = pid;
+    if (ops->in_parent) ops->in_parent(ch);
+}
+
+size_t ipc_call(struct ipc_chan* ch, const char* req, size_t n, const char** rep) {
+    return ch->ops->call(ch, req, n, rep);
+}
+
+int ipc_send(struct ipc_chan* ch, const char* req, size_t n) {
+    if (ch->ops->send) return ch->ops->send(ch, req, n);
+    // очереди нет: обмен сразу, ответ полежит до ipc_take
+    if (ch->npend) return 0;
+    ch->pend_len = ch->ops->call(ch, req, n, &ch->pend);
+    ch->npend = 1;
+    return 1;
+}
+
+size_t ipc_take(struct ipc_chan* ch, const char** rep) {
+    if (ch->ops->take) return ch->ops->take(ch, rep);
+    if (!ch->npend) return 0;
+    ch->npend = 0;
+    *rep = ch->pend;
+    return ch->pend_len;
+}
+
+int ipc_finish(struct ipc_chan* ch) {
+    ch->ops->end(ch);
+    int status = 0;
+    // pid 0 — не ребёнок (демон, ipc_connect)
+    while (ch->pid && waitpid(ch->pid, &status, 0) < 0 && errno == EINTR) {}
+    ch->ops->release(ch);
+    return status;
+}
+
+char* ipc_big(struct ipc_chan* ch, size_t n) {
+    if (!ch->ops->big) return NULL;
+    if (n > IPC_BIG_MAX) die("слишком длинный запрос");
+    return ch->ops->big(ch, n);
+}
+
+int ipc_event_fd(struct ipc_chan* ch) {
+    return ch->ops->event_fd ? ch->ops->event_fd(ch) : -1;
+}
+
+// Без arm и try_take: у транспорта без очереди ответ, если он есть, уже
+// лежит (ipc_send делает обмен сразу); у ring ответы видны только ipc_take
+int ipc_arm(struct ipc_chan* ch) {
+    if (ch->ops->arm) return ch->ops->arm(ch);
+    return !(ch->npend && !ch->ops->take);
+}
+
+size_t ipc_try_take(struct ipc_chan* ch, const char** rep) {
+    if (ch->ops->try_take) return ch->ops->try_take(ch, rep);
+    return ch->ops->take ? 0 : ipc_take(ch, rep);
+}
+
+int ipc_attach(struct ipc_chan* ch, char** argv, int argc) {
+    // транспорт — по признаку в первом аргументе адреса; без признака — shm
+    const struct ipc_ops* ops = &ipc_shm_ops;
+    for (size_t k = 0; k < NTRANSPORTS; ++k)
+        if (argc > 0 && transports[k]->flag && strcmp(transports[k]->flag, argv[0]) == 0)
+            ops = transports[k];
+    chan_init(ch, ops);
+    return ops->attach(ch, argv, argc);
+}
+
+size_t ipc_recv(struct ipc_chan* ch, const char** req) {
+    return ch->ops->recv(ch, req);
+}
+
+void ipc_reply(struct ipc_chan* ch, const char* rep, size_t n) {
+    ch->ops->reply(ch, rep, n);
+}
+
+void ipc_close(struct ipc_chan* ch) {
+    ch->ops->release(ch);
+}
@@ -0,0 +1,305 @@
+// Демон (ipc.h): один долгоживущий child_shm --daemon обслуживает сразу
+// многих родителей. Он создаёт сегмент с известным именем IPC_DAEMON_NAME —
+// реестр из IPC_DAEMON_SLOTS мест. Клиент занимает свободное место (CAS pid
+// в слот) и дальше меняется с демоном строками, как в транспорте shm:
+// запрос в in_buf, ответ в out_buf. Демон однопоточный и не может спать на
+// семафорах всех мест сразу, поэтому клиент, положив запрос, поднимает
+// флаг pending своего места и звонит в общий звонок (счётчик событий
+// doorbell, futex); ответа клиент ждёт на ipc_fsem своего места.
+//
+// Конец работы клиента — пустой запрос. Если клиент пропал молча (упал),
+// демон замечает это при обходе (не чаще раза в CHECK_MS) по kill(pid, 0)
+// и тоже освобождает место. Клиент, в свою очередь, ожидая ответа,
+// проверяет, жив ли демон.
+#define _GNU_SOURCE
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <spawn.h>
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include <time.h>
+#include <errno.h>
+#include <limits.h>
+#include <string.h>
+
+#include "ipc.h"
+
+#define CACHE_LINE  64
+#define DMN_MAGIC   0x31444d53u     // "SMD1": раскладка сегмента
+#define CHECK_MS    1000            // обход мёртвых клиентов / проверка демона
+#define START_MS    2000            // сколько ждать запущенного демона
+
+struct dmn_slot {
+    int32_t pid;                // клиент; 0 — место свободно
+    uint32_t pending;           // 1 — в in_buf запрос для демона
+    struct ipc_fsem rep __attribute__((aligned(CACHE_LINE)));
+    char in_buf[IPC_MSG_MAX] __attribute__((aligned(CACHE_LINE)));
+    char out_buf[IPC_MSG_MAX];
+};
+
+struct dmn_seg {
+    uint32_t magic;
+    int32_t pid;                // демон
+    uint32_t doorbell __attribute__((aligned(CACHE_LINE)));
+    uint32_t sleeping;          // 1 — демон спит на звонке
+    struct dmn_slot slot[IPC_DAEMON_SLOTS] __attribute__((aligned(CACHE_LINE)));
+};
+
+static volatile sig_atomic_t stopping;
+
+static long futex(uint32_t* w, int op, uint32_t val, const struct timespec* t) {
+    return syscall(SYS_futex, w, op, val, t, NULL, 0);
+}
+
+static int alive(pid_t pid) {
+    return pid > 0 && (kill(pid, 0) == 0 || errno != ESRCH);
+}
+
+static struct dmn_seg* dmn_map(int fd) {
+    void* map = mmap(NULL, sizeof(struct dmn_seg), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED) die("mmap failed");
+    close(fd); // отображение остаётся и без дескриптора
+    return (struct dmn_seg*)map;
+}
+
+// ======= клиент: транспорт daemon =======
+#define SEG(ch)  ((struct dmn_seg*)(ch)->shm)
+#define SLOT(ch) (&SEG(ch)->slot[(ch)->fd[1]])
+
+// реестр запущенного демона; NULL — демона нет (или сегмент чужой сборки)
+static struct dmn_seg* dmn_find(void) {
+    int fd = shm_open(IPC_DAEMON_NAME, O_RDWR, 0);
+    if (fd < 0) return NULL;
+    struct stat st;
+    if (fstat(fd, &st) < 0 || st.st_size != (off_t)sizeof(struct dmn_seg)) {
+        close(fd);
+        return NULL;
+    }
+    struct dmn_seg* d = dmn_map(fd);
+    if (__atomic_load_n(&d->magic, __ATOMIC_ACQUIRE) != DMN_MAGIC || !alive(d->pid)) {
+        munmap(d, sizeof(*d));
+        return NULL;
+    }
+    return d;
+}
+
+// запустить демон отдельной сессией; ввод-вывод — /dev/null, чтобы он не
+// держал каналы родителя (иначе `parent_shm | ...` не дождётся EOF)
+static void dmn_start(const char* path, char** argv, char** envp) {
+    posix_spawn_file_actions_t fa;
+    posix_spawnattr_t at;
+    if (posix_spawn_file_actions_init(&fa) != 0 || posix_spawnattr_init(&at) != 0)
+        die("posix_spawn init failed");
+    for (int k = 0; k < 3; ++k)
+        if (posix_spawn_file_actions_addopen(&fa, k, "/dev/null", k ? O_WRONLY : O_RDONLY, 0) != 0)
+            die("posix_spawn_file_actions failed");
+    posix_spawnattr_setflags(&at, POSIX_SPAWN_SETSID);
+    pid_t pid;
+    int err = posix_spawn(&pid, path, &fa, &at, argv, envp);
+    posix_spawn_file_actions_destroy(&fa);
+    posix_spawnattr_destroy(&at);
+    if (err != 0) die("posix_spawn(daemon) failed");
+    // ребёнком он остаётся только до нашего выхода; зомби не важен
+}
+
+void ipc_connect(struct ipc_chan* ch, const char* path, char** argv, char** envp) {
+    memset(ch, 0, sizeof(*ch));
+    ch->ops = &ipc_daemon_ops;
+    for (int k = 0; k < 4; ++k) ch->fd[k] = -1;
+    struct dmn_seg* d = dmn_find();
+    if (!d) {
+        dmn_start(path, argv, envp);
+        struct timespec t = { 0, 10 * 1000000L };
+        for (int k = 0; !d && k < START_MS / 10; ++k) {
+            nanosleep(&t, NULL);
+            d = dmn_find();
+        }
+        if (!d) die("демон не запустился");
+    }
+    pid_t self = getpid();
+    for (int i = 0; i < IPC_DAEMON_SLOTS && ch->fd[1] < 0; ++i) {
+        int32_t z = 0;
+        if (__atomic_compare_exchange_n(&d->slot[i].pid, &z, (int32_t)self, 0, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED))
+            ch->fd[1] = i;
+    }
+    if (ch->fd[1] < 0) die("демон: свободных мест нет");
+    ch->shm = d;
+    ch->pid = 0; // не ребёнок: ipc_finish не ждёт его
+}
+
+static void dmn_ring(struct dmn_seg* d) {
+    __atomic_fetch_add(&d->doorbell, 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&d->sleeping, __ATOMIC_SEQ_CST))
+        futex(&d->doorbell, FUTEX_WAKE, 1, NULL);
+}
+
+static void dmn_put(struct ipc_chan* ch, const char* req, size_t n) {
+    struct dmn_slot* s = SLOT(ch);
+    if (n > IPC_MSG_MAX - 1) n = IPC_MSG_MAX - 1;
+    memcpy(s->in_buf, req, n);
+    s->in_buf[n] = '\0';
+    __atomic_store_n(&s->pending, 1, __ATOMIC_SEQ_CST);
+    dmn_ring(SEG(ch));
+}
+
+static size_t dmn_call(struct ipc_chan* ch, const char* req, size_t n, const char** rep) {
+    struct dmn_slot* s = SLOT(ch);
+    dmn_put(ch, req, n);
+    while (!ipc_fsem_timedwait(&s->rep, CHECK_MS))
+        if (!alive(SEG(ch)->pid)) return 0; // демон пропал — как закрытый канал
+    *rep = s->out_buf;
+    return strlen(s->out_buf);
+}
+
+static void dmn_end(struct ipc_chan* ch) {
+    dmn_put(ch, "", 0); // место освободит демон
+}
+
+static void dmn_release(struct ipc_chan* ch) {
+    munmap(ch->shm, sizeof(struct dmn_seg));
+}
+
+// только клиентская сторона: демон работает через ipc_daemon_*
+const struct ipc_ops ipc_daemon_ops = {
+    "daemon", NULL,
+    NULL, NULL, NULL, dmn_call, NULL, NULL, dmn_end,
+    NULL, NULL, NULL, dmn_release, NULL,
+    NULL, NULL, NULL,
+};
+
+// ======= демон =======
+// Сегмент с нашим именем остался от упавшего демона (или от другой сборки)?
+// Только что созданный другим демоном (magic ещё 0) — не старый.
+static int dmn_stale(void) {
+    int fd = shm_open(IPC_DAEMON_NAME, O_RDWR, 0);
+    if (fd < 0) return 0;
+    struct stat st;
+    if (fstat(fd, &st) < 0 || st.st_size == 0) {
+        close(fd);
+        return 0;
+    }
+    if (st.st_size != (off_t)sizeof(struct dmn_seg)) {
+        close(fd);
+        return 1;
+    }
+    struct dmn_seg* d = dmn_map(fd);
+    int stale = __atomic_load_n(&d->magic, __ATOMIC_ACQUIRE) == DMN_MAGIC && !alive(d->pid);
+    munmap(d, sizeof(*d));
+    return stale;
+}
+
+int ipc_daemon_open(struct ipc_daemon* dm) {
+    memset(dm, 0, sizeof(*dm));
+    dm->freeing = -1;
+    int fd = shm_open(IPC_DAEMON_NAME, O_CREAT | O_EXCL | O_RDWR, 0666);
+    if (fd < 0 && errno == EEXIST && dmn_stale()) {
+        shm_unlink(IPC_DAEMON_NAME);
+        fd = shm_open(IPC_DAEMON_NAME, O_CREAT | O_EXCL | O_RDWR, 0666);
+    }
+    if (fd < 0) return 0; // демон уже есть (или запускается)
+    if (ftruncate(fd, sizeof(struct dmn_seg)) < 0) die("ftruncate failed");
+    struct dmn_seg* d = dmn_map(fd); // ftruncate обнуляет: все места свободны
+    d->pid = getpid();
+    __atomic_store_n(&d->magic, DMN_MAGIC, __ATOMIC_RELEASE);
+    dm->seg = d;
+    return 1;
+}
+
+void ipc_daemon_stop(void) {
+    stopping = 1;
+}
+
+// есть запрос — забрать (pending снимается, ответить надо ipc_daemon_reply)
+static int take_pending(struct ipc_daemon* dm, int* slot) {
+    struct dmn_seg* d = dm->seg;
+    for (int k = 0; k < IPC_DAEMON_SLOTS; ++k) {
+        int i = (dm->next + k) % IPC_DAEMON_SLOTS;
+        if (__atomic_load_n(&d->slot[i].pending, __ATOMIC_ACQUIRE)) {
+            __atomic_store_n(&d->slot[i].pending, 0, __ATOMIC_RELAXED);
+            dm->next = i + 1; // по кругу: один болтливый клиент не заслонит остальных
+            *slot = i;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+struct take_arg {
+    struct ipc_daemon* dm;
+    int slot;
+};
+
+static int take_try(void* arg) {
+    struct take_arg* a = (struct take_arg*)arg;
+    return take_pending(a->dm, &a->slot);
+}
+
+static int64_t now_ms(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (int64_t)t.tv_sec * 1000 + t.tv_nsec / 1000000;
+}
+
+// клиент, который пропал, не сказав; -1 — таких нет (или рано проверять:
+// обход — не чаще раза в CHECK_MS, даже когда демон занят)
+static int find_dead(struct ipc_daemon* dm) {
+    int64_t now = now_ms();
+    if (now - dm->checked < CHECK_MS) return -1;
+    dm->checked = now;
+    for (int i = 0; i < IPC_DAEMON_SLOTS; ++i) {
+        pid_t pid = __atomic_load_n(&dm->seg->slot[i].pid, __ATOMIC_ACQUIRE);
+        if (pid && !alive(pid)) return i;
+    }
+    return -1;
+}
+
+ssize_t ipc_daemon_recv(struct ipc_daemon* dm, int* slot, const char** req) {
+    struct dmn_seg* d = dm->seg;
+    if (dm->freeing >= 0) {
+        // о конце клиента уже сообщили: место — следующему
+        struct dmn_slot* s = &d->slot[dm->freeing];
+        __atomic_store_n(&s->pending, 0, __ATOMIC_RELAXED);
+        memset(&s->rep, 0, sizeof(s->rep));
+        __atomic_store_n(&s->pid, 0, __ATOMIC_RELEASE);
+        dm->freeing = -1;
+    }
+    struct take_arg a = { dm, -1 };
+    for (;;) {
+        uint32_t seen = __atomic_load_n(&d->doorbell, __ATOMIC_SEQ_CST);
+        if (stopping) return -1;
+        int dead = find_dead(dm);
+        if (dead >= 0) {
+            dm->freeing = *slot = dead;
+            return 0;
+        }
+        if (ipc_spin(take_try, &a)) {
+            struct dmn_slot* s = &d->slot[a.slot];
+            *slot = a.slot;
+            *req = s->in_buf;
+            size_t n = strlen(s->in_buf);
+            if (!n) dm->freeing = a.slot;
+            return (ssize_t)n;
+        }
+        struct timespec t = { CHECK_MS / 1000, (CHECK_MS % 1000) * 1000000L };
+        __atomic_store_n(&d->sleeping, 1, __ATOMIC_SEQ_CST);
+        futex(&d->doorbell, FUTEX_WAIT, seen, &t); // звонок, CHECK_MS или сигнал
+        __atomic_store_n(&d->sleeping, 0, __ATOMIC_RELAXED);
+    }
+}
+
+void ipc_daemon_reply(struct ipc_daemon* dm, int slot, const char* rep, size_t n) {
+    struct dmn_slot* s = &dm->seg->slot[slot];
+    if (n > IPC_MSG_MAX - 1) n = IPC_MSG_MAX - 1;
+    memcpy(s->out_buf, rep, n);
+    s->out_buf[n] = '\0';
+    ipc_fsem_post(&s->rep);
+}
+
+void ipc_daemon_close(struct ipc_daemon* dm) {
+    shm_unlink(IPC_DAEMON_NAME);
+    munmap(dm->seg, sizeof(struct dmn_seg));
+}
@@ -0,0 +1,385 @@
+// Общая часть ЛР1 и ЛР3 (libipc.a): ввод-вывод без stdio, чтение строк,
+// разбор чисел и канал запрос-ответ между родителем и ребёнком.
+//
+// Канал один и тот же для всех транспортов; транспорт выбирается по имени
+// (ipc_transport) и меняется флагом командной строки:
+//   pipe      — пара каналов, строка запроса в stdin ребёнка, ответ из stdout;
+//   shm       — shared memory + пара именованных семафоров (как в ЛР3);
+//   memfd     — то же без имён: сегмент memfd с неименованными семафорами
+//               внутри, ребёнку передаётся дескриптором;
+//   seqpacket — пара UNIX-сокетов SOCK_SEQPACKET: сообщение = одна строка;
+//   ring      — shared memory с двумя кольцами SPSC (запросы и ответы):
+//               много строк в полёте, семафоры — только чтобы разбудить;
+//   eventfd   — кольца ring в сегменте memfd, будят eventfd: ответы можно
+//               ждать в epoll вместе с другими дескрипторами.
+// Родитель: ipc_spawn -> ipc_call ... -> ipc_finish (или вместо ipc_call —
+// ipc_send ... ipc_take, чтобы не ждать ответа на каждую строку).
+// Ребёнок:  ipc_attach -> ipc_recv / ipc_reply ... -> ipc_close.
+#ifndef IPC_IPC_H
+#define IPC_IPC_H
+
+#include <sys/types.h>
+#include <spawn.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// ======= ввод-вывод =======
+// сообщение в stderr и немедленный выход
+void die(const char* msg) __attribute__((noreturn));
+ssize_t write_all(int fd, const void* buf, size_t n);
+// обрезать завершающий \n, если есть
+void chomp(char* s);
+// разбор положительного целого из аргумента командной строки (не больше max); 0 — ошибка
+size_t parse_count(const char* s, size_t max);
+// целое -> строка; пишет прямо в buf, возвращает длину
+int ll_to_buf(long long v, char* buf);
+// имя объекта IPC: prefix + pid (+ "_k" для k > 0), например /shm_sum_12345
+void ipc_make_name(char* dst, const char* prefix, pid_t pid, int k);
+
+// ======= буферизованное чтение строк =======
+// Один read() заполняет сразу много строк, поиск '\n' идёт через memchr.
+// Строки отдаются указателем прямо в буфер, без копирования.
+#define LR_BUF_SIZE 65536
+
+struct line_reader {
+    int fd;
+    int eof;
+    size_t pos;               // начало непрочитанных данных
+    size_t len;               // конец данных в buf
+    size_t scanned;           // сколько байт после pos уже проверено на '\n'
+    char buf[LR_BUF_SIZE + 1]; // +1 под завершающий '\0'
+};
+
+void lr_init(struct line_reader* lr, int fd);
+// перенести хвост неполной строки в начало буфера
+void lr_compact(struct line_reader* lr);
+// дочитать данные в буфер (хвост неполной строки переносится в начало).
+// Возвращает результат read(): >0, 0 при EOF, -1 при ошибке.
+ssize_t lr_fill(struct line_reader* lr);
+// Взять строку только из уже прочитанных данных, без read().
+// Возвращает длину строки (вместе с '\n') или 0, если полной строки в буфере
+// нет. *line указывает внутрь буфера и действителен до следующего lr_fill.
+// Строка длиннее max режется на куски по max байт; после EOF отдаётся и
+// последняя строка без '\n'.
+// Если строка без '\n' упирается в конец данных (EOF или полный буфер),
+// за ней пишется '\0' — разбор всегда остановится на '\n' либо на '\0'.
+size_t lr_take(struct line_reader* lr, size_t max, const char** line);
+// Возвращает длину строки (вместе с '\n'), 0 при EOF, -1 при ошибке.
+ssize_t lr_next(struct line_reader* lr, size_t max, const char** line);
+// дочитать, пока в буфере не будет хотя бы n байт (n <= LR_BUF_SIZE).
+// 1 — есть, 0 — EOF раньше.
+int lr_need(struct line_reader* lr, size_t n);
+// Дочитать начатую строку прямо в dst (не больше cap > 0 байт): сначала то,
+// что уже в буфере, потом read() сразу в dst; прочитанное после '\n'
+// остаётся в буфере. Возвращает, сколько байт положено, -1 при ошибке;
+// *done = 1 — строка кончилась ('\n' положен или EOF).
+ssize_t lr_read_rest(struct line_reader* lr, char* dst, size_t cap, int* done);
+
+// ======= разбор целых =======
+// Скалярный путь и SIMD (SSE4.2 / AVX2), выбор при запуске — parse_init().
+#define PARSE_OK        1
+#define PARSE_END       0   // токенов больше нет (в sum_line — чисел не нашлось)
+#define PARSE_BAD      -1   // дробное число: 12.2 или 12,2
+#define PARSE_OVERFLOW -2   // число или сумма не помещаются в long long
+
+// выбрать реализацию по CPU; PARSE_IMPL=scalar|sse42|avx2 — принудительно
+void parse_init(void);
+// очередное число строки s с позиции *i (эталонный скалярный путь)
+int parse_ll(const char* s, size_t* i, long long* out);
+// Сумма чисел строки (строка заканчивается '\n' или '\0'). Возвращает
+// PARSE_OK, PARSE_END (чисел нет), PARSE_BAD или PARSE_OVERFLOW —
+// первая встреченная ошибка.
+extern int (*sum_line)(const char* s, long long* sum);
+// то же, но сами числа складываются в vals (места — на столько чисел,
+// сколько может быть в строке), их количество — в *nvals
+extern int (*vals_line)(const char* s, long long* sum, long long* vals, size_t* nvals);
+
+// ======= ожидание (wait.c) =======
+// Крутиться с pause, пока try(arg) не вернёт 1, не дольше бюджета
+// (IPC_SPIN=N итераций; без переменной бюджет подстраивается по тому, чем
+// кончались прошлые ожидания; на одном CPU — 0). 1 — дождались, 0 — пора спать.
+int ipc_spin(int (*try)(void*), void* arg);
+
+// семафор на двух словах в общей памяти: сначала кручение, потом FUTEX_WAIT;
+// post зовёт FUTEX_WAKE, только если кто-то спит. Нули — семафор со значением 0.
+struct ipc_fsem {
+    uint32_t val;
+    uint32_t waiters;
+};
+void ipc_fsem_post(struct ipc_fsem* s);
+void ipc_fsem_wait(struct ipc_fsem* s);
+// то же, но не дольше ms (< 0 — без предела); 1 — дождались, 0 — время вышло
+int ipc_fsem_timedwait(struct ipc_fsem* s, long ms);
+// sem_wait для sem_t* (именованного или нет): сначала кручение на sem_trywait
+void ipc_sem_wait(void* sem);
+
+// ======= канал запрос-ответ =======
+// Запрос — строка с '\n' на конце, ответ — текст ответа ребёнка.
+// Вместе с завершающим '\0' не больше IPC_MSG_MAX байт. Длиннее — только
+// запрос и только у shm и memfd (растущая область длинных запросов в том
+// же сегменте, ребёнок разбирает его на месте) и у ring и eventfd (идёт
+// кусками через кольцо, ребёнок собирает их у себя); см. ipc_big.
+#define IPC_MSG_MAX 2048
+#define IPC_BIG_MAX ((size_t)1 << 32)   // предел длинного запроса
+
+struct ipc_ops;
+
+struct ipc_chan {
+    const struct ipc_ops* ops;
+    pid_t pid;                  // родитель: pid ребёнка
+    int owner;                  // 1 — канал создан этим процессом (ему и удалять)
+    int fd[4];                  // каналы / сокеты транспорта
+    struct line_reader* lr;     // pipe: чтение строк (mmap)
+    void* shm;                  // shm, memfd: отображённый сегмент
+    void* sem[2];               // shm, ring: sem_t* запроса и ответа; memfd: ipc_fsem*
+    char name[3][64];           // shm, ring: имена сегмента и семафоров
+    char* big;                  // shm, memfd, ring, eventfd: область длинных запросов
+    size_t big_size;            // сколько её отображено
+    size_t held;                // ring, eventfd: принятая запись, которую ещё читают
+    const char* pend;           // ipc_send без очереди: ответ ждёт ipc_take
+    size_t pend_len;
+    int npend;
+    char msg[IPC_MSG_MAX];      // pipe, seqpacket: последнее принятое сообщение
+};
+
+// транспорт по имени ("pipe", "shm", "memfd", "seqpacket", "ring", "eventfd"); NULL — такого нет
+const struct ipc_ops* ipc_transport(const char* name);
+// имя транспорта канала
+const char* ipc_name(const struct ipc_chan* ch);
+
+// Родитель: создать канал и запустить path. argv ребёнка — head,
+// затем адрес канала (его разбирает ipc_attach), затем tail; оба списка
+// завершены NULL.
+void ipc_spawn(struct ipc_chan* ch, const struct ipc_ops* ops, const char* path,
+               char** head, char** tail, char** envp);
+// Отдать запрос (n байт) и дождаться ответа. *rep указывает на ответ,
+// завершённый '\0', и действителен до следующего вызова. Возвращает его
+// длину; 0 — ребёнок закрыл канал.
+size_t ipc_call(struct ipc_chan* ch, const char* req, size_t n, const char** rep);
+// Отдать запрос, не дожидаясь ответа. 1 — запрос ушёл; 0 — места нет:
+// сначала забрать ответ ipc_take. Без очереди у транспорта (всё, кроме
+// ring) в полёте не больше одного запроса. До ipc_finish все ответы надо
+// забрать: ребёнок, которому некуда положить ответ, ждёт.
+int ipc_send(struct ipc_chan* ch, const char* req, size_t n);
+// Дождаться ответа на самый ранний из отданных ipc_send запросов (ответы
+// идут в порядке запросов). *rep — как у ipc_call.
+size_t ipc_take(struct ipc_chan* ch, const char** rep);
+// Сообщить ребёнку о конце работы, дождаться его и освободить канал.
+// Возвращает статус waitpid.
+int ipc_finish(struct ipc_chan* ch);
+// Место в канале под запрос из n байт (n <= IPC_BIG_MAX), чтобы не
+// копировать его: строку собирают прямо здесь и отдают ipc_call /
+// ipc_send. Содержимое при повторном вызове с большим n сохраняется, но
+// место может переехать. На прошлые запросы к этому времени ответ уже
+// получен: у shm и memfd в полёте один, у ring и eventfd длинный запрос
+// уходит только целиком, а ребёнок, которому некуда положить ответ, кусков
+// не разбирает. NULL — транспорт длинных запросов не умеет.
+char* ipc_big(struct ipc_chan* ch, size_t n);
+// Ответы в цикле событий (epoll, poll) вместо ожидания в ipc_take.
+// Дескриптор, который станет читаемым, когда ребёнок положит ответ;
+// -1 — транспорт так не умеет (всё, кроме eventfd).
+int ipc_event_fd(struct ipc_chan* ch);
+// Перед сном в epoll: попросить ребёнка разбудить через ipc_event_fd.
+// 0 — ответ уже есть, спать нельзя: забрать ipc_try_take. Работают с
+// любым транспортом, но без ipc_event_fd будить некому: у pipe, shm,
+// memfd и seqpacket ответ на ipc_send уже готов, у ring — только ipc_take.
+int ipc_arm(struct ipc_chan* ch);
+// как ipc_take, но не ждёт: 0 — ответа пока нет
+size_t ipc_try_take(struct ipc_chan* ch, const char** rep);
+
+// Ребёнок: подключиться к каналу по адресу в argv (argc — сколько там
+// аргументов). Возвращает число разобранных аргументов, -1 — адреса нет.
+int ipc_attach(struct ipc_chan* ch, char** argv, int argc);
+// Дождаться запроса. *req — строка, которая заканчивается '\n' или '\0',
+// действительна до следующего ipc_recv. Возвращает длину, 0 — конец работы.
+size_t ipc_recv(struct ipc_chan* ch, const char** req);
+// отдать ответ (n байт) на последний запрос
+void ipc_reply(struct ipc_chan* ch, const char* rep, size_t n);
+void ipc_close(struct ipc_chan* ch);
+
+// ---- транспорт изнутри ----
+// Реализация каждого транспорта — таблица ipc_ops в своём файле.
+struct ipc_ops {
+    const char* name;
+    const char* flag;   // признак в argv ребёнка; NULL — адрес без признака (shm)
+    // родитель, до запуска ребёнка: создать канал; addr — аргументы адреса для ребёнка (до 7)
+    void   (*create)(struct ipc_chan* ch, char** addr);
+    // file actions для posix_spawn: дескрипторы, которые получит ребёнок
+    void   (*actions)(struct ipc_chan* ch, posix_spawn_file_actions_t* fa);
+    void   (*in_parent)(struct ipc_chan* ch);   // после запуска
+    size_t (*call)(struct ipc_chan* ch, const char* req, size_t n, const char** rep);
+    // очередь запросов: не дожидаясь ответа / ответ; NULL — очереди нет
+    int    (*send)(struct ipc_chan* ch, const char* req, size_t n);
+    size_t (*take)(struct ipc_chan* ch, const char** rep);
+    void   (*end)(struct ipc_chan* ch);         // родитель: запросов больше не будет
+    int    (*attach)(struct ipc_chan* ch, char** argv, int argc);
+    size_t (*recv)(struct ipc_chan* ch, const char** req);
+    void   (*reply)(struct ipc_chan* ch, const char* rep, size_t n);
+    void   (*release)(struct ipc_chan* ch);     // освободить (обе стороны)
+    char*  (*big)(struct ipc_chan* ch, size_t n); // ipc_big; NULL — не умеет
+    // ipc_event_fd, ipc_arm, ipc_try_take; NULL — не умеет
+    int    (*event_fd)(struct ipc_chan* ch);
+    int    (*arm)(struct ipc_chan* ch);
+    size_t (*try_take)(struct ipc_chan* ch, const char** rep);
+};
+
+extern const struct ipc_ops ipc_pipe_ops;
+extern const struct ipc_ops ipc_shm_ops;
+extern const struct ipc_ops ipc_memfd_ops;
+extern const struct ipc_ops ipc_seqpacket_ops;
+extern const struct ipc_ops ipc_ring_ops;
+extern const struct ipc_ops ipc_eventfd_ops;
+extern const struct ipc_ops ipc_daemon_ops;
+
+// ======= пул обработчиков (pool.c) =======
+// Несколько детей на одном сегменте shared memory: родитель кладёт строки
+// в общую очередь, кто из детей свободен — забирает. У каждой строки номер
+// по порядку; ответы родитель получает по порядку номеров, и в файл
+// результатов (его пишут дети) они попадают в том же порядке. Дети
+// подключаются когда угодно (child_shm - --pool <имя>) и уходят по SIGTERM.
+#define IPC_POOL_SLOTS    512   // строк в работе, не больше
+#define IPC_POOL_WORKERS  64
+#define IPC_POOL_FILE_MAX 512
+
+struct pool_seg;
+
+struct ipc_pool {
+    struct pool_seg* seg;
+    char name[64];              // имя сегмента
+    int owner;
+    // родитель
+    uint64_t sent, taken;       // строк отдано / ответов получено
+    int held;                   // ответ taken - 1 ещё читают
+    int warned;                 // уже сказали, что обработчиков нет
+    int npids;
+    pid_t pids[IPC_POOL_WORKERS];   // запущенные сами; < 0 — уже забран waitpid
+    int status;                 // первый ненулевой статус waitpid
+    // ребёнок
+    pid_t pid;
+    int slot;                   // место в списке обработчиков
+    uint64_t cur;               // номер строки в работе
+    int fd;                     // файл результатов (сюда дописывает ipc_pool_reply)
+};
+
+// Родитель: создать сегмент (/shm_pool_<pid>); детей можно запускать сразу
+void ipc_pool_create(struct ipc_pool* p);
+// имя файла результатов и список агрегатов (NULL — только sum): дети,
+// которые их ждут, начинают работу
+void ipc_pool_start(struct ipc_pool* p, const char* file, const char* aggs);
+// запустить ребёнка: argv — head, --pool <имя>, tail
+void ipc_pool_spawn(struct ipc_pool* p, const char* path, char** head, char** tail, char** envp);
+// как ipc_send / ipc_take: 0 — места нет (сначала забрать ответ) / ответов
+// не ждём; ответ действителен до следующего вызова
+int ipc_pool_send(struct ipc_pool* p, const char* req, size_t n);
+size_t ipc_pool_take(struct ipc_pool* p, const char** rep);
+// все ответы забраны: отпустить детей, дождаться своих, удалить сегмент.
+// Возвращает первый ненулевой статус waitpid (или 0).
+int ipc_pool_finish(struct ipc_pool* p);
+
+// Ребёнок: подключиться по argv "--pool <имя>" (2 аргумента; -1 — не то)
+// и дождаться ipc_pool_start
+int ipc_pool_attach(struct ipc_pool* p, char** argv, int argc);
+// NULL — родитель закончил раньше, чем назвал файл
+const char* ipc_pool_file(const struct ipc_pool* p);
+const char* ipc_pool_aggs(const struct ipc_pool* p);
+// файл результатов не открылся — родитель завершится с ошибкой
+void ipc_pool_fail(struct ipc_pool* p);
+// следующая строка; 0 — работы больше нет (родитель закончил или ipc_pool_leave)
+size_t ipc_pool_recv(struct ipc_pool* p, const char** req);
+// ответ на строку: родителю и в файл p->fd — по порядку номеров строк
+void ipc_pool_reply(struct ipc_pool* p, const char* rep, size_t n);
+// из обработчика сигнала: досчитать текущую строку и уйти
+void ipc_pool_leave(void);
+void ipc_pool_close(struct ipc_pool* p);
+
+// ======= демон (daemon.c) =======
+// Долгоживущий child_shm --daemon на реестре с известным именем: у каждого
+// клиента своё место (канал как у shm), запускать ребёнка на каждый сеанс
+// не нужно. Места клиентов, которые упали, демон освобождает сам.
+#define IPC_DAEMON_NAME  "/shm_sum_daemon"
+#define IPC_DAEMON_SLOTS 32
+
+// Клиент: подключиться к демону; если его нет — запустить path с argv
+// (отдельной сессией, ввод-вывод — /dev/null) и дождаться. Дальше — как с
+// ребёнком: ipc_call / ipc_send / ipc_take / ipc_finish (ждать процесс
+// ipc_finish не будет). Демон пропал — ipc_call вернёт 0.
+void ipc_connect(struct ipc_chan* ch, const char* path, char** argv, char** envp);
+
+struct dmn_seg;
+
+struct ipc_daemon {
+    struct dmn_seg* seg;
+    int next;                   // с какого места смотреть запросы (по кругу)
+    int freeing;                // место, о конце которого уже сообщили; -1 — нет
+    int64_t checked;            // когда искали упавших клиентов (мс)
+};
+
+// Демон: создать реестр. 0 — демон уже запущен.
+int ipc_daemon_open(struct ipc_daemon* dm);
+// Следующий запрос любого клиента, *slot — его место. 0 — клиент закончил
+// (пустой запрос) или пропал: закрыть всё, что открыто для места; -1 —
+// ipc_daemon_stop. Порядок запросов одного клиента сохраняется.
+ssize_t ipc_daemon_recv(struct ipc_daemon* dm, int* slot, const char** req);
+void ipc_daemon_reply(struct ipc_daemon* dm, int slot, const char* rep, size_t n);
+// из обработчика сигнала: ipc_daemon_recv вернёт -1
+void ipc_daemon_stop(void);
+void ipc_daemon_close(struct ipc_daemon* dm);
+
+// ======= счётчики и задержки (stats.c) =======
+// У процесса (родителя, ребёнка, обработчика пула, демона) — сегмент
+// /shm_stat_<pid>: счётчики строк и ошибок, глубина очереди и гистограмма
+// задержек. Пишет только сам процесс (relaxed-записями, без блокировок и
+// RMW), читает shmstat (ЛР3) — только для чтения, никого не останавливая.
+// IPC_STATS=0 — не заводить.
+#define IPC_STATS_PREFIX "/shm_stat_"
+#define IPC_STATS_MAGIC  0x31544154534d4853ULL   // "SHMSTAT1"
+#define IPC_HIST_SUB     8                       // корзин на степень двойки
+#define IPC_HIST_BUCKETS (62 * IPC_HIST_SUB)
+// задержка меряется у каждой IPC_STATS_SAMPLE-й строки: два clock_gettime
+// на каждую — около 10% времени строки у ring
+#define IPC_STATS_SAMPLE 8
+
+#define IPC_ROLE_PARENT 1
+#define IPC_ROLE_CHILD  2
+#define IPC_ROLE_WORKER 3   // обработчик пула
+#define IPC_ROLE_DAEMON 4
+
+enum {
+    IPC_ST_LINES,       // строк: ребёнок — разобрано, родитель — отдано
+    IPC_ST_REPLIES,     // родитель: ответов получено
+    IPC_ST_OK,          // ребёнок: ответов с суммой
+    IPC_ST_BAD_FORMAT,  // ERR: invalid number format
+    IPC_ST_OVERFLOW,    // ERR: integer overflow
+    IPC_ST_NO_NUMBERS,  // чисел нет
+    IPC_ST_TOO_LONG,    // родитель: ERR: line too long
+    IPC_ST_BYTES,       // байт строк
+    IPC_ST_INFLIGHT,    // родитель: строк без ответа сейчас (значение, не счётчик)
+    IPC_ST_N
+};
+
+struct ipc_stats {
+    uint64_t magic;             // пишется последним: заголовок готов
+    int32_t pid;
+    int32_t role;
+    char transport[16];
+    int64_t started_ns;         // CLOCK_MONOTONIC
+    uint64_t c[IPC_ST_N] __attribute__((aligned(64)));
+    // задержка в нс: родитель — от отдачи строки до ответа, ребёнок — от
+    // получения строки до отданного ответа
+    uint64_t hist[IPC_HIST_BUCKETS] __attribute__((aligned(64)));
+};
+
+int64_t ipc_now_ns(void);
+// завести сегмент; NULL — IPC_STATS=0 или не вышло (работать можно и так)
+struct ipc_stats* ipc_stats_open(int role, const char* transport);
+// убрать сегмент (NULL — ничего)
+void ipc_stats_close(struct ipc_stats* s);
+void ipc_stat_add(struct ipc_stats* s, int k, uint64_t v);
+void ipc_stat_set(struct ipc_stats* s, int k, uint64_t v);
+// учесть задержку от since (ipc_now_ns) до сейчас; возвращает сейчас
+int64_t ipc_stat_lat(struct ipc_stats* s, int64_t since);
+// корзина гистограммы для ns и нижняя граница корзины
+unsigned ipc_hist_bucket(uint64_t ns);
+uint64_t ipc_hist_value(unsigned b);
+
+#endif
@@ -0,0 +1,302 @@
+// Разбор целых (ipc.h): скалярный путь и SIMD (SSE4.2 / AVX2), выбор при запуске.
+#include <errno.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <limits.h>
+#include <immintrin.h>
+
+#include "ipc.h"
+
+// SIMD-вариант классифицирует строку блоками по 32 байта: битовые маски
+// цифр, пробелов и знаков. Из масок сразу видно начала всех чисел блока и
+// место, где разбор обрывается (чужой символ, знак без цифры, '\n', '\0').
+// Числа блока переводятся независимо друг от друга (до 16 цифр — тремя
+// умножениями-сложениями SSE), так что их задержки перекрываются, а не
+// выстраиваются в цепочку, как в посимвольном цикле.
+// Векторная загрузка может заглянуть за конец строки, поэтому делается
+// только если не пересекает границу страницы (как strlen в libc); иначе
+// блок копируется в локальный буфер.
+#define IMPL_SSE42  1
+#define IMPL_AVX2   2
+
+#define PAGE_SAFE(p, n) ((((uintptr_t)(p)) & 4095) <= 4096 - (n))
+#define INLINE static inline __attribute__((always_inline))
+#define IS_DIGIT(c) ((unsigned char)((c) - '0') <= 9)
+
+// Серия цифр скаляром. В *pn — её длина, *ovf — значащих цифр больше 19.
+INLINE uint64_t digits_scalar(const char* p, size_t* pn, int* ovf) {
+    uint64_t u = 0;
+    size_t n = 0;
+    while (IS_DIGIT(p[n])) {
+        u = u * 10 + (uint64_t)(p[n] - '0');
+        n++;
+    }
+    *pn = n;
+    *ovf = 0;
+    if (n > 19) { // редкий случай: возможно, это ведущие нули
+        size_t z = 0;
+        while (p[z] == '0' && z + 1 < n) z++;
+        if (n - z > 19) *ovf = 1;
+        else for (u = 0; z < n; ++z) u = u * 10 + (uint64_t)(p[z] - '0');
+    }
+    return u;
+}
+
+// простой парсер long long (десятичный) — эталонный скалярный путь
+int parse_ll(const char* s, size_t* i, long long* out) {
+    while (s[*i] == ' ' || s[*i] == '\t' || s[*i] == '\r') (*i)++;
+
+    int neg = 0;
+    if (s[*i] == '+' || s[*i] == '-') {
+        if (s[*i] == '-') neg = 1;
+        (*i)++;
+    }
+
+    if (!IS_DIGIT(s[*i])) return PARSE_END;
+
+    size_t n;
+    int ovf;
+    uint64_t u = digits_scalar(s + *i, &n, &ovf);
+    *i += n;
+
+    // проверка на . или ,
+    if (s[*i] == '.' || s[*i] == ',') {
+        *out = 0;
+        while (s[*i] && s[*i] != ' ' && s[*i] != '\n') (*i)++;
+        errno = EINVAL;
+        return PARSE_BAD;
+    }
+
+    // |LLONG_MIN| = LLONG_MAX + 1
+    if (ovf || u > (uint64_t)LLONG_MAX + (uint64_t)neg) return PARSE_OVERFLOW;
+    *out = neg ? (long long)(0 - u) : (long long)u;
+    return PARSE_OK;
+}
+
+// Сумма чисел строки (строка заканчивается '\n' или '\0'). Возвращает
+// PARSE_OK, PARSE_END (чисел нет), PARSE_BAD или PARSE_OVERFLOW —
+// первая встреченная ошибка. Если vals != NULL, сами числа складываются
+// в vals (места — на все числа строки), их количество — в *nvals.
+static int vals_line_scalar(const char* s, long long* sum, long long* vals, size_t* nvals) {
+    size_t i = 0, nv = 0;
+    long long val, acc = 0;
+    for (;;) {
+        int st = parse_ll(s, &i, &val);
+        if (st == PARSE_END) break;
+        if (st != PARSE_OK) return st;
+        if (__builtin_add_overflow(acc, val, &acc)) return PARSE_OVERFLOW;
+        if (vals) vals[nv] = val;
+        nv++;
+    }
+    *sum = acc;
+    if (vals) *nvals = nv;
+    return nv ? PARSE_OK : PARSE_END;
+}
+
+static int sum_line_scalar(const char* s, long long* sum) {
+    return vals_line_scalar(s, sum, NULL, NULL);
+}
+
+// маски pshufb: n цифр прижимаются вправо, слева — нули
+static __m128i shift_masks[17];
+
+// n <= 16 цифр (уже минус '0') -> число: пары -> 2 цифры (maddubs),
+// -> 4 (madd), -> 8 (madd), две половины склеиваются скаляром
+__attribute__((target("sse4.2")))
+static inline uint64_t digits16_sse42(__m128i v, size_t n) {
+    v = _mm_shuffle_epi8(v, shift_masks[n]);
+    v = _mm_maddubs_epi16(v, _mm_setr_epi8(10, 1, 10, 1, 10, 1, 10, 1, 10, 1, 10, 1, 10, 1, 10, 1));
+    v = _mm_madd_epi16(v, _mm_setr_epi16(100, 1, 100, 1, 100, 1, 100, 1));
+    v = _mm_packus_epi32(v, v);
+    v = _mm_madd_epi16(v, _mm_setr_epi16(10000, 1, 10000, 1, 10000, 1, 10000, 1));
+    return (uint64_t)(uint32_t)_mm_cvtsi128_si32(v) * 100000000ULL
+         + (uint32_t)_mm_extract_epi32(v, 1);
+}
+
+// до 8 цифр (SWAR): 8 байт в регистр, цифры прижимаются к старшим байтам,
+// затем три умножения склеивают пары, четвёрки и восьмёрки
+INLINE uint64_t digits8_swar(const char* p, size_t n) {
+    uint64_t x;
+    memcpy(&x, p, 8);
+    x = (x - 0x3030303030303030ULL) << (8 * (8 - n));
+    x = (x * 10 + (x >> 8)) & 0x00FF00FF00FF00FFULL;
+    x = (x * 100 + (x >> 16)) & 0x0000FFFF0000FFFFULL;
+    return (x * 10000 + (x >> 32)) & 0xFFFFFFFFULL;
+}
+
+// n цифр с p -> число; до 19 значащих цифр: старшие до 3 скаляром,
+// младшие 16 — одним вектором
+__attribute__((target("sse4.2")))
+static inline uint64_t digits_sse42(const char* p, size_t n, int* ovf) {
+    *ovf = 0;
+    if (n <= 8 && PAGE_SAFE(p, 8)) return digits8_swar(p, n);
+    if (n > 16) {
+        while (n > 1 && *p == '0') { p++; n--; } // ведущие нули
+        if (n > 19) { *ovf = 1; return 0; }
+    }
+    size_t h = n > 16 ? n - 16 : 0;
+    uint64_t hi = 0;
+    for (size_t k = 0; k < h; ++k) hi = hi * 10 + (uint64_t)(p[k] - '0');
+    p += h;
+    n -= h;
+    uint64_t lo;
+    if (PAGE_SAFE(p, 16)) {
+        __m128i v = _mm_sub_epi8(_mm_loadu_si128((const __m128i*)p), _mm_set1_epi8('0'));
+        lo = digits16_sse42(v, n);
+    } else {
+        lo = 0;
+        for (size_t k = 0; k < n; ++k) lo = lo * 10 + (uint64_t)(p[k] - '0');
+    }
+    return hi * 10000000000000000ULL + lo;
+}
+
+// длина серии цифр, продолжающейся с p: SSE4.2 pcmpestri по 16 байт
+__attribute__((target("sse4.2")))
+static size_t digit_run_sse42(const char* p) {
+    const __m128i range = _mm_setr_epi8('0', '9', 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+    size_t n = 0;
+    while (PAGE_SAFE(p + n, 16)) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(p + n));
+        // индекс первого байта вне диапазона '0'..'9'; 16 — все цифры
+        int k = _mm_cmpestri(range, 2, v, 16,
+                             _SIDD_UBYTE_OPS | _SIDD_CMP_RANGES | _SIDD_NEGATIVE_POLARITY);
+        n += (size_t)k;
+        if (k < 16) return n;
+    }
+    while (IS_DIGIT(p[n])) n++;
+    return n;
+}
+
+// маски 16 байт: цифры, пробелы (' ', '\t', '\r'), знаки ('+', '-')
+__attribute__((target("sse4.2")))
+static inline void classify16(const char* p, uint32_t* d, uint32_t* w, uint32_t* sg) {
+    __m128i v = _mm_loadu_si128((const __m128i*)p);
+    __m128i x = _mm_sub_epi8(v, _mm_set1_epi8('0'));
+    __m128i dig = _mm_cmpeq_epi8(_mm_min_epu8(x, _mm_set1_epi8(9)), x);
+    __m128i ws = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(' ')),
+                                           _mm_cmpeq_epi8(v, _mm_set1_epi8('\t'))),
+                              _mm_cmpeq_epi8(v, _mm_set1_epi8('\r')));
+    __m128i sign = _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('+')),
+                                _mm_cmpeq_epi8(v, _mm_set1_epi8('-')));
+    *d = (uint32_t)_mm_movemask_epi8(dig);
+    *w = (uint32_t)_mm_movemask_epi8(ws);
+    *sg = (uint32_t)_mm_movemask_epi8(sign);
+}
+
+// то же для 32 байт
+__attribute__((target("avx2")))
+static inline void classify32(const char* p, uint32_t* d, uint32_t* w, uint32_t* sg) {
+    __m256i v = _mm256_loadu_si256((const __m256i*)p);
+    __m256i x = _mm256_sub_epi8(v, _mm256_set1_epi8('0'));
+    __m256i dig = _mm256_cmpeq_epi8(_mm256_min_epu8(x, _mm256_set1_epi8(9)), x);
+    __m256i ws = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(' ')),
+                                                 _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\t'))),
+                                 _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\r')));
+    __m256i sign = _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('+')),
+                                   _mm256_cmpeq_epi8(v, _mm256_set1_epi8('-')));
+    *d = (uint32_t)_mm256_movemask_epi8(dig);
+    *w = (uint32_t)_mm256_movemask_epi8(ws);
+    *sg = (uint32_t)_mm256_movemask_epi8(sign);
+}
+
+// impl — константа времени компиляции; вместе с SIMD-помощниками
+// встраивается в варианты ниже (flatten). vals — как у vals_line_scalar.
+static inline int sum_line_blocks(const char* s, long long* sum, long long* vals, size_t* nvals, int impl) {
+    char pad[32];
+    size_t nv = 0;
+    long long acc = 0;
+    uint32_t carry = 0;     // последний байт предыдущего блока — цифра
+    for (size_t b = 0;; b += 32) {
+        const char* blk = s + b;
+        if (!PAGE_SAFE(blk, 32)) { // блок у края страницы: скопировать до конца строки
+            size_t k = 0;
+            while (k < 32 && blk[k] && blk[k] != '\n') { pad[k] = blk[k]; k++; }
+            memset(pad + k, 0, 32 - k);
+            blk = pad;
+        }
+
+        uint32_t d, w, sg;
+        if (impl == IMPL_AVX2) {
+            classify32(blk, &d, &w, &sg);
+        } else {
+            uint32_t d1, w1, s1;
+            classify16(blk, &d, &w, &sg);
+            classify16(blk + 16, &d1, &w1, &s1);
+            d |= d1 << 16; w |= w1 << 16; sg |= s1 << 16;
+        }
+
+        // разбор обрывается на чужом байте или на знаке, за которым не цифра
+        uint32_t next_digit = (d >> 1) | ((uint32_t)(sg >> 31 && IS_DIGIT(s[b + 32])) << 31);
+        uint32_t stop_mask = ~(d | w | sg) | (sg & ~next_digit);
+        unsigned stop = stop_mask ? (unsigned)__builtin_ctz(stop_mask) : 32;
+
+        uint32_t starts = d & ~(d << 1 | carry);
+        if (stop < 32) starts &= (1U << stop) - 1;
+
+        for (; starts; starts &= starts - 1) {
+            unsigned k = (unsigned)__builtin_ctz(starts);
+            const char* p = s + b + k;
+            size_t n = (size_t)__builtin_ctzll(~(uint64_t)(d >> k));
+            if (k + n == 32) n += digit_run_sse42(p + n); // серия уходит в следующий блок
+
+            if (p[n] == '.' || p[n] == ',') {
+                errno = EINVAL;
+                return PARSE_BAD;
+            }
+            int ovf;
+            uint64_t u = digits_sse42(p, n, &ovf);
+            int neg = (b + k) > 0 && p[-1] == '-';
+            if (ovf || u > (uint64_t)LLONG_MAX + (uint64_t)neg) return PARSE_OVERFLOW;
+            long long val = neg ? (long long)(0 - u) : (long long)u;
+            if (__builtin_add_overflow(acc, val, &acc)) return PARSE_OVERFLOW;
+            if (vals) vals[nv] = val;
+            nv++;
+        }
+
+        if (stop < 32) break;
+        carry = d >> 31;
+    }
+    *sum = acc;
+    if (vals) *nvals = nv;
+    return nv ? PARSE_OK : PARSE_END;
+}
+
+__attribute__((target("sse4.2"), flatten))
+static int sum_line_sse42(const char* s, long long* sum) {
+    return sum_line_blocks(s, sum, NULL, NULL, IMPL_SSE42);
+}
+
+__attribute__((target("avx2"), flatten))
+static int sum_line_avx2(const char* s, long long* sum) {
+    return sum_line_blocks(s, sum, NULL, NULL, IMPL_AVX2);
+}
+
+__attribute__((target("sse4.2"), flatten))
+static int vals_line_sse42(const char* s, long long* sum, long long* vals, size_t* nvals) {
+    return sum_line_blocks(s, sum, vals, nvals, IMPL_SSE42);
+}
+
+__attribute__((target("avx2"), flatten))
+static int vals_line_avx2(const char* s, long long* sum, long long* vals, size_t* nvals) {
+    return sum_line_blocks(s, sum, vals, nvals, IMPL_AVX2);
+}
+
+int (*sum_line)(const char* s, long long* sum) = sum_line_scalar;
+int (*vals_line)(const char* s, long long* sum, long long* vals, size_t* nvals) = vals_line_scalar;
+
+void parse_init(void) {
+    for (int n = 0; n <= 16; ++n) {
+        char m[16];
+        for (int k = 0; k < 16; ++k) m[k] = (char)(k < 16 - n ? 0x80 : k - (16 - n));
+        shift_masks[n] = _mm_loadu_si128((const __m128i*)m);
+    }
+    __builtin_cpu_init();
+    int sse42 = __builtin_cpu_supports("sse4.2");
+    int avx2 = sse42 && __builtin_cpu_supports("avx2");
+    const char* force = getenv("PARSE_IMPL");
+    if (force && strcmp(force, "scalar") == 0) sse42 = avx2 = 0;
+    if (force && strcmp(force, "sse42") == 0) avx2 = 0;
+    sum_line = avx2 ? sum_line_avx2 : sse42 ? sum_line_sse42 : sum_line_scalar;
+    vals_line = avx2 ? vals_line_avx2 : sse42 ? vals_line_sse42 : vals_line_scalar;
+}
@@ -0,0 +1,95 @@
+// Транспорт pipe: запрос — строка в stdin ребёнка, ответ — строка из его
+// stdout (тот же обмен, что у ЛР1 в текстовом режиме). Конец работы — EOF.
+#define _GNU_SOURCE
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <spawn.h>
+#include <string.h>
+
+#include "ipc.h"
+
+// fd: 0 — конец родителя для записи, 1 — для чтения, 2, 3 — концы ребёнка
+
+static struct line_reader* lr_map(int fd) {
+    void* p = mmap(NULL, sizeof(struct line_reader), PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED) die("mmap failed");
+    lr_init((struct line_reader*)p, fd);
+    return (struct line_reader*)p;
+}
+
+static void pipe_create(struct ipc_chan* ch, char** addr) {
+    int req[2], rep[2];
+    // O_CLOEXEC: концы родителя не утекут в execve ребёнка
+    if (pipe2(req, O_CLOEXEC) < 0 || pipe2(rep, O_CLOEXEC) < 0) die("pipe failed");
+    ch->fd[0] = req[1];
+    ch->fd[1] = rep[0];
+    ch->fd[2] = req[0];
+    ch->fd[3] = rep[1];
+    addr[0] = (char*)"--pipe";
+}
+
+static void pipe_actions(struct ipc_chan* ch, posix_spawn_file_actions_t* fa) {
+    if (posix_spawn_file_actions_adddup2(fa, ch->fd[2], 0) != 0
+        || posix_spawn_file_actions_adddup2(fa, ch->fd[3], 1) != 0) die("posix_spawn_file_actions failed");
+}
+
+static void pipe_in_parent(struct ipc_chan* ch) {
+    close(ch->fd[2]);
+    close(ch->fd[3]);
+    ch->fd[2] = ch->fd[3] = -1;
+    ch->lr = lr_map(ch->fd[1]);
+}
+
+static size_t pipe_call(struct ipc_chan* ch, const char* req, size_t n, const char** rep) {
+    if (write_all(ch->fd[0], req, n) < 0) return 0;
+    // строка без '\n' дополняется им, иначе ребёнок будет ждать её конца вечно
+    if ((n == 0 || req[n - 1] != '\n') && write_all(ch->fd[0], "\n", 1) < 0) return 0;
+    const char* line;
+    ssize_t k = lr_next(ch->lr, IPC_MSG_MAX - 1, &line);
+    if (k <= 0) return 0;
+    // за ответом в буфере может лежать следующий — '\0' туда не поставить
+    memcpy(ch->msg, line, (size_t)k);
+    ch->msg[k] = '\0';
+    *rep = ch->msg;
+    return (size_t)k;
+}
+
+static void pipe_end(struct ipc_chan* ch) {
+    close(ch->fd[0]);
+    ch->fd[0] = -1;
+}
+
+static int pipe_attach(struct ipc_chan* ch, char** argv, int argc) {
+    (void)argv; (void)argc;
+    ch->lr = lr_map(0);
+    ch->fd[0] = 1;
+    return 1;
+}
+
+static size_t pipe_recv(struct ipc_chan* ch, const char** req) {
+    ssize_t n = lr_next(ch->lr, LR_BUF_SIZE, req);
+    if (n < 0) die("read failed");
+    return (size_t)n;
+}
+
+static void pipe_reply(struct ipc_chan* ch, const char* rep, size_t n) {
+    if (write_all(ch->fd[0], rep, n) < 0) die("write failed");
+}
+
+static void pipe_release(struct ipc_chan* ch) {
+    if (ch->lr) munmap(ch->lr, sizeof(struct line_reader));
+    ch->lr = NULL;
+    if (ch->owner) {
+        for (int k = 0; k < 4; ++k)
+            if (ch->fd[k] >= 0) close(ch->fd[k]);
+    }
+}
+
+const struct ipc_ops ipc_pipe_ops = {
+    "pipe", "--pipe",
+    pipe_create, pipe_actions, pipe_in_parent, pipe_call, NULL, NULL, pipe_end,
+    pipe_attach, pipe_recv, pipe_reply, pipe_release, NULL,
+    NULL, NULL, NULL,
+};
@@ -0,0 +1,448 @@
+// Пул обработчиков (ipc.h): один сегмент POSIX shared memory на родителя и
+// сколько угодно детей. Строку родитель кладёт в ячейку slot[seq % SLOTS]
+// (seq — её номер по порядку ввода), а номер — в общую очередь MPMC
+// (ограниченная очередь Вьюкова: у каждой ячейки свой счётчик, головы и
+// хвост двигаются CAS, без замков). Ребёнок, который свободен, забирает
+// номер, считает строку и кладёт ответ в ту же ячейку.
+//
+// Файл результатов дописывается по порядку номеров: ответы, готовые подряд
+// начиная с written, пишет одним write() тот ребёнок, который взял замок
+// wlock; остальные не ждут — держатель замка, отпустив его, ещё раз смотрит,
+// не готов ли следующий. Родитель отдаёт ответы пользователю тоже по
+// порядку: ячейка seq отдаётся, когда она уже в файле.
+//
+// Ребёнок подключается в любой момент (child_shm - --pool <имя сегмента>)
+// и уходит по SIGTERM, досчитав свою строку. Если ребёнок упал, родитель
+// (ожидая ответа дольше CHECK_MS) возвращает его строку в очередь. Если
+// упал родитель, ребёнок (простояв без строк CHECK_MS) уходит сам.
+// Ожидание — кручение (ipc_spin), потом futex на счётчике событий.
+#define _GNU_SOURCE
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <spawn.h>
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include <time.h>
+#include <errno.h>
+#include <limits.h>
+#include <string.h>
+
+#include "ipc.h"
+
+#define CACHE_LINE 64
+#define SLOTS      IPC_POOL_SLOTS
+#define QCAP       (2 * SLOTS)      // номера строк в работе и «пинки»
+#define KICK       UINT64_MAX       // не строка: дописать готовое в файл
+#define CHECK_MS   100              // родитель, ожидая ответ, ищет упавших
+#define OUT_BUF    (1 << 16)
+
+enum { S_FREE, S_REQ, S_DONE, S_WRITTEN };
+
+struct pool_slot {
+    uint64_t seq;
+    uint32_t state;             // S_*
+    uint32_t req_len, rep_len;
+    char req[IPC_MSG_MAX];
+    char rep[IPC_MSG_MAX];
+};
+
+struct pool_cell {
+    uint64_t seq;               // очередь Вьюкова: чья очередь писать/читать ячейку
+    uint64_t val;
+};
+
+struct pool_worker {
+    int32_t pid;                // 0 — место свободно
+    uint32_t pad;
+    uint64_t cur;               // номер строки в работе + 1; 0 — строки нет
+} __attribute__((aligned(CACHE_LINE)));
+
+struct pool_seg {
+    uint32_t ready;             // 1 — file и aggs заполнены
+    uint32_t stop;              // 1 — родитель закончил
+    uint32_t failed;            // 1 — ребёнок не открыл файл результатов
+    int32_t owner;              // pid родителя
+    char file[IPC_POOL_FILE_MAX];
+    char aggs[IPC_MSG_MAX];     // список -a; пусто — только sum
+    uint64_t enq __attribute__((aligned(CACHE_LINE)));
+    uint64_t deq __attribute__((aligned(CACHE_LINE)));
+    uint32_t items_ev __attribute__((aligned(CACHE_LINE)));   // +1 на каждый номер в очереди
+    uint32_t items_sleepers;
+    uint64_t written __attribute__((aligned(CACHE_LINE)));    // следующий номер для файла
+    uint32_t wlock;                                           // pid пишущего; 0 — никто
+    uint32_t done_ev __attribute__((aligned(CACHE_LINE)));    // +1 на каждую запись в файл
+    uint32_t done_sleepers;
+    struct pool_worker workers[IPC_POOL_WORKERS];
+    struct pool_cell q[QCAP] __attribute__((aligned(CACHE_LINE)));
+    struct pool_slot slot[SLOTS] __attribute__((aligned(CACHE_LINE)));
+};
+
+static volatile sig_atomic_t leaving;
+
+// ---- futex: счётчик событий ----
+static long futex(uint32_t* w, int op, uint32_t val, const struct timespec* t) {
+    return syscall(SYS_futex, w, op, val, t, NULL, 0);
+}
+
+// Уснуть, пока ev равен seen (seen прочитан до проверки условия), не дольше
+// ms. Сигнал тоже будит: вызывающий сам проверяет, ради чего ждал.
+static void ev_sleep(uint32_t* ev, uint32_t* sleepers, uint32_t seen, long ms) {
+    struct timespec t = { ms / 1000, (ms % 1000) * 1000000 };
+    __atomic_fetch_add(sleepers, 1, __ATOMIC_SEQ_CST);
+    futex(ev, FUTEX_WAIT, seen, &t); // EAGAIN, ETIMEDOUT, EINTR — всё равно назад
+    __atomic_fetch_sub(sleepers, 1, __ATOMIC_SEQ_CST);
+}
+
+static void ev_signal(uint32_t* ev, uint32_t* sleepers, int all) {
+    __atomic_fetch_add(ev, 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(sleepers, __ATOMIC_SEQ_CST))
+        futex(ev, FUTEX_WAKE, all ? INT_MAX : 1, NULL);
+}
+
+// ---- очередь номеров ----
+static int q_push(struct pool_seg* g, uint64_t v) {
+    uint64_t pos = __atomic_load_n(&g->enq, __ATOMIC_RELAXED);
+    for (;;) {
+        struct pool_cell* c = &g->q[pos % QCAP];
+        int64_t d = (int64_t)(__atomic_load_n(&c->seq, __ATOMIC_ACQUIRE) - pos);
+        if (d == 0) {
+            if (__atomic_compare_exchange_n(&g->enq, &pos, pos + 1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                c->val = v;
+                __atomic_store_n(&c->seq, pos + 1, __ATOMIC_RELEASE);
+                return 1;
+            }
+        } else if (d < 0) {
+            return 0; // полна
+        } else {
+            pos = __atomic_load_n(&g->enq, __ATOMIC_RELAXED);
+        }
+    }
+}
+
+static int q_pop(struct pool_seg* g, uint64_t* v) {
+    uint64_t pos = __atomic_load_n(&g->deq, __ATOMIC_RELAXED);
+    for (;;) {
+        struct pool_cell* c = &g->q[pos % QCAP];
+        int64_t d = (int64_t)(__atomic_load_n(&c->seq, __ATOMIC_ACQUIRE) - (pos + 1));
+        if (d == 0) {
+            if (__atomic_compare_exchange_n(&g->deq, &pos, pos + 1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                *v = c->val;
+                __atomic_store_n(&c->seq, pos + QCAP, __ATOMIC_RELEASE);
+                return 1;
+            }
+        } else if (d < 0) {
+            return 0; // пуста
+        } else {
+            pos = __atomic_load_n(&g->deq, __ATOMIC_RELAXED);
+        }
+    }
+}
+
+static void push_wake(struct pool_seg* g, uint64_t v) {
+    if (!q_push(g, v)) die("пул: очередь переполнена");
+    ev_signal(&g->items_ev, &g->items_sleepers, 0);
+}
+
+// ---- родитель ----
+static void pool_map(struct ipc_pool* p, int oflag) {
+    int fd = shm_open(p->name, oflag, 0666);
+    if (fd < 0) die("shm_open(pool) failed");
+    if ((oflag & O_CREAT) && ftruncate(fd, sizeof(struct pool_seg)) < 0) die("ftruncate failed");
+    struct stat st;
+    if (fstat(fd, &st) < 0 || st.st_size != (off_t)sizeof(struct pool_seg))
+        die("пул: сегмент другого размера (другая сборка?)");
+    void* map = mmap(NULL, sizeof(struct pool_seg), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED) die("mmap failed");
+    close(fd); // отображение остаётся и без дескриптора
+    p->seg = (struct pool_seg*)map;
+}
+
+void ipc_pool_create(struct ipc_pool* p) {
+    static int seq;
+    memset(p, 0, sizeof(*p));
+    p->owner = 1;
+    p->fd = -1;
+    ipc_make_name(p->name, "/shm_pool_", getpid(), seq++);
+    pool_map(p, O_CREAT | O_RDWR); // ftruncate обнуляет: очередь пуста, ячейки свободны
+    p->seg->owner = getpid();
+    for (uint64_t i = 0; i < QCAP; ++i) p->seg->q[i].seq = i;
+}
+
+void ipc_pool_start(struct ipc_pool* p, const char* file, const char* aggs) {
+    struct pool_seg* g = p->seg;
+    size_t n = strlen(file), a = aggs ? strlen(aggs) : 0;
+    if (n >= sizeof(g->file) || a >= sizeof(g->aggs)) die("пул: слишком длинное имя файла или список -a");
+    memcpy(g->file, file, n + 1);
+    if (a) memcpy(g->aggs, aggs, a + 1);
+    __atomic_store_n(&g->ready, 1, __ATOMIC_RELEASE);
+    futex(&g->ready, FUTEX_WAKE, INT_MAX, NULL);
+}
+
+void ipc_pool_spawn(struct ipc_pool* p, const char* path, char** head, char** tail, char** envp) {
+    if (p->npids == IPC_POOL_WORKERS) die("пул: слишком много обработчиков");
+    // argv: head, --pool <имя>, tail
+    char* args[32];
+    int na = 0;
+    for (int k = 0; head[k] && na < 29; ++k) args[na++] = head[k];
+    args[na++] = (char*)"--pool";
+    args[na++] = p->name;
+    for (int k = 0; tail && tail[k] && na < 31; ++k) args[na++] = tail[k];
+    args[na] = NULL;
+    pid_t pid;
+    if (posix_spawn(&pid, path, NULL, NULL, args, envp) != 0) die("posix_spawn(pool) failed");
+    p->pids[p->npids++] = pid;
+}
+
+// ответ, отданный прошлым ipc_pool_take, прочитан — ячейка свободна
+static void drop(struct ipc_pool* p) {
+    if (!p->held) return;
+    __atomic_store_n(&p->seg->slot[(p->taken - 1) % SLOTS].state, S_FREE, __ATOMIC_RELEASE);
+    p->held = 0;
+}
+
+int ipc_pool_send(struct ipc_pool* p, const char* req, size_t n) {
+    drop(p);
+    if (p->sent - p->taken >= SLOTS) return 0;
+    struct pool_slot* s = &p->seg->slot[p->sent % SLOTS];
+    if (n > IPC_MSG_MAX - 1) n = IPC_MSG_MAX - 1;
+    memcpy(s->req, req, n);
+    s->req[n] = '\0';
+    s->req_len = (uint32_t)n;
+    s->seq = p->sent;
+    __atomic_store_n(&s->state, S_REQ, __ATOMIC_RELEASE);
+    push_wake(p->seg, p->sent++);
+    return 1;
+}
+
+static void keep_status(struct ipc_pool* p, int st) {
+    if (!p->status && !(WIFEXITED(st) && WEXITSTATUS(st) == 0)) p->status = st;
+}
+
+// Ответа долго нет: забрать упавших своих детей (зомби для kill ещё жив),
+// найти в списке тех, кого больше нет, вернуть их строки в очередь и снять
+// брошенный замок файла. Строка, которую ребёнок забрал из очереди, но ещё
+// не отметил в cur, теряется вместе с ним — окно в пару инструкций.
+static void pool_check(struct ipc_pool* p) {
+    struct pool_seg* g = p->seg;
+    for (int k = 0; k < p->npids; ++k) {
+        int st;
+        if (p->pids[k] > 0 && waitpid(p->pids[k], &st, WNOHANG) == p->pids[k]) {
+            keep_status(p, st);
+            p->pids[k] = -p->pids[k]; // уже забран
+        }
+    }
+    int alive = 0;
+    for (int i = 0; i < IPC_POOL_WORKERS; ++i) {
+        struct pool_worker* w = &g->workers[i];
+        pid_t pid = __atomic_load_n(&w->pid, __ATOMIC_ACQUIRE);
+        if (!pid) continue;
+        if (kill(pid, 0) == 0 || errno != ESRCH) {
+            alive++;
+            continue;
+        }
+        uint64_t cur = __atomic_load_n(&w->cur, __ATOMIC_ACQUIRE);
+        if (cur && __atomic_load_n(&g->slot[(cur - 1) % SLOTS].state, __ATOMIC_ACQUIRE) == S_REQ)
+            push_wake(g, cur - 1);
+        __atomic_store_n(&w->cur, 0, __ATOMIC_RELAXED);
+        __atomic_store_n(&w->pid, 0, __ATOMIC_RELEASE);
+    }
+    uint32_t owner = __atomic_load_n(&g->wlock, __ATOMIC_ACQUIRE);
+    if (owner && kill((pid_t)owner, 0) < 0 && errno == ESRCH
+        && __atomic_compare_exchange_n(&g->wlock, &owner, 0, 0, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED))
+        push_wake(g, KICK); // готовое, но не записанное, допишет следующий
+    if (!alive && !p->warned) {
+        const char* m1 = "пул: обработчиков нет; подключить: ./child_shm - --pool ";
+        write_all(2, m1, strlen(m1));
+        write_all(2, p->name, strlen(p->name));
+        write_all(2, "\n", 1);
+    }
+    p->warned = !alive;
+}
+
+static int slot_written(void* arg) {
+    return __atomic_load_n(&((struct pool_slot*)arg)->state, __ATOMIC_ACQUIRE) == S_WRITTEN;
+}
+
+size_t ipc_pool_take(struct ipc_pool* p, const char** rep) {
+    drop(p);
+    if (p->taken == p->sent) return 0;
+    struct pool_seg* g = p->seg;
+    struct pool_slot* s = &g->slot[p->taken % SLOTS];
+    // файл пишется по порядку: любая запись в него — и эта ячейка тоже
+    if (!ipc_spin(slot_written, s)) {
+        for (;;) {
+            uint32_t seen = __atomic_load_n(&g->done_ev, __ATOMIC_SEQ_CST);
+            if (slot_written(s)) break;
+            if (__atomic_load_n(&g->failed, __ATOMIC_ACQUIRE)) {
+                shm_unlink(p->name);
+                die("пул: обработчик не открыл файл результатов");
+            }
+            ev_sleep(&g->done_ev, &g->done_sleepers, seen, CHECK_MS);
+            if (!slot_written(s)) pool_check(p);
+        }
+    }
+    p->taken++;
+    p->held = 1;
+    *rep = s->rep;
+    return s->rep_len;
+}
+
+int ipc_pool_finish(struct ipc_pool* p) {
+    struct pool_seg* g = p->seg;
+    drop(p);
+    __atomic_store_n(&g->stop, 1, __ATOMIC_SEQ_CST);
+    futex(&g->ready, FUTEX_WAKE, INT_MAX, NULL);
+    ev_signal(&g->items_ev, &g->items_sleepers, 1);
+    // ждать только своих: подключившиеся сами увидят stop
+    for (int k = 0; k < p->npids; ++k) {
+        int st = 0;
+        if (p->pids[k] <= 0) continue;
+        while (waitpid(p->pids[k], &st, 0) < 0 && errno == EINTR) {}
+        keep_status(p, st);
+    }
+    munmap(g, sizeof(struct pool_seg));
+    shm_unlink(p->name);
+    return p->status;
+}
+
+// ---- ребёнок ----
+void ipc_pool_leave(void) {
+    leaving = 1;
+}
+
+// родителя больше нет — строк и stop уже не будет
+static int owner_gone(const struct pool_seg* g) {
+    return kill((pid_t)g->owner, 0) < 0 && errno == ESRCH;
+}
+
+int ipc_pool_attach(struct ipc_pool* p, char** argv, int argc) {
+    if (argc < 2 || strcmp(argv[0], "--pool") != 0) return -1;
+    size_t n = strlen(argv[1]);
+    memset(p, 0, sizeof(*p));
+    p->fd = -1;
+    if (n >= sizeof(p->name)) return -1;
+    memcpy(p->name, argv[1], n + 1);
+    pool_map(p, O_RDWR);
+    struct pool_seg* g = p->seg;
+
+    p->pid = getpid();
+    p->slot = -1;
+    for (int i = 0; i < IPC_POOL_WORKERS && p->slot < 0; ++i) {
+        int32_t z = 0;
+        if (__atomic_compare_exchange_n(&g->workers[i].pid, &z, (int32_t)p->pid, 0, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED))
+            p->slot = i;
+    }
+    if (p->slot < 0) die("пул: мест для обработчиков нет");
+
+    // запущены заранее (parent_shm -W) — ждать имя файла
+    while (!__atomic_load_n(&g->ready, __ATOMIC_ACQUIRE) && !__atomic_load_n(&g->stop, __ATOMIC_ACQUIRE) && !leaving) {
+        struct timespec t = { 0, CHECK_MS * 1000000L };
+        futex(&g->ready, FUTEX_WAIT, 0, &t);
+        if (owner_gone(g)) break; // ipc_pool_file вернёт NULL
+    }
+    return 2;
+}
+
+const char* ipc_pool_file(const struct ipc_pool* p) {
+    return __atomic_load_n(&p->seg->ready, __ATOMIC_ACQUIRE) ? p->seg->file : NULL;
+}
+
+const char* ipc_pool_aggs(const struct ipc_pool* p) {
+    return p->seg->aggs[0] ? p->seg->aggs : NULL;
+}
+
+void ipc_pool_fail(struct ipc_pool* p) {
+    __atomic_store_n(&p->seg->failed, 1, __ATOMIC_SEQ_CST);
+    ev_signal(&p->seg->done_ev, &p->seg->done_sleepers, 1);
+}
+
+// Дописать в файл готовые ответы по порядку номеров, сколько их есть
+// подряд. Пишет держатель замка; кто замок не взял — уходит сразу: его
+// ответ уже помечен S_DONE, и держатель увидит его после отпускания.
+static void drain(struct ipc_pool* p) {
+    static char buf[OUT_BUF];
+    struct pool_seg* g = p->seg;
+    for (;;) {
+        uint32_t z = 0;
+        if (!__atomic_compare_exchange_n(&g->wlock, &z, (uint32_t)p->pid, 0, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED))
+            return;
+        uint64_t w = g->written;
+        for (;;) {
+            uint64_t from = w;
+            size_t k = 0;
+            // не больше SLOTS за раз: ячейка from помечается записанной только
+            // после write(), и на следующем круге она ещё выглядит готовой
+            while (w - from < SLOTS) {
+                struct pool_slot* s = &g->slot[w % SLOTS];
+                if (__atomic_load_n(&s->state, __ATOMIC_ACQUIRE) != S_DONE || k + s->rep_len > sizeof(buf)) break;
+                memcpy(buf + k, s->rep, s->rep_len);
+                k += s->rep_len;
+                w++;
+            }
+            if (w == from) break;
+            if (p->fd >= 0 && write_all(p->fd, buf, k) < 0) die("child: write(file) failed");
+            for (uint64_t i = from; i < w; ++i)
+                __atomic_store_n(&g->slot[i % SLOTS].state, S_WRITTEN, __ATOMIC_RELEASE);
+            g->written = w;
+            ev_signal(&g->done_ev, &g->done_sleepers, 0);
+        }
+        __atomic_store_n(&g->wlock, 0, __ATOMIC_SEQ_CST);
+        if (__atomic_load_n(&g->slot[w % SLOTS].state, __ATOMIC_SEQ_CST) != S_DONE) return;
+    }
+}
+
+struct pop_arg {
+    struct pool_seg* g;
+    uint64_t v;
+};
+
+static int pop_try(void* arg) {
+    struct pop_arg* a = (struct pop_arg*)arg;
+    return q_pop(a->g, &a->v);
+}
+
+size_t ipc_pool_recv(struct ipc_pool* p, const char** req) {
+    struct pool_seg* g = p->seg;
+    struct pop_arg a = { g, 0 };
+    for (;;) {
+        uint32_t seen = __atomic_load_n(&g->items_ev, __ATOMIC_SEQ_CST);
+        if (leaving) return 0;
+        if (ipc_spin(pop_try, &a)) {
+            if (a.v == KICK) {
+                drain(p);
+                continue;
+            }
+            struct pool_slot* s = &g->slot[a.v % SLOTS];
+            __atomic_store_n(&g->workers[p->slot].cur, a.v + 1, __ATOMIC_RELEASE);
+            p->cur = a.v;
+            *req = s->req;
+            return s->req_len;
+        }
+        if (__atomic_load_n(&g->stop, __ATOMIC_ACQUIRE)) return 0;
+        ev_sleep(&g->items_ev, &g->items_sleepers, seen, CHECK_MS);
+        // проспали CHECK_MS без единой строки — жив ли родитель
+        if (__atomic_load_n(&g->items_ev, __ATOMIC_SEQ_CST) == seen && owner_gone(g)) return 0;
+    }
+}
+
+void ipc_pool_reply(struct ipc_pool* p, const char* rep, size_t n) {
+    struct pool_seg* g = p->seg;
+    struct pool_slot* s = &g->slot[p->cur % SLOTS];
+    if (n > IPC_MSG_MAX - 1) n = IPC_MSG_MAX - 1;
+    memcpy(s->rep, rep, n);
+    s->rep[n] = '\0';
+    s->rep_len = (uint32_t)n;
+    __atomic_store_n(&s->state, S_DONE, __ATOMIC_SEQ_CST);
+    __atomic_store_n(&g->workers[p->slot].cur, 0, __ATOMIC_RELEASE);
+    drain(p);
+}
+
+void ipc_pool_close(struct ipc_pool* p) {
+    __atomic_store_n(&p->seg->workers[p->slot].pid, 0, __ATOMIC_RELEASE);
+    munmap(p->seg, sizeof(struct pool_seg));
+}
@@ -0,0 +1,466 @@
+// Транспорт ring: сегмент POSIX shared memory с двумя кольцами SPSC —
+// запросов (пишет родитель, читает ребёнок) и ответов (наоборот) — и пара
+// именованных семафоров, как у shm. Записи переменной длины: 4 байта длины,
+// текст с '\0' на конце, выравнивание до 8 байт. Счётчики головы (сколько
+// байт забрано) и хвоста (сколько выложено) только растут, каждый — на
+// своей кэш-линии: писатель и читатель не делят линию, которую оба пишут.
+//
+// Стороны работают одновременно: родитель кладёт строки, пока есть место
+// (ipc_send), ребёнок отвечает, не дожидаясь, пока ответы заберут. Пока
+// работа есть, системных вызовов нет. Семафор — только чтобы разбудить
+// сторону, которая уснула: перед сном она поднимает свой флаг sleeping и
+// ещё раз смотрит в кольцо, другая сторона после каждого шага проверяет
+// флаг и, если он поднят, снимает его и делает sem_post.
+// Запрос длиннее IPC_MSG_MAX - 1 идёт кусками по RING_CHUNK байт: у всех
+// кусков, кроме последнего, в длине поднят RING_MORE. Ребёнок собирает их
+// в своей области (ch->big) и разбирает строку целиком. Пока кусок не
+// принят, родитель ждёт места в кольце запросов, поэтому ответов на
+// прошлые запросы к этому времени ждать не должно (ipc_big).
+// Адрес для ребёнка: --ring <shm_name> <sem_p_name> <sem_c_name>.
+// Здесь же транспорт eventfd — те же кольца, но будят eventfd (см. ниже).
+#define _GNU_SOURCE
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/eventfd.h>
+#include <poll.h>
+#include <spawn.h>
+#include <semaphore.h>
+#include <errno.h>
+#include <string.h>
+
+#include "ipc.h"
+
+#define RING_SIZE (1 << 16)       // байт в кольце, степень двойки
+#define RING_SKIP 0xFFFFFFFFu     // длина-метка: до конца кольца пусто, запись — с начала
+#define RING_MORE 0x80000000u     // в длине: кусок длинного запроса, дальше ещё
+#define RING_CHUNK (RING_SIZE / 4)
+#define BIG_MIN (1 << 20)
+#define CACHE_LINE 64
+
+struct ring {
+    uint64_t head __attribute__((aligned(CACHE_LINE)));   // пишет читатель
+    uint64_t tail __attribute__((aligned(CACHE_LINE)));   // пишет писатель
+};
+
+struct ring_data {
+    struct ring q[2];           // 0 — запросы, 1 — ответы
+    // 0 — ребёнок спит на sem_p, 1 — родитель спит на sem_c
+    uint32_t sleeping[2] __attribute__((aligned(CACHE_LINE)));
+    char buf[2][RING_SIZE] __attribute__((aligned(CACHE_LINE)));
+};
+
+#define RING(ch) ((struct ring_data*)(ch)->shm)
+#define REQ 0
+#define REP 1
+#define IS_EFD(ch) ((ch)->ops == &ipc_eventfd_ops)
+#define EFD(ch, k) ((ch)->fd[1 + (k)])   // eventfd, на котором спит сторона k
+
+static size_t rec_size(size_t n) {
+    return (4 + n + 1 + 7) & ~(size_t)7;
+}
+
+// ---- кольцо ----
+// положить запись (писатель); 0 — места нет
+static int ring_put(struct ring* r, char* buf, const char* s, size_t n, int more) {
+    uint64_t tail = r->tail;
+    uint64_t head = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+    size_t need = rec_size(n), pos = tail % RING_SIZE;
+    size_t skip = RING_SIZE - pos < need ? RING_SIZE - pos : 0;
+    if (tail + skip + need - head > RING_SIZE) return 0;
+    if (skip) {
+        uint32_t m = RING_SKIP;
+        memcpy(buf + pos, &m, 4);
+        pos = 0;
+    }
+    uint32_t len = (uint32_t)n | (more ? RING_MORE : 0);
+    memcpy(buf + pos, &len, 4);
+    memcpy(buf + pos + 4, s, n);
+    buf[pos + 4 + n] = '\0';
+    __atomic_store_n(&r->tail, tail + skip + need, __ATOMIC_RELEASE);
+    return 1;
+}
+
+// следующая запись (читатель): текст в *p, длина в *n, сколько байт она
+// занимает — в *used, кусок ли это длинного запроса — в *more; 0 — кольцо пусто
+static int ring_peek(struct ring* r, char* buf, const char** p, size_t* n, size_t* used, int* more) {
+    uint64_t head = r->head;
+    if (head == __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE)) return 0;
+    size_t pos = head % RING_SIZE, skip = 0;
+    uint32_t len;
+    memcpy(&len, buf + pos, 4);
+    if (len == RING_SKIP) { // метка и запись за ней выкладываются вместе
+        skip = RING_SIZE - pos;
+        pos = 0;
+        memcpy(&len, buf, 4);
+    }
+    *more = (len & RING_MORE) != 0;
+    len &= ~RING_MORE;
+    *p = buf + pos + 4;
+    *n = len;
+    *used = skip + rec_size(len);
+    return 1;
+}
+
+// ---- сон и пробуждение ----
+// eventfd открыт с O_NONBLOCK (его ждёт и epoll родителя): пусто — poll
+static void efd_wait(int fd) {
+    uint64_t v;
+    while (read(fd, &v, sizeof(v)) < 0) {
+        if (errno == EAGAIN) {
+            struct pollfd p = { fd, POLLIN, 0 };
+            if (poll(&p, 1, -1) < 0 && errno != EINTR) die("poll failed");
+        } else if (errno != EINTR) {
+            die("read(eventfd) failed");
+        }
+    }
+}
+
+static void efd_post(int fd) {
+    uint64_t v = 1;
+    while (write(fd, &v, sizeof(v)) < 0)
+        if (errno != EINTR) die("write(eventfd) failed");
+}
+
+// уснуть до пробуждения другой стороной / разбудить сторону k
+static void side_wait(struct ipc_chan* ch, int k) {
+    if (IS_EFD(ch)) {
+        efd_wait(EFD(ch, k));
+        return;
+    }
+    while (sem_wait((sem_t*)ch->sem[k]) < 0)
+        if (errno != EINTR) die("sem_wait failed");
+}
+
+static void side_post(struct ipc_chan* ch, int k) {
+    if (IS_EFD(ch)) efd_post(EFD(ch, k));
+    else if (sem_post((sem_t*)ch->sem[k]) < 0) die("sem_post failed");
+}
+
+struct spin_arg {
+    struct ipc_chan* ch;
+    int (*try)(struct ipc_chan*, void*);
+    void* arg;
+};
+
+static int spin_try(void* p) {
+    struct spin_arg* a = (struct spin_arg*)p;
+    return a->try(a->ch, a->arg);
+}
+
+// разбудить другую сторону, если она спит (после любого шага по кольцу)
+static void ring_wake(struct ipc_chan* ch) {
+    struct ring_data* d = RING(ch);
+    int peer = !ch->owner;
+    __atomic_thread_fence(__ATOMIC_SEQ_CST); // шаг по кольцу виден до проверки флага
+    if (__atomic_load_n(&d->sleeping[peer], __ATOMIC_RELAXED)
+        && __atomic_exchange_n(&d->sleeping[peer], 0, __ATOMIC_SEQ_CST))
+        side_post(ch, peer);
+}
+
+// Повторять try, пока не выйдет: сначала покрутиться (ipc_spin), потом
+// спать на своём семафоре. Флаг поднимается до последней проверки: другая
+// сторона либо увидит его и разбудит, либо её шаг виден этой проверке.
+static void ring_sleep(struct ipc_chan* ch, int (*try)(struct ipc_chan*, void*), void* arg) {
+    struct ring_data* d = RING(ch);
+    int self = ch->owner;
+    struct spin_arg sa = { ch, try, arg };
+    if (ipc_spin(spin_try, &sa)) return;
+    while (!try(ch, arg)) {
+        __atomic_store_n(&d->sleeping[self], 1, __ATOMIC_SEQ_CST);
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+        if (try(ch, arg)) {
+            // обошлось без сна; флаг уже сняла другая сторона — её sem_post в пути
+            if (!__atomic_exchange_n(&d->sleeping[self], 0, __ATOMIC_SEQ_CST)) side_wait(ch, self);
+            return;
+        }
+        side_wait(ch, self);
+    }
+}
+
+struct put_arg {
+    int q;
+    const char* s;
+    size_t n;
+    int more;
+};
+
+static int try_put(struct ipc_chan* ch, void* arg) {
+    struct put_arg* a = (struct put_arg*)arg;
+    return ring_put(&RING(ch)->q[a->q], RING(ch)->buf[a->q], a->s, a->n, a->more);
+}
+
+struct peek_arg {
+    int q;
+    const char* p;
+    size_t n;
+    int more;
+};
+
+static int try_peek(struct ipc_chan* ch, void* arg) {
+    struct peek_arg* a = (struct peek_arg*)arg;
+    return ring_peek(&RING(ch)->q[a->q], RING(ch)->buf[a->q], &a->p, &a->n, &ch->held, &a->more);
+}
+
+// положить запись в кольцо q, дождавшись места; длинный запрос — кусками
+static void put_wait(struct ipc_chan* ch, int q, const char* s, size_t n) {
+    if (n > IPC_MSG_MAX - 1 && q == REP) n = IPC_MSG_MAX - 1;
+    for (;;) {
+        struct put_arg a = { q, s, n, 0 };
+        if (n > IPC_MSG_MAX - 1) {
+            a.n = n < RING_CHUNK ? n : RING_CHUNK;
+            a.more = a.n < n;
+        }
+        ring_sleep(ch, try_put, &a);
+        ring_wake(ch);
+        if (!a.more) return;
+        s += a.n;
+        n -= a.n;
+    }
+}
+
+// отпустить прочитанную запись кольца q (место — писателю)
+static void drop(struct ipc_chan* ch, int q) {
+    if (!ch->held) return;
+    struct ring* r = &RING(ch)->q[q];
+    __atomic_store_n(&r->head, r->head + ch->held, __ATOMIC_RELEASE);
+    ch->held = 0;
+    ring_wake(ch);
+}
+
+// Область длинных запросов (ch->big) — своя память процесса: у родителя
+// строку собирают в ней (ipc_big), у ребёнка в неё складываются куски.
+// Место под n байт и '\0'; содержимое сохраняется.
+static char* big_grow(struct ipc_chan* ch, size_t n) {
+    size_t size = ch->big_size ? ch->big_size : BIG_MIN;
+    while (size < n + 1) size *= 2;
+    if (size > ch->big_size) {
+        void* p = ch->big_size
+            ? mremap(ch->big, ch->big_size, size, MREMAP_MAYMOVE)
+            : mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (p == MAP_FAILED) die("mmap(big) failed");
+        ch->big = (char*)p;
+        ch->big_size = size;
+    }
+    return ch->big;
+}
+
+// дождаться записи в кольце q; она остаётся в кольце до drop. Куски
+// длинного запроса собираются в ch->big и сразу отпускаются.
+static size_t take_wait(struct ipc_chan* ch, int q, const char** p) {
+    struct peek_arg a = { q, NULL, 0, 0 };
+    ring_sleep(ch, try_peek, &a);
+    if (!a.more) {
+        *p = a.p;
+        return a.n;
+    }
+    size_t n = 0;
+    for (;;) {
+        if (n + a.n > IPC_BIG_MAX) die("слишком длинный запрос");
+        memcpy(big_grow(ch, n + a.n) + n, a.p, a.n);
+        n += a.n;
+        drop(ch, q);
+        if (!a.more) break;
+        ring_sleep(ch, try_peek, &a);
+    }
+    ch->big[n] = '\0';
+    *p = ch->big;
+    return n;
+}
+
+// ---- родитель ----
+static void ring_map(struct ipc_chan* ch, int oflag) {
+    ch->fd[0] = shm_open(ch->name[0], oflag, 0666);
+    if (ch->fd[0] < 0) die("shm_open failed");
+    if ((oflag & O_CREAT) && ftruncate(ch->fd[0], sizeof(struct ring_data)) < 0) die("ftruncate failed");
+    void* map = mmap(NULL, sizeof(struct ring_data), PROT_READ | PROT_WRITE, MAP_SHARED, ch->fd[0], 0);
+    if (map == MAP_FAILED) die("mmap failed");
+    ch->shm = map;
+}
+
+static void ring_create(struct ipc_chan* ch, char** addr) {
+    static int seq;
+    pid_t self = getpid();
+    ipc_make_name(ch->name[0], "/shm_ring_", self, seq);
+    ipc_make_name(ch->name[1], "/sem_rp_", self, seq);
+    ipc_make_name(ch->name[2], "/sem_rc_", self, seq);
+    seq++;
+
+    ring_map(ch, O_CREAT | O_RDWR); // ftruncate обнуляет: кольца пусты, никто не спит
+    ch->sem[0] = sem_open(ch->name[1], O_CREAT, 0666, 0);
+    if (ch->sem[0] == SEM_FAILED) die("sem_open(sem_parent) failed");
+    ch->sem[1] = sem_open(ch->name[2], O_CREAT, 0666, 0);
+    if (ch->sem[1] == SEM_FAILED) die("sem_open(sem_child) failed");
+    addr[0] = (char*)"--ring";
+    for (int k = 0; k < 3; ++k) addr[k + 1] = ch->name[k];
+}
+
+static int ring_send(struct ipc_chan* ch, const char* req, size_t n) {
+    if (n > IPC_MSG_MAX - 1) { // кусками, дожидаясь, пока ребёнок их разберёт
+        put_wait(ch, REQ, req, n);
+        return 1;
+    }
+    if (!ring_put(&RING(ch)->q[REQ], RING(ch)->buf[REQ], req, n, 0)) return 0;
+    ring_wake(ch);
+    return 1;
+}
+
+static size_t ring_take(struct ipc_chan* ch, const char** rep) {
+    drop(ch, REP); // прошлый ответ уже прочитан
+    return take_wait(ch, REP, rep);
+}
+
+static size_t ring_call(struct ipc_chan* ch, const char* req, size_t n, const char** rep) {
+    drop(ch, REP);
+    put_wait(ch, REQ, req, n);
+    return take_wait(ch, REP, rep);
+}
+
+static void ring_end(struct ipc_chan* ch) {
+    drop(ch, REP);
+    put_wait(ch, REQ, "", 0); // пустая запись — конец работы
+}
+
+// ---- ребёнок ----
+static int ring_attach(struct ipc_chan* ch, char** argv, int argc) {
+    if (argc < 4) return -1;
+    for (int k = 0; k < 3; ++k) {
+        size_t n = strlen(argv[k + 1]);
+        if (n >= sizeof(ch->name[k])) return -1;
+        memcpy(ch->name[k], argv[k + 1], n + 1);
+    }
+    ring_map(ch, O_RDWR);
+    ch->sem[0] = sem_open(ch->name[1], 0);
+    if (ch->sem[0] == SEM_FAILED) die("sem_open(parent) failed");
+    ch->sem[1] = sem_open(ch->name[2], 0);
+    if (ch->sem[1] == SEM_FAILED) die("sem_open(child) failed");
+    return 4;
+}
+
+static size_t ring_recv(struct ipc_chan* ch, const char** req) {
+    drop(ch, REQ);
+    return take_wait(ch, REQ, req);
+}
+
+static void ring_reply(struct ipc_chan* ch, const char* rep, size_t n) {
+    put_wait(ch, REP, rep, n);
+}
+
+static char* ring_big(struct ipc_chan* ch, size_t n) {
+    return big_grow(ch, n);
+}
+
+static void ring_release(struct ipc_chan* ch) {
+    if (ch->big_size) munmap(ch->big, ch->big_size);
+    munmap(ch->shm, sizeof(struct ring_data));
+    close(ch->fd[0]);
+    sem_close((sem_t*)ch->sem[0]);
+    sem_close((sem_t*)ch->sem[1]);
+    if (ch->owner) {
+        sem_unlink(ch->name[1]);
+        sem_unlink(ch->name[2]);
+        shm_unlink(ch->name[0]);
+    }
+}
+
+const struct ipc_ops ipc_ring_ops = {
+    "ring", "--ring",
+    ring_create, NULL, NULL, ring_call, ring_send, ring_take, ring_end,
+    ring_attach, ring_recv, ring_reply, ring_release, ring_big,
+    NULL, NULL, NULL,
+};
+
+// ======= eventfd =======
+// Те же кольца в сегменте memfd, а вместо именованных семафоров — два
+// eventfd, общих у родителя и ребёнка: на первом спит ребёнок, на втором
+// родитель. eventfd можно ждать в epoll вместе с вводом, другими каналами
+// и таймерами (ipc_event_fd, ipc_arm, ipc_try_take). Пробуждение одно на
+// сон, а не на запись: сторона будит другую, только если та подняла флаг
+// sleeping, и проснувшаяся забирает всё, что накопилось в кольце.
+// Ребёнку сегмент и оба eventfd достаются дескрипторами EFD_FD_BASE..+2
+// (file actions posix_spawn), адрес — один признак --eventfd.
+#define EFD_FD_BASE 3
+#define EFD_FD_HIGH 16          // свои дескрипторы держим выше: dup2 не затрёт ещё не скопированный
+
+static int fd_high(int fd) {
+    int h = fcntl(fd, F_DUPFD_CLOEXEC, EFD_FD_HIGH);
+    if (h < 0) die("fcntl(F_DUPFD) failed");
+    close(fd);
+    return h;
+}
+
+static void efd_map(struct ipc_chan* ch) {
+    void* map = mmap(NULL, sizeof(struct ring_data), PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_POPULATE, ch->fd[0], 0);
+    if (map == MAP_FAILED) die("mmap failed");
+    ch->shm = map;
+}
+
+static void efd_create(struct ipc_chan* ch, char** addr) {
+    int fd = memfd_create("ipc_ring", MFD_CLOEXEC);
+    if (fd < 0) die("memfd_create failed");
+    if (ftruncate(fd, sizeof(struct ring_data)) < 0) die("ftruncate failed");
+    ch->fd[0] = fd_high(fd);
+    for (int k = 0; k < 2; ++k) {
+        int e = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+        if (e < 0) die("eventfd failed");
+        EFD(ch, k) = fd_high(e);
+    }
+    efd_map(ch);
+    addr[0] = (char*)"--eventfd";
+}
+
+static void efd_actions(struct ipc_chan* ch, posix_spawn_file_actions_t* fa) {
+    for (int k = 0; k < 3; ++k)
+        if (posix_spawn_file_actions_adddup2(fa, ch->fd[k], EFD_FD_BASE + k) != 0)
+            die("posix_spawn_file_actions failed");
+}
+
+static int efd_attach(struct ipc_chan* ch, char** argv, int argc) {
+    (void)argv; (void)argc;
+    for (int k = 0; k < 3; ++k) ch->fd[k] = EFD_FD_BASE + k;
+    efd_map(ch);
+    return 1;
+}
+
+static void efd_release(struct ipc_chan* ch) {
+    if (ch->big_size) munmap(ch->big, ch->big_size);
+    munmap(ch->shm, sizeof(struct ring_data));
+    for (int k = 0; k < 3; ++k) close(ch->fd[k]);
+}
+
+static int efd_event_fd(struct ipc_chan* ch) {
+    return EFD(ch, REP);
+}
+
+// Перед сном в epoll: сбросить старые пробуждения, поднять флаг и ещё раз
+// посмотреть в кольцо ответов. 0 — ответ уже есть, спать не надо (если
+// флаг успел снять ребёнок, его пробуждение придёт зря — не страшно).
+static int efd_arm(struct ipc_chan* ch) {
+    struct ring_data* d = RING(ch);
+    uint64_t v;
+    while (read(EFD(ch, REP), &v, sizeof(v)) < 0 && errno == EINTR) {}
+    __atomic_store_n(&d->sleeping[REP], 1, __ATOMIC_SEQ_CST);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&d->q[REP].tail, __ATOMIC_ACQUIRE) == d->q[REP].head) return 1;
+    __atomic_store_n(&d->sleeping[REP], 0, __ATOMIC_SEQ_CST);
+    return 0;
+}
+
+// ответ, если он уже есть; 0 — пока нет
+static size_t efd_try_take(struct ipc_chan* ch, const char** rep) {
+    drop(ch, REP);
+    struct peek_arg a = { REP, NULL, 0, 0 };
+    if (!try_peek(ch, &a)) return 0;
+    *rep = a.p;
+    return a.n;
+}
+
+const struct ipc_ops ipc_eventfd_ops = {
+    "eventfd", "--eventfd",
+    efd_create, efd_actions, NULL, ring_call, ring_send, ring_take, ring_end,
+    efd_attach, ring_recv, ring_reply, efd_release, ring_big,
+    efd_event_fd, efd_arm, efd_try_take,
+};
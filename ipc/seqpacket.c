@@ -0,0 +1,84 @@
+// Транспорт seqpacket: пара UNIX-сокетов SOCK_SEQPACKET (socketpair).
+// Границы сообщений хранит ядро: одно сообщение — одна строка запроса или
+// один ответ, искать '\n' и склеивать куски не нужно. Сокет ребёнка — его
+// stdin. Конец работы — shutdown(SHUT_WR) у родителя.
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <spawn.h>
+#include <errno.h>
+#include <string.h>
+
+#include "ipc.h"
+
+// fd: 0 — сокет родителя, 2 — сокет ребёнка
+
+static void sp_create(struct ipc_chan* ch, char** addr) {
+    int sv[2];
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, sv) < 0) die("socketpair failed");
+    ch->fd[0] = sv[0];
+    ch->fd[2] = sv[1];
+    addr[0] = (char*)"--seqpacket";
+}
+
+static void sp_actions(struct ipc_chan* ch, posix_spawn_file_actions_t* fa) {
+    if (posix_spawn_file_actions_adddup2(fa, ch->fd[2], 0) != 0) die("posix_spawn_file_actions failed");
+}
+
+static void sp_in_parent(struct ipc_chan* ch) {
+    close(ch->fd[2]);
+    ch->fd[2] = -1;
+}
+
+// принять одно сообщение в ch->msg; 0 — другая сторона закрыла сокет
+static size_t sp_take(struct ipc_chan* ch) {
+    for (;;) {
+        ssize_t r = recv(ch->fd[0], ch->msg, IPC_MSG_MAX - 1, 0);
+        if (r < 0 && errno == EINTR) continue;
+        if (r < 0) die("recv failed");
+        ch->msg[r] = '\0';
+        return (size_t)r;
+    }
+}
+
+static void sp_send(struct ipc_chan* ch, const char* buf, size_t n) {
+    while (send(ch->fd[0], buf, n, MSG_NOSIGNAL) < 0)
+        if (errno != EINTR) die("send failed");
+}
+
+static size_t sp_call(struct ipc_chan* ch, const char* req, size_t n, const char** rep) {
+    if (n > IPC_MSG_MAX - 1) n = IPC_MSG_MAX - 1;
+    sp_send(ch, req, n);
+    *rep = ch->msg;
+    return sp_take(ch);
+}
+
+static void sp_end(struct ipc_chan* ch) {
+    shutdown(ch->fd[0], SHUT_WR);
+}
+
+static int sp_attach(struct ipc_chan* ch, char** argv, int argc) {
+    (void)argv; (void)argc;
+    ch->fd[0] = 0;
+    return 1;
+}
+
+static size_t sp_recv(struct ipc_chan* ch, const char** req) {
+    *req = ch->msg;
+    return sp_take(ch);
+}
+
+static void sp_reply(struct ipc_chan* ch, const char* rep, size_t n) {
+    sp_send(ch, rep, n);
+}
+
+static void sp_release(struct ipc_chan* ch) {
+    if (ch->owner && ch->fd[0] >= 0) close(ch->fd[0]);
+}
+
+const struct ipc_ops ipc_seqpacket_ops = {
+    "seqpacket", "--seqpacket",
+    sp_create, sp_actions, sp_in_parent, sp_call, NULL, NULL, sp_end,
+    sp_attach, sp_recv, sp_reply, sp_release, NULL,
+    NULL, NULL, NULL,
+};
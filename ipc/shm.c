@@ -0,0 +1,353 @@
+// Транспорт shm (ЛР3): сегмент POSIX shared memory и два именованных
+// семафора. Родитель кладёт строку в in_buf и поднимает sem_p, ребёнок
+// отвечает в out_buf и поднимает sem_c. Конец работы — пустая строка.
+// Адрес для ребёнка — три имени: <shm_name> <sem_p_name> <sem_c_name>.
+// Запрос длиннее in_buf лежит в области длинных запросов — в том же
+// сегменте с hdr.big_off. Родитель наращивает её (fallocate) и отображает
+// заново, ребёнок — следом, когда видит, что запрос в неё не помещается.
+// Здесь же транспорт memfd — тот же обмен без имён (см. ниже).
+//
+// Страницы сегмента (обе стороны, по переменным окружения):
+//   сегмент отображается с MAP_POPULATE — без page fault на первых строках;
+//   IPC_MLOCK=1 — ещё и mlock сегмента и области длинных запросов (не
+//               вышло, например из-за RLIMIT_MEMLOCK, — работаем так);
+//   IPC_HUGE=1  — memfd на huge pages (MFD_HUGETLB; нет свободных — обычные
+//               страницы), у shm и без свободных huge pages — MADV_HUGEPAGE
+//               для области длинных запросов (THP, если их разрешает
+//               /sys/kernel/mm/transparent_hugepage/shmem_enabled).
+#define _GNU_SOURCE
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <semaphore.h>
+#include <spawn.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ipc.h"
+
+#define CACHE_LINE 64
+#define SHM_MAGIC   0x314d48535f435049ULL  // "IPC_SHM1"
+#define SHM_VERSION 2
+#define SHM_HUGETLB 1u                     // hdr.flags: сегмент на huge pages
+
+// Заголовок пишет создатель до запуска ребёнка, ребёнок сверяет его
+// (shm_check): parent_shm и child_shm разных сборок с разной раскладкой
+// не разойдутся молча. Дальше — поля родителя и поля ребёнка, каждая
+// группа со своей кэш-линии: в одну линию пишет только одна сторона.
+struct shm_hdr {
+    uint64_t magic;         // пишется последним
+    uint32_t version;
+    uint32_t size;          // sizeof(struct shm_data)
+    uint32_t flags;         // SHM_HUGETLB
+    uint32_t page;          // страница сегмента
+    uint64_t big_off;       // начало области длинных запросов
+};
+
+struct shm_data {
+    struct shm_hdr hdr;
+    // пишет родитель. Семафоры обеспечивают порядок, поэтому отдельные
+    // флаги не нужны.
+    uint64_t big_len __attribute__((aligned(CACHE_LINE)));   // запрос в области длинных запросов; 0 — в in_buf
+    uint64_t big_size;      // размер области (только растёт)
+    char in_buf[IPC_MSG_MAX] __attribute__((aligned(CACHE_LINE)));
+    // пишет ребёнок
+    char out_buf[IPC_MSG_MAX] __attribute__((aligned(CACHE_LINE)));
+};
+
+#define SHM(ch)  ((struct shm_data*)(ch)->shm)
+#define SEM_P(ch) ((sem_t*)(ch)->sem[0])
+#define SEM_C(ch) ((sem_t*)(ch)->sem[1])
+#define IS_MEMFD(ch) ((ch)->ops == &ipc_memfd_ops)
+
+#define BIG_OFF  65536      // начало области: после shm_data или memfd_data (на huge pages — страница)
+#define BIG_MIN  (1 << 20)
+#define BIG_PAD  64         // за запросом: '\0' и запас
+
+static int env_on(const char* name) {
+    const char* v = getenv(name);
+    return v && strcmp(v, "1") == 0;
+}
+
+// страница файла сегмента: у hugetlbfs st_blksize — размер huge page
+static size_t fd_page(int fd) {
+    struct stat st;
+    if (fstat(fd, &st) < 0) die("fstat failed");
+    return st.st_blksize > 4096 ? (size_t)st.st_blksize : 4096;
+}
+
+static size_t page_round(size_t n, size_t page) {
+    return (n + page - 1) & ~(page - 1);
+}
+
+// IPC_MLOCK=1: держать страницы в памяти (mremap переносит и блокировку)
+static void seg_lock(void* p, size_t n) {
+    if (env_on("IPC_MLOCK")) mlock(p, n);
+}
+
+// создатель: заголовок, magic — последним
+static void shm_init_hdr(struct shm_data* d, unsigned flags, size_t page) {
+    d->hdr.version = SHM_VERSION;
+    d->hdr.size = sizeof(struct shm_data);
+    d->hdr.flags = flags;
+    d->hdr.page = (uint32_t)page;
+    d->hdr.big_off = page > BIG_OFF ? page : BIG_OFF;
+    __atomic_store_n(&d->hdr.magic, SHM_MAGIC, __ATOMIC_RELEASE);
+}
+
+// ребёнок: сегмент той же раскладки?
+static void shm_check(const struct shm_data* d) {
+    if (__atomic_load_n(&d->hdr.magic, __ATOMIC_ACQUIRE) != SHM_MAGIC
+        || d->hdr.version != SHM_VERSION || d->hdr.size != sizeof(struct shm_data))
+        die("shm: сегмент другой раскладки (parent_shm и child_shm разных сборок?)");
+}
+
+// Сигналы обмена: 0 — запрос готов (sem_p), 1 — ответ готов (sem_c).
+// У shm — именованные семафоры, у memfd — ipc_fsem в сегменте; ждут оба
+// через кручение, а уже потом засыпают (wait.c).
+static void sig_post(struct ipc_chan* ch, int k) {
+    if (IS_MEMFD(ch)) ipc_fsem_post((struct ipc_fsem*)ch->sem[k]);
+    else if (sem_post((sem_t*)ch->sem[k]) < 0) die("sem_post failed");
+}
+
+static void sig_wait(struct ipc_chan* ch, int k) {
+    if (IS_MEMFD(ch)) ipc_fsem_wait((struct ipc_fsem*)ch->sem[k]);
+    else ipc_sem_wait(ch->sem[k]);
+}
+
+static void shm_map(struct ipc_chan* ch, int oflag) {
+    ch->fd[0] = shm_open(ch->name[0], oflag, 0666);
+    if (ch->fd[0] < 0) die("shm_open failed");
+    if ((oflag & O_CREAT) && ftruncate(ch->fd[0], sizeof(struct shm_data)) < 0) die("ftruncate failed");
+    void* map = mmap(NULL, sizeof(struct shm_data), PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_POPULATE, ch->fd[0], 0);
+    if (map == MAP_FAILED) die("mmap failed");
+    seg_lock(map, sizeof(struct shm_data));
+    ch->shm = map;
+    if (oflag & O_CREAT) shm_init_hdr(SHM(ch), 0, 4096);
+    else shm_check(SHM(ch));
+}
+
+// отобразить область длинных запросов на size байт (если меньше)
+static void big_map(struct ipc_chan* ch, size_t size) {
+    if (size <= ch->big_size) return;
+    const struct shm_hdr* h = &SHM(ch)->hdr;
+    // hugetlb-отображение mremap не растит (EINVAL) — отобразить заново
+    if (ch->big_size && (h->flags & SHM_HUGETLB)) {
+        munmap(ch->big, ch->big_size);
+        ch->big_size = 0;
+    }
+    void* p = ch->big_size
+        ? mremap(ch->big, ch->big_size, size, MREMAP_MAYMOVE)
+        : mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, ch->fd[0], (off_t)h->big_off);
+    if (p == MAP_FAILED) die("mmap(big) failed");
+    if (!ch->big_size) {
+        if (!(h->flags & SHM_HUGETLB) && env_on("IPC_HUGE")) madvise(p, size, MADV_HUGEPAGE);
+        seg_lock(p, size);
+    }
+    ch->big = (char*)p;
+    ch->big_size = size;
+}
+
+// Родитель: место под запрос из n байт. Страницы выделяются сразу
+// (fallocate): если /dev/shm переполнен, лучше узнать здесь, чем получить
+// SIGBUS на записи. Размер — целое число страниц сегмента.
+static char* shm_big(struct ipc_chan* ch, size_t n) {
+    const struct shm_hdr* h = &SHM(ch)->hdr;
+    size_t size = ch->big_size ? ch->big_size : BIG_MIN;
+    while (size < n + BIG_PAD || size < h->page) size *= 2;
+    if (size > ch->big_size) {
+        if (fallocate(ch->fd[0], 0, (off_t)(h->big_off + ch->big_size), (off_t)(size - ch->big_size)) < 0)
+            die("fallocate(big) failed");
+        SHM(ch)->big_size = size;
+        big_map(ch, size);
+    }
+    return ch->big;
+}
+
+static void shm_create(struct ipc_chan* ch, char** addr) {
+    // POSIX требует, чтобы имя shm/sem начиналось с '/'
+    // Пример: /shm_sum_12345, /sem_p_12345, /sem_c_12345
+    static int seq;
+    pid_t self = getpid();
+    // "_k" — для второго и следующих каналов процесса
+    ipc_make_name(ch->name[0], "/shm_sum_", self, seq);
+    ipc_make_name(ch->name[1], "/sem_p_", self, seq);
+    ipc_make_name(ch->name[2], "/sem_c_", self, seq);
+    seq++;
+
+    shm_map(ch, O_CREAT | O_RDWR);
+    //    - sem_p: родитель -> ребенок (данные готовы к чтению)
+    //    - sem_c: ребенок -> родитель (ответ готов)
+    ch->sem[0] = sem_open(ch->name[1], O_CREAT, 0666, 0);
+    if (ch->sem[0] == SEM_FAILED) die("sem_open(sem_parent) failed");
+    ch->sem[1] = sem_open(ch->name[2], O_CREAT, 0666, 0);
+    if (ch->sem[1] == SEM_FAILED) die("sem_open(sem_child) failed");
+    for (int k = 0; k < 3; ++k) addr[k] = ch->name[k];
+}
+
+static size_t shm_call(struct ipc_chan* ch, const char* req, size_t n, const char** rep) {
+    struct shm_data* shm = SHM(ch);
+    if (n > IPC_MSG_MAX - 1) {
+        // собранный на месте (ipc_big) запрос не копируется
+        if (req != ch->big) memcpy(shm_big(ch, n), req, n);
+        ch->big[n] = '\0';
+        shm->big_len = n;
+    } else {
+        memcpy(shm->in_buf, req, n);
+        shm->in_buf[n] = '\0';
+        shm->big_len = 0;
+    }
+    sig_post(ch, 0);
+    sig_wait(ch, 1);
+    *rep = shm->out_buf;
+    return strlen(shm->out_buf);
+}
+
+static void shm_end(struct ipc_chan* ch) {
+    SHM(ch)->in_buf[0] = '\0';
+    SHM(ch)->big_len = 0;
+    sig_post(ch, 0); // дать ребёнку понять, что пора завершаться
+}
+
+static int shm_attach(struct ipc_chan* ch, char** argv, int argc) {
+    if (argc < 3) return -1;
+    for (int k = 0; k < 3; ++k) {
+        size_t n = strlen(argv[k]);
+        if (n >= sizeof(ch->name[k])) return -1;
+        memcpy(ch->name[k], argv[k], n + 1);
+    }
+    shm_map(ch, O_RDWR);
+    ch->sem[0] = sem_open(ch->name[1], 0);
+    if (ch->sem[0] == SEM_FAILED) die("sem_open(parent) failed");
+    ch->sem[1] = sem_open(ch->name[2], 0);
+    if (ch->sem[1] == SEM_FAILED) die("sem_open(child) failed");
+    return 3;
+}
+
+static size_t shm_recv(struct ipc_chan* ch, const char** req) {
+    struct shm_data* shm = SHM(ch);
+    sig_wait(ch, 0);
+    if (shm->big_len) {
+        big_map(ch, shm->big_size);
+        *req = ch->big;
+        return shm->big_len;
+    }
+    *req = shm->in_buf;
+    return strlen(shm->in_buf);
+}
+
+static void shm_reply(struct ipc_chan* ch, const char* rep, size_t n) {
+    struct shm_data* shm = SHM(ch);
+    if (n > IPC_MSG_MAX - 1) n = IPC_MSG_MAX - 1;
+    memcpy(shm->out_buf, rep, n);
+    shm->out_buf[n] = '\0';
+    sig_post(ch, 1);
+}
+
+static void shm_release(struct ipc_chan* ch) {
+    if (ch->big_size) munmap(ch->big, ch->big_size);
+    munmap(ch->shm, sizeof(struct shm_data));
+    close(ch->fd[0]);
+    sem_close(SEM_P(ch));
+    sem_close(SEM_C(ch));
+    if (ch->owner) {
+        sem_unlink(ch->name[1]);
+        sem_unlink(ch->name[2]);
+        shm_unlink(ch->name[0]);
+    }
+}
+
+const struct ipc_ops ipc_shm_ops = {
+    "shm", NULL,
+    shm_create, NULL, NULL, shm_call, NULL, NULL, shm_end,
+    shm_attach, shm_recv, shm_reply, shm_release, shm_big,
+    NULL, NULL, NULL,
+};
+
+// ======= memfd =======
+// Тот же обмен, но без объектов с именами: сегмент — memfd_create, оба
+// семафора — ipc_fsem (слово futex, wait.c) в его начале, каждый на своей
+// кэш-линии. Ребёнок
+// получает сегмент дескриптором IPC_MEMFD_FD через file actions
+// posix_spawn, адрес — один признак --memfd. Нет shm_open/sem_open (поиск
+// и создание файлов в /dev/shm) и нечего удалять, если кто-то упал.
+// Сегмент отображается с MAP_POPULATE: страницы готовы до первой строки.
+// Дескриптор ребёнок держит до конца: по нему отображается область
+// длинных запросов. С IPC_HUGE=1 сегмент — на huge pages (если они есть):
+// сегмент — одна такая страница, область длинных запросов — со второй.
+#define IPC_MEMFD_FD 3
+
+struct memfd_data {
+    struct ipc_fsem req __attribute__((aligned(CACHE_LINE)));
+    struct ipc_fsem rep __attribute__((aligned(CACHE_LINE)));
+    struct shm_data io __attribute__((aligned(CACHE_LINE)));
+};
+_Static_assert(sizeof(struct memfd_data) <= BIG_OFF, "memfd_data");
+
+// отобразить сегмент (len — целое число его страниц); 0 — не вышло
+static int memfd_map(struct ipc_chan* ch, int fd, size_t len) {
+    void* map = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, 0);
+    if (map == MAP_FAILED) return 0;
+    seg_lock(map, len);
+    struct memfd_data* d = (struct memfd_data*)map;
+    ch->sem[0] = &d->req;
+    ch->sem[1] = &d->rep;
+    ch->shm = &d->io;
+    return 1;
+}
+
+static size_t memfd_len(int fd) {
+    return page_round(sizeof(struct memfd_data), fd_page(fd));
+}
+
+static void memfd_create_chan(struct ipc_chan* ch, char** addr) {
+    // huge pages: свободных нет — ftruncate или mmap откажут, тогда обычные
+    int fd = env_on("IPC_HUGE") ? memfd_create("ipc_chan", MFD_CLOEXEC | MFD_HUGETLB) : -1;
+    if (fd >= 0 && (ftruncate(fd, (off_t)memfd_len(fd)) < 0 || !memfd_map(ch, fd, memfd_len(fd)))) {
+        close(fd);
+        fd = -1;
+    }
+    if (fd < 0) {
+        fd = memfd_create("ipc_chan", MFD_CLOEXEC);
+        if (fd < 0) die("memfd_create failed");
+        if (ftruncate(fd, (off_t)memfd_len(fd)) < 0) die("ftruncate failed");
+        if (!memfd_map(ch, fd, memfd_len(fd))) die("mmap failed");
+    }
+    ch->fd[0] = fd;
+    // ftruncate обнуляет: оба семафора — 0
+    size_t page = fd_page(fd);
+    shm_init_hdr(SHM(ch), page > 4096 ? SHM_HUGETLB : 0, page);
+    addr[0] = (char*)"--memfd";
+}
+
+static void memfd_actions(struct ipc_chan* ch, posix_spawn_file_actions_t* fa) {
+    // копия после dup2 — без O_CLOEXEC, сегмент переживёт execve
+    // (если номер совпал, glibc снимает флаг сам)
+    if (posix_spawn_file_actions_adddup2(fa, ch->fd[0], IPC_MEMFD_FD) != 0)
+        die("posix_spawn_file_actions failed");
+}
+
+static int memfd_attach(struct ipc_chan* ch, char** argv, int argc) {
+    (void)argv; (void)argc;
+    ch->fd[0] = IPC_MEMFD_FD;
+    if (!memfd_map(ch, IPC_MEMFD_FD, memfd_len(IPC_MEMFD_FD))) die("mmap failed");
+    shm_check(SHM(ch));
+    return 1;
+}
+
+static void memfd_release(struct ipc_chan* ch) {
+    if (ch->big_size) munmap(ch->big, ch->big_size);
+    munmap(ch->sem[0], memfd_len(ch->fd[0])); // req — в начале сегмента
+    close(ch->fd[0]);
+}
+
+const struct ipc_ops ipc_memfd_ops = {
+    "memfd", "--memfd",
+    memfd_create_chan, memfd_actions, NULL, shm_call, NULL, NULL, shm_end,
+    memfd_attach, shm_recv, shm_reply, memfd_release, shm_big,
+    NULL, NULL, NULL,
+};
@@ -0,0 +1,88 @@
+// Счётчики и гистограммы задержек процесса (ipc.h): сегмент POSIX shared
+// memory /shm_stat_<pid>, который процесс только пишет, а shmstat только
+// читает. Никто никого не ждёт: у каждого поля один писатель, он пишет
+// relaxed-записью, читатель видит целые 64-битные значения, но не обязательно
+// все из одного и того же мгновения — для скоростей и процентилей это не важно.
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "ipc.h"
+
+int64_t ipc_now_ns(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (int64_t)t.tv_sec * 1000000000 + t.tv_nsec;
+}
+
+struct ipc_stats* ipc_stats_open(int role, const char* transport) {
+    const char* v = getenv("IPC_STATS");
+    if (v && strcmp(v, "0") == 0) return NULL;
+    char name[64];
+    ipc_make_name(name, IPC_STATS_PREFIX, getpid(), 0);
+    int fd = shm_open(name, O_CREAT | O_RDWR, 0644);
+    if (fd < 0) return NULL; // без статистики работать можно
+    // сегмент с тем же pid мог остаться от упавшего процесса — обнулить
+    if (ftruncate(fd, 0) < 0 || ftruncate(fd, sizeof(struct ipc_stats)) < 0) {
+        close(fd);
+        shm_unlink(name);
+        return NULL;
+    }
+    void* map = mmap(NULL, sizeof(struct ipc_stats), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        shm_unlink(name);
+        return NULL;
+    }
+    struct ipc_stats* s = (struct ipc_stats*)map;
+    s->pid = getpid();
+    s->role = role;
+    size_t n = strlen(transport);
+    if (n >= sizeof(s->transport)) n = sizeof(s->transport) - 1;
+    memcpy(s->transport, transport, n);
+    s->started_ns = ipc_now_ns();
+    __atomic_store_n(&s->magic, IPC_STATS_MAGIC, __ATOMIC_RELEASE); // заголовок готов
+    return s;
+}
+
+void ipc_stats_close(struct ipc_stats* s) {
+    if (!s) return;
+    char name[64];
+    ipc_make_name(name, IPC_STATS_PREFIX, s->pid, 0);
+    munmap(s, sizeof(*s));
+    shm_unlink(name);
+}
+
+void ipc_stat_add(struct ipc_stats* s, int k, uint64_t v) {
+    __atomic_store_n(&s->c[k], s->c[k] + v, __ATOMIC_RELAXED);
+}
+
+void ipc_stat_set(struct ipc_stats* s, int k, uint64_t v) {
+    __atomic_store_n(&s->c[k], v, __ATOMIC_RELAXED);
+}
+
+// Корзина: значения до IPC_HIST_SUB — точно, дальше на каждую степень
+// двойки IPC_HIST_SUB корзин по трём битам после старшего (погрешность до 1/8).
+unsigned ipc_hist_bucket(uint64_t ns) {
+    if (ns < IPC_HIST_SUB) return (unsigned)ns;
+    unsigned msb = 63u - (unsigned)__builtin_clzll(ns);
+    return (msb - 2) * IPC_HIST_SUB + (unsigned)((ns >> (msb - 3)) & (IPC_HIST_SUB - 1));
+}
+
+uint64_t ipc_hist_value(unsigned b) {
+    if (b < IPC_HIST_SUB) return b;
+    unsigned msb = b / IPC_HIST_SUB + 2;
+    return (uint64_t)(IPC_HIST_SUB + b % IPC_HIST_SUB) << (msb - 3);
+}
+
+int64_t ipc_stat_lat(struct ipc_stats* s, int64_t since) {
+    int64_t now = ipc_now_ns();
+    uint64_t* h = &s->hist[ipc_hist_bucket(now > since ? (uint64_t)(now - since) : 0)];
+    __atomic_store_n(h, *h + 1, __ATOMIC_RELAXED);
+    return now;
+}
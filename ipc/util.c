@@ -0,0 +1,171 @@
+// ввод-вывод без stdio и чтение строк (ipc.h)
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+
+#include "ipc.h"
+
+void die(const char* msg) {
+    ssize_t _ __attribute__((unused)) = write(2, msg, strlen(msg));
+    ssize_t __ __attribute__((unused)) = write(2, "\n", 1);
+    _exit(1);
+}
+
+ssize_t write_all(int fd, const void* buf, size_t n) {
+    const char* p = (const char*)buf;
+    size_t left = n;
+    while (left) {
+        ssize_t w = write(fd, p, left);
+        if (w < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        left -= (size_t)w;
+        p += w;
+    }
+    return (ssize_t)n;
+}
+
+void chomp(char* s) {
+    size_t n = strlen(s);
+    if (n && s[n-1] == '\n') s[n-1] = '\0';
+}
+
+size_t parse_count(const char* s, size_t max) {
+    size_t v = 0;
+    if (!*s) return 0;
+    for (; *s; ++s) {
+        if (*s < '0' || *s > '9') return 0;
+        v = v * 10 + (size_t)(*s - '0');
+        if (v > max) return 0;
+    }
+    return v;
+}
+
+int ll_to_buf(long long v, char* buf) {
+    char tmp[32];
+    int neg = v < 0;
+    unsigned long long x = neg ? (unsigned long long)(-(v+1)) + 1ULL : (unsigned long long)v;
+    int n = 0;
+    do {
+        tmp[n++] = (char)('0' + (x % 10ULL));
+        x /= 10ULL;
+    } while (x);
+    int k = 0;
+    if (neg) buf[k++] = '-';
+    for (int i = n - 1; i >= 0; --i) buf[k++] = tmp[i];
+    return k;
+}
+
+void ipc_make_name(char* dst, const char* prefix, pid_t pid, int k) {
+    size_t n = strlen(prefix);
+    memcpy(dst, prefix, n);
+    n += (size_t)ll_to_buf(pid, dst + n);
+    if (k) {
+        dst[n++] = '_';
+        n += (size_t)ll_to_buf(k, dst + n);
+    }
+    dst[n] = '\0';
+}
+
+// ======= буферизованное чтение строк =======
+void lr_init(struct line_reader* lr, int fd) {
+    lr->fd = fd;
+    lr->eof = 0;
+    lr->pos = 0;
+    lr->len = 0;
+    lr->scanned = 0;
+}
+
+void lr_compact(struct line_reader* lr) {
+    if (lr->pos > 0) {
+        memmove(lr->buf, lr->buf + lr->pos, lr->len - lr->pos);
+        lr->len -= lr->pos;
+        lr->pos = 0;
+    }
+}
+
+ssize_t lr_fill(struct line_reader* lr) {
+    lr_compact(lr);
+    for (;;) {
+        ssize_t r = read(lr->fd, lr->buf + lr->len, LR_BUF_SIZE - lr->len);
+        if (r < 0 && errno == EINTR) continue;
+        if (r == 0) lr->eof = 1;
+        if (r > 0) lr->len += (size_t)r;
+        return r;
+    }
+}
+
+size_t lr_take(struct line_reader* lr, size_t max, const char** line) {
+    if (max > LR_BUF_SIZE) max = LR_BUF_SIZE;
+    size_t avail = lr->len - lr->pos;
+    char* beg = lr->buf + lr->pos;
+    size_t lim = avail < max ? avail : max;
+    char* nl = lim > lr->scanned ? memchr(beg + lr->scanned, '\n', lim - lr->scanned) : NULL;
+    size_t n = 0;
+    if (nl) n = (size_t)(nl - beg) + 1;
+    else if (avail >= max || (lr->eof && avail > 0)) n = lim;
+    if (!n) {
+        lr->scanned = lim; // при следующем вызове не сканировать заново
+        return 0;
+    }
+    *line = beg;
+    lr->pos += n;
+    lr->scanned = 0;
+    if (beg[n - 1] != '\n' && lr->pos == lr->len) beg[n] = '\0';
+    return n;
+}
+
+ssize_t lr_next(struct line_reader* lr, size_t max, const char** line) {
+    for (;;) {
+        size_t n = lr_take(lr, max, line);
+        if (n) return (ssize_t)n;
+        if (lr->eof) return 0;
+        if (lr_fill(lr) < 0) return -1;
+    }
+}
+
+int lr_need(struct line_reader* lr, size_t n) {
+    while (lr->len - lr->pos < n) {
+        if (lr->eof) return 0;
+        if (lr_fill(lr) < 0) die("не удалось прочитать данные");
+    }
+    return 1;
+}
+
+ssize_t lr_read_rest(struct line_reader* lr, char* dst, size_t cap, int* done) {
+    size_t avail = lr->len - lr->pos;
+    *done = 0;
+    if (avail) {
+        char* beg = lr->buf + lr->pos;
+        size_t lim = avail < cap ? avail : cap;
+        char* nl = memchr(beg, '\n', lim);
+        size_t n = nl ? (size_t)(nl - beg) + 1 : lim;
+        memcpy(dst, beg, n);
+        lr->pos += n;
+        lr->scanned = 0;
+        *done = nl != NULL;
+        return (ssize_t)n;
+    }
+    if (lr->eof) {
+        *done = 1;
+        return 0;
+    }
+    // буфер пуст: читать сразу в dst, но не больше буфера — хвост после
+    // '\n' должен в него поместиться
+    ssize_t r;
+    while ((r = read(lr->fd, dst, cap < LR_BUF_SIZE ? cap : LR_BUF_SIZE)) < 0 && errno == EINTR) {}
+    if (r <= 0) {
+        if (r == 0) lr->eof = *done = 1;
+        return r;
+    }
+    char* nl = memchr(dst, '\n', (size_t)r);
+    if (!nl) return r;
+    size_t n = (size_t)(nl - dst) + 1;
+    lr->pos = 0;
+    lr->len = (size_t)r - n;
+    lr->scanned = 0;
+    memcpy(lr->buf, dst + n, lr->len);
+    *done = 1;
+    return (ssize_t)n;
+}
@@ -0,0 +1,118 @@
+// Ожидание другой стороны (ipc.h): сначала короткое кручение с pause,
+// потом сон в ядре. Ответ ребёнка часто приходит за единицы микросекунд —
+// быстрее, чем стоят futex-вызов и переключение контекста.
+//
+// Бюджет кручения (итераций) — IPC_SPIN=N, постоянный; без переменной он
+// подстраивается сам: дождались на кручении — бюджет растёт вдвое (до
+// SPIN_MAX), пришлось уснуть — падает вдвое. На одном CPU кручение
+// бесполезно (другая сторона не работает, пока крутимся мы), там бюджет
+// по умолчанию 0.
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include <semaphore.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "ipc.h"
+
+#define SPIN_MAX   (1u << 14)
+#define SPIN_START 256u
+#define SPIN_MIN   16u        // ниже не падает: иначе бюджету не из чего расти
+
+// у каждого потока свой бюджет: поток, который обычно засыпает надолго,
+// не урезает его тому, кто дожидается ответа на кручении
+static __thread int spin_fixed = -1;     // -1 — ещё не настроено
+static __thread unsigned spin_max, spin_cur;
+
+static void spin_setup(void) {
+    const char* v = getenv("IPC_SPIN");
+    size_t n = v ? parse_count(v, SPIN_MAX) : 0;
+    if (v && (n || strcmp(v, "0") == 0)) {
+        spin_fixed = 1;
+        spin_max = spin_cur = (unsigned)n;
+    } else {
+        spin_fixed = 0;
+        spin_max = sysconf(_SC_NPROCESSORS_ONLN) > 1 ? SPIN_MAX : 0;
+        spin_cur = spin_max < SPIN_START ? spin_max : SPIN_START;
+    }
+}
+
+static inline void cpu_relax(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    __asm__ __volatile__("yield");
+#endif
+}
+
+int ipc_spin(int (*try)(void*), void* arg) {
+    if (spin_fixed < 0) spin_setup();
+    for (unsigned i = 0; i < spin_cur; ++i) {
+        if (try(arg)) {
+            if (!spin_fixed) spin_cur = spin_cur * 2 > spin_max ? spin_max : spin_cur * 2;
+            return 1;
+        }
+        cpu_relax();
+    }
+    if (try(arg)) return 1;
+    if (!spin_fixed && spin_cur > SPIN_MIN) spin_cur /= 2;
+    return 0;
+}
+
+// ======= семафор на слове в общей памяти =======
+static long futex(uint32_t* w, int op, uint32_t val, const struct timespec* t) {
+    return syscall(SYS_futex, w, op, val, t, NULL, 0);
+}
+
+static int fsem_try(void* arg) {
+    struct ipc_fsem* s = (struct ipc_fsem*)arg;
+    uint32_t v = __atomic_load_n(&s->val, __ATOMIC_RELAXED);
+    while (v) {
+        if (__atomic_compare_exchange_n(&s->val, &v, v - 1, 1, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+            return 1;
+    }
+    return 0;
+}
+
+void ipc_fsem_post(struct ipc_fsem* s) {
+    __atomic_fetch_add(&s->val, 1, __ATOMIC_SEQ_CST);
+    // будить, только если кто-то уже ушёл в futex (или собирается)
+    if (__atomic_load_n(&s->waiters, __ATOMIC_SEQ_CST))
+        futex(&s->val, FUTEX_WAKE, 1, NULL);
+}
+
+void ipc_fsem_wait(struct ipc_fsem* s) {
+    while (!ipc_fsem_timedwait(s, -1)) {}
+}
+
+int ipc_fsem_timedwait(struct ipc_fsem* s, long ms) {
+    if (ipc_spin(fsem_try, s)) return 1;
+    struct timespec t = { ms / 1000, (ms % 1000) * 1000000 };
+    int got;
+    __atomic_fetch_add(&s->waiters, 1, __ATOMIC_SEQ_CST);
+    // val == 0 проверяет ядро: post между проверкой и сном не потеряется
+    while (!(got = fsem_try(s))) {
+        if (futex(&s->val, FUTEX_WAIT, 0, ms < 0 ? NULL : &t) == 0 || errno == EAGAIN || errno == EINTR)
+            continue;
+        if (errno != ETIMEDOUT) die("futex failed");
+        got = fsem_try(s);
+        break;
+    }
+    __atomic_fetch_sub(&s->waiters, 1, __ATOMIC_RELAXED);
+    return got;
+}
+
+// ======= именованный семафор POSIX =======
+// sem_trywait обходится без системного вызова, sem_wait засыпает на futex
+static int sem_try(void* arg) {
+    return sem_trywait((sem_t*)arg) == 0;
+}
+
+void ipc_sem_wait(void* sem) {
+    if (ipc_spin(sem_try, sem)) return;
+    while (sem_wait((sem_t*)sem) < 0)
+        if (errno != EINTR) die("sem_wait failed");
+}
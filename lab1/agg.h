@@ -0,0 +1,315 @@
+// Набор агрегатов на строку: sum, min, max, count, mean, hist=LO:HI:N.
+// Набор согласуется при запуске строкой PROTO_AGGS (proto.h); без неё
+// ребёнок, как раньше, считает только сумму. Разбор строки при этом один:
+// парсер отдаёт сумму (с той же проверкой переполнения, что и раньше) и
+// массив чисел, а остальное считается одним проходом по массиву — min/max
+// векторно (AVX2, если есть).
+// Текстовый ответ: запрошенные агрегаты в порядке sum min max count mean hist,
+// через пробел, например "sum=10 max=7 mean=2.500 hist=1,2,0\n". mean —
+// с тремя знаками после точки. hist — N корзин одинаковой ширины на
+// [LO, HI); значения вне диапазона попадают в крайние корзины.
+#ifndef LAB1_AGG_H
+#define LAB1_AGG_H
+
+#include <stdint.h>
+#include <limits.h>
+#include <string.h>
+#include <immintrin.h>
+
+#include "proto.h"
+#include "../ipc/ipc.h"
+
+#define AGG_SUM    1u
+#define AGG_MIN    2u
+#define AGG_MAX    4u
+#define AGG_COUNT  8u
+#define AGG_MEAN  16u
+#define AGG_HIST  32u
+
+#define HIST_MAX  16
+#define AGG_VALS_MAX (5 + HIST_MAX)   // значений в двоичном ответе сверх суммы
+#define REPLY_MAX 512                 // самый длинный текстовый ответ
+
+// ответы на строку, которую не удалось сложить (ребёнок, родитель по
+// двоичному ответу, logtool)
+static const char MSG_BAD_FORMAT[] = "ERR: invalid number format\n";
+static const char MSG_NO_NUMBERS[] = "Бро, ошибка, тут числа нет либо что-то чужеродное\n";
+static const char MSG_OVERFLOW[]   = "ERR: integer overflow\n";
+
+struct agg_spec {
+    unsigned mask;
+    unsigned nbins;
+    long long lo, hi;
+    uint64_t width;     // ширина корзины
+};
+
+struct agg_res {
+    long long sum, min, max, count;
+    // среднее, округлённое до тысячных: целая часть и тысячные (знак — у обеих)
+    long long mean_int, mean_frac;
+    long long hist[HIST_MAX];
+};
+
+static inline void agg_default(struct agg_spec* a) {
+    memset(a, 0, sizeof(*a));
+    a->mask = AGG_SUM;
+}
+
+// целое со знаком из s[*i..n); 1 — успех
+static inline int agg_parse_ll(const char* s, size_t n, size_t* i, long long* out) {
+    int neg = *i < n && s[*i] == '-';
+    if (neg) (*i)++;
+    if (*i >= n || s[*i] < '0' || s[*i] > '9') return 0;
+    unsigned long long u = 0;
+    for (; *i < n && s[*i] >= '0' && s[*i] <= '9'; ++*i) {
+        if (u > (ULLONG_MAX - 9) / 10) return 0;
+        u = u * 10 + (unsigned long long)(s[*i] - '0');
+    }
+    if (u > (unsigned long long)LLONG_MAX + (unsigned long long)neg) return 0;
+    *out = neg ? (long long)(0 - u) : (long long)u;
+    return 1;
+}
+
+// Список через запятую, например "sum,min,hist=0:100:10" (конец — n или
+// '\n'). 1 — набор понятен, 0 — нет (тогда *a не тронут).
+static inline int agg_parse(const char* s, size_t n, struct agg_spec* a) {
+    struct agg_spec r;
+    memset(&r, 0, sizeof(r));
+    size_t i = 0;
+    while (n && (s[n - 1] == '\n' || s[n - 1] == '\r')) n--;
+    for (;;) {
+        size_t e = i;
+        while (e < n && s[e] != ',' && s[e] != '=') e++;
+        size_t len = e - i;
+        if (len == 3 && memcmp(s + i, "sum", 3) == 0) r.mask |= AGG_SUM;
+        else if (len == 3 && memcmp(s + i, "min", 3) == 0) r.mask |= AGG_MIN;
+        else if (len == 3 && memcmp(s + i, "max", 3) == 0) r.mask |= AGG_MAX;
+        else if (len == 5 && memcmp(s + i, "count", 5) == 0) r.mask |= AGG_COUNT;
+        else if (len == 4 && memcmp(s + i, "mean", 4) == 0) r.mask |= AGG_MEAN;
+        else if (len == 4 && memcmp(s + i, "hist", 4) == 0 && e < n && s[e] == '=') {
+            long long nb;
+            i = e + 1;
+            if (!agg_parse_ll(s, n, &i, &r.lo) || i >= n || s[i++] != ':') return 0;
+            if (!agg_parse_ll(s, n, &i, &r.hi) || i >= n || s[i++] != ':') return 0;
+            if (!agg_parse_ll(s, n, &i, &nb) || nb < 1 || nb > HIST_MAX || r.lo >= r.hi) return 0;
+            r.mask |= AGG_HIST;
+            r.nbins = (unsigned)nb;
+            uint64_t span = (uint64_t)r.hi - (uint64_t)r.lo;
+            r.width = span / r.nbins + (span % r.nbins != 0);
+            e = i;
+        } else {
+            return 0;
+        }
+        if (e == n) break;
+        if (s[e] != ',') return 0;
+        i = e + 1;
+    }
+    *a = r;
+    return 1;
+}
+
+// сколько значений int64 идёт в двоичном ответе вслед за frame_reply
+static inline size_t agg_nvals(const struct agg_spec* a) {
+    if (a->mask == AGG_SUM) return 0;
+    return (size_t)!!(a->mask & AGG_MIN) + !!(a->mask & AGG_MAX) + !!(a->mask & AGG_COUNT)
+         + 2 * !!(a->mask & AGG_MEAN) + ((a->mask & AGG_HIST) ? a->nbins : 0);
+}
+
+static inline size_t agg_pack(const struct agg_spec* a, const struct agg_res* r, int64_t* v) {
+    size_t k = 0;
+    if (a->mask == AGG_SUM) return 0;
+    if (a->mask & AGG_MIN)   v[k++] = r->min;
+    if (a->mask & AGG_MAX)   v[k++] = r->max;
+    if (a->mask & AGG_COUNT) v[k++] = r->count;
+    if (a->mask & AGG_MEAN) {
+        v[k++] = r->mean_int;
+        v[k++] = r->mean_frac;
+    }
+    if (a->mask & AGG_HIST)
+        for (unsigned b = 0; b < a->nbins; ++b) v[k++] = r->hist[b];
+    return k;
+}
+
+static inline void agg_unpack(const struct agg_spec* a, long long sum, const int64_t* v, struct agg_res* r) {
+    size_t k = 0;
+    memset(r, 0, sizeof(*r));
+    r->sum = sum;
+    if (a->mask == AGG_SUM) return;
+    if (a->mask & AGG_MIN)   r->min = v[k++];
+    if (a->mask & AGG_MAX)   r->max = v[k++];
+    if (a->mask & AGG_COUNT) r->count = v[k++];
+    if (a->mask & AGG_MEAN) {
+        r->mean_int = v[k++];
+        r->mean_frac = v[k++];
+    }
+    if (a->mask & AGG_HIST)
+        for (unsigned b = 0; b < a->nbins; ++b) r->hist[b] = v[k++];
+}
+
+// ---- вычисление ----
+static inline void agg_minmax_scalar(const long long* v, size_t n, long long* mn, long long* mx) {
+    long long lo = v[0], hi = v[0];
+    for (size_t i = 1; i < n; ++i) {
+        lo = v[i] < lo ? v[i] : lo;
+        hi = v[i] > hi ? v[i] : hi;
+    }
+    *mn = lo;
+    *mx = hi;
+}
+
+// по 8 значений за шаг в двух парах регистров (vpcmpgtq + blend)
+__attribute__((target("avx2")))
+static inline void agg_minmax_avx2(const long long* v, size_t n, long long* mn, long long* mx) {
+    if (n < 8) { agg_minmax_scalar(v, n, mn, mx); return; }
+    __m256i lo0 = _mm256_loadu_si256((const __m256i*)v), hi0 = lo0;
+    __m256i lo1 = _mm256_loadu_si256((const __m256i*)(v + 4)), hi1 = lo1;
+    size_t i = 8;
+    for (; i + 8 <= n; i += 8) {
+        __m256i a = _mm256_loadu_si256((const __m256i*)(v + i));
+        __m256i b = _mm256_loadu_si256((const __m256i*)(v + i + 4));
+        lo0 = _mm256_blendv_epi8(lo0, a, _mm256_cmpgt_epi64(lo0, a));
+        hi0 = _mm256_blendv_epi8(hi0, a, _mm256_cmpgt_epi64(a, hi0));
+        lo1 = _mm256_blendv_epi8(lo1, b, _mm256_cmpgt_epi64(lo1, b));
+        hi1 = _mm256_blendv_epi8(hi1, b, _mm256_cmpgt_epi64(b, hi1));
+    }
+    lo0 = _mm256_blendv_epi8(lo0, lo1, _mm256_cmpgt_epi64(lo0, lo1));
+    hi0 = _mm256_blendv_epi8(hi0, hi1, _mm256_cmpgt_epi64(hi1, hi0));
+    long long l[4], h[4];
+    _mm256_storeu_si256((__m256i*)l, lo0);
+    _mm256_storeu_si256((__m256i*)h, hi0);
+    long long rl, rh;
+    agg_minmax_scalar(l, 4, &rl, &rh);
+    *mn = rl;
+    agg_minmax_scalar(h, 4, &rl, &rh);
+    *mx = rh;
+    for (; i < n; ++i) { // хвост
+        *mn = v[i] < *mn ? v[i] : *mn;
+        *mx = v[i] > *mx ? v[i] : *mx;
+    }
+}
+
+// Агрегаты по n >= 1 числам строки; sum уже посчитан парсером.
+static inline void agg_values(const struct agg_spec* a, const long long* v, size_t n,
+                              long long sum, struct agg_res* r) {
+    r->sum = sum;
+    r->count = (long long)n;
+    if (a->mask & (AGG_MIN | AGG_MAX)) {
+        if (__builtin_cpu_supports("avx2")) agg_minmax_avx2(v, n, &r->min, &r->max);
+        else agg_minmax_scalar(v, n, &r->min, &r->max);
+    }
+    if (a->mask & AGG_MEAN) { // округление половины — от нуля
+        __int128 num = (__int128)sum * 2000 + (sum < 0 ? -(__int128)n : (__int128)n);
+        __int128 m = num / (2 * (__int128)n);
+        r->mean_int = (long long)(m / 1000);
+        r->mean_frac = (long long)(m % 1000);
+    }
+    if (a->mask & AGG_HIST) {
+        long long* h = r->hist;
+        memset(h, 0, sizeof(r->hist));
+        unsigned last = a->nbins - 1;
+        for (size_t i = 0; i < n; ++i) {
+            long long x = v[i];
+            unsigned b = x < a->lo ? 0 : x >= a->hi ? last
+                       : (unsigned)(((uint64_t)x - (uint64_t)a->lo) / a->width);
+            h[b]++;
+        }
+    }
+}
+
+// ---- текст ответа ----
+static inline size_t agg_put_ull(unsigned long long x, char* buf) {
+    char tmp[24];
+    size_t n = 0, k = 0;
+    do { tmp[n++] = (char)('0' + x % 10); x /= 10; } while (x);
+    while (n) buf[k++] = tmp[--n];
+    return k;
+}
+
+static inline size_t agg_put_ll(long long v, char* buf) {
+    if (v >= 0) return agg_put_ull((unsigned long long)v, buf);
+    buf[0] = '-';
+    return 1 + agg_put_ull(0 - (unsigned long long)v, buf + 1);
+}
+
+static inline size_t agg_put(char* out, size_t k, const char* name, long long v) {
+    if (k) out[k++] = ' ';
+    size_t n = strlen(name);
+    memcpy(out + k, name, n);
+    return k + n + agg_put_ll(v, out + k + n);
+}
+
+// текст удачного ответа (не больше REPLY_MAX байт); возвращает длину
+static inline size_t agg_format(const struct agg_spec* a, const struct agg_res* r, char* out) {
+    size_t k = 0;
+    if (a->mask & AGG_SUM)   k = agg_put(out, k, "sum=", r->sum);
+    if (a->mask & AGG_MIN)   k = agg_put(out, k, "min=", r->min);
+    if (a->mask & AGG_MAX)   k = agg_put(out, k, "max=", r->max);
+    if (a->mask & AGG_COUNT) k = agg_put(out, k, "count=", r->count);
+    if (a->mask & AGG_MEAN) {
+        long long q = r->mean_int, f = r->mean_frac;
+        if (k) out[k++] = ' ';
+        memcpy(out + k, "mean=", 5); k += 5;
+        if (q < 0 || f < 0) out[k++] = '-';
+        k += agg_put_ull(q < 0 ? 0 - (unsigned long long)q : (unsigned long long)q, out + k);
+        unsigned long long u = (unsigned long long)(f < 0 ? -f : f);
+        out[k++] = '.';
+        out[k++] = (char)('0' + u / 100);
+        out[k++] = (char)('0' + u / 10 % 10);
+        out[k++] = (char)('0' + u % 10);
+    }
+    if (a->mask & AGG_HIST) {
+        if (k) out[k++] = ' ';
+        memcpy(out + k, "hist=", 5); k += 5;
+        for (unsigned b = 0; b < a->nbins; ++b) {
+            if (b) out[k++] = ',';
+            k += agg_put_ll(r->hist[b], out + k);
+        }
+    }
+    out[k++] = '\n';
+    return k;
+}
+
+// ---- ответ на строку ----
+// Один текст на всех: его пишет ребёнок (в канал и в файл), его же
+// восстанавливают родитель из двоичного ответа, parent_shm из массива -B
+// и logtool из журнала.
+
+// код ответа RS_* (proto.h) по результату разбора (sum_line, vals_line)
+static inline int32_t rs_status(int st) {
+    return st == PARSE_OK ? RS_OK : st == PARSE_END ? RS_NO_NUMBERS
+         : st == PARSE_BAD ? RS_BAD_FORMAT : RS_OVERFLOW;
+}
+
+// текст ответа по коду RS_* (не больше REPLY_MAX байт); r нужен только
+// при RS_OK. Возвращает длину.
+static inline size_t format_reply(const struct agg_spec* a, int32_t status, const struct agg_res* r, char* out) {
+    switch (status) {
+    case RS_OK:
+        break;
+    case RS_BAD_FORMAT: // ровно один ответ на строку, как в ЛР3
+        memcpy(out, MSG_BAD_FORMAT, sizeof(MSG_BAD_FORMAT) - 1);
+        return sizeof(MSG_BAD_FORMAT) - 1;
+    case RS_NO_NUMBERS:
+        memcpy(out, MSG_NO_NUMBERS, sizeof(MSG_NO_NUMBERS) - 1);
+        return sizeof(MSG_NO_NUMBERS) - 1;
+    default: // число или сумма не влезли в long long
+        memcpy(out, MSG_OVERFLOW, sizeof(MSG_OVERFLOW) - 1);
+        return sizeof(MSG_OVERFLOW) - 1;
+    }
+    if (a->mask != AGG_SUM) return agg_format(a, r, out);
+    size_t k = 0;
+    memcpy(out + k, "sum=", 4);  k += 4;
+    k += (size_t)ll_to_buf(r->sum, out + k);
+    out[k++] = '\n';
+    return k;
+}
+
+// двоичный ответ (proto.h) и значения агрегатов за ним -> тот же текст
+static inline size_t format_frame(const struct agg_spec* a, const struct frame_reply* f,
+                                  const int64_t* extra, char* out) {
+    struct agg_res r;
+    agg_unpack(a, (long long)f->value, extra, &r);
+    return format_reply(a, f->status, &r, out);
+}
+
+#endif
@@ -1,146 +1,782 @@
+#define _GNU_SOURCE
 #include <unistd.h>
 #include <fcntl.h>
 #include <sys/types.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#include <pthread.h>
 #include <errno.h>
 #include <string.h>
 #include <stdlib.h>
+#include <stddef.h>
+#include <time.h>
+#include <stdint.h>
 
-static void die(const char* msg) {
-    ssize_t _ __attribute__((unused)) = write(2, msg, strlen(msg));
-    ssize_t __ __attribute__((unused)) = write(2, "\n", 1);
-    _exit(1);
+#include "proto.h"
+#include "reslog.h"
+#include "agg.h"
+#include "rcache.h"
+#include "../ipc/ipc.h"
+
+// набор агрегатов (agg.h), согласуется при запуске; по умолчанию — только sum
+static struct agg_spec aggs = { AGG_SUM, 0, 0, 0, 0 };
+
+// больше чисел в строке (или кадре FR_TEXT) не поместится: "1 1 1 ..."
+#define MAX_VALS (LR_BUF_SIZE / 2 + 1)
+static __thread long long vals_buf[MAX_VALS];
+
+// Разобрать строку: код sum_line, в r — сумма и остальные агрегаты набора.
+// Строка должна заканчиваться '\n' или '\0'.
+static int eval_line(const char* line, struct agg_res* r) {
+    if (aggs.mask == AGG_SUM) return sum_line(line, &r->sum);
+    size_t n;
+    int st = vals_line(line, &r->sum, vals_buf, &n);
+    if (st == PARSE_OK) agg_values(&aggs, vals_buf, n, r->sum, r);
+    return st;
+}
+
+// текст ответа по результату eval_line (не больше REPLY_MAX байт); возвращает длину
+static size_t format_result(int st, const struct agg_res* r, char* out) {
+    return format_reply(&aggs, rs_status(st), r, out);
+}
+
+// кэш результатов (rcache.h), --cache N; по умолчанию выключен
+static struct rcache cache;
+
+// eval_line через кэш: строка line[0..n) уже встречалась — разбора нет
+static int eval_cached(const char* line, size_t n, struct agg_res* r) {
+    int hit;
+    struct rc_entry* e = rc_lookup(&cache, line, n, &hit);
+    if (!e) return eval_line(line, r);
+    if (!hit) e->st = eval_line(line, &e->r);
+    *r = e->r;
+    return e->st;
 }
 
-static ssize_t write_all(int fd, const void* buf, size_t n) {
-    const char* p = (const char*)buf;
-    size_t left = n;
-    while (left) {
-        ssize_t w = write(fd, p, left);
-        if (w < 0) { if (errno == EINTR) continue; return -1; }
-        left -= (size_t)w; p += w;
+// разобрать строку line[0..n) и сформировать ответ в out (не больше REPLY_MAX
+// байт). Строка должна заканчиваться '\n' или '\0'. Возвращает длину ответа.
+static size_t process_line(const char* line, size_t n, char* out) {
+    struct agg_res r;
+    int st = eval_cached(line, n, &r);
+    return format_result(st, &r, out);
+}
+
+// ======= двоичный режим (proto.h) =======
+// агрегаты готовых чисел из кадра FR_INTS; коды — как у sum_line
+static int eval_ints(const char* p, size_t n, struct agg_res* r) {
+    long long acc = 0;
+    for (size_t k = 0; k < n; ++k) {
+        int64_t v;
+        memcpy(&v, p + k * sizeof(v), sizeof(v));
+        if (__builtin_add_overflow(acc, (long long)v, &acc)) return PARSE_OVERFLOW;
     }
-    return (ssize_t)n;
+    r->sum = acc;
+    if (!n) return PARSE_END;
+    if (aggs.mask != AGG_SUM) {
+        memcpy(vals_buf, p, n * sizeof(int64_t)); // кадр в буфере не выровнен
+        agg_values(&aggs, vals_buf, n, acc, r);
+    }
+    return PARSE_OK;
 }
 
-static ssize_t read_line(int fd, char* buf, size_t cap) {
-    size_t i = 0;
-    while (i + 1 < cap) {
-        char c;
-        ssize_t r = read(fd, &c, 1);
-        if (r == 0) break; // EOF
-        if (r < 0) { if (errno == EINTR) continue; return -1; }
-        buf[i++] = c;
-        if (c == '\n') break;
+// Кадры запросов -> ответы по 16 байт в stdout. В файл по-прежнему пишется
+// текст: его читает человек (или записи журнала, если log задан). Ответы копятся и уходят разом, когда во входном
+// буфере не осталось целого кадра (перед ожиданием ввода) или буфер полон —
+// построчный родитель ждёт ответ, держать его дольше нельзя.
+// Конец работы — EOF на stdin.
+#define REPLY_BATCH 1024
+
+static void run_binary(struct line_reader* in, int fd, struct reslog* log) {
+    // ответ — frame_reply и agg_nvals() значений набора агрегатов
+    static char reps[REPLY_BATCH * (sizeof(struct frame_reply) + AGG_VALS_MAX * sizeof(int64_t))];
+    static char text[REPLY_BATCH * REPLY_MAX];
+    size_t nrep = 0, rep_len = 0, text_len = 0;
+
+    for (;;) {
+        struct frame_hdr h;
+        size_t avail = in->len - in->pos;
+        if (avail >= sizeof(h)) memcpy(&h, in->buf + in->pos, sizeof(h));
+        if (avail < sizeof(h) || avail - sizeof(h) < h.len || nrep == REPLY_BATCH) {
+            write_all(1, reps, rep_len);       // в parent
+            write_all(fd, text, text_len);     // в файл
+            nrep = rep_len = text_len = 0;
+            if (!lr_need(in, sizeof(h))) break;
+            memcpy(&h, in->buf + in->pos, sizeof(h));
+        }
+        in->pos += sizeof(h);
+        if (h.len > FRAME_MAX || !lr_need(in, h.len)) die("дочь: оборванный кадр");
+        const char* p = in->buf + in->pos;
+        in->pos += h.len;
+
+        struct agg_res res;
+        int st;
+        if (h.type == FR_TEXT) {
+            if (h.len == 0 || p[h.len - 1] != '\n') die("дочь: кадр FR_TEXT без перевода строки");
+            st = eval_cached(p, h.len, &res);
+        } else if (h.type == FR_INTS && h.len % sizeof(int64_t) == 0) {
+            st = eval_ints(p, h.len / sizeof(int64_t), &res);
+        } else {
+            die("дочь: неизвестный кадр");
+        }
+
+        struct frame_reply r;
+        int64_t extra[AGG_VALS_MAX];
+        size_t nextra = agg_nvals(&aggs);
+        r.status = rs_status(st);
+        r.reserved = 0;
+        r.value = st == PARSE_OK ? res.sum : 0;
+        if (st == PARSE_OK) agg_pack(&aggs, &res, extra);
+        else memset(extra, 0, sizeof(extra));
+        memcpy(reps + rep_len, &r, sizeof(r));
+        memcpy(reps + rep_len + sizeof(r), extra, nextra * sizeof(int64_t));
+        rep_len += sizeof(r) + nextra * sizeof(int64_t);
+        nrep++;
+        if (log) rl_add(log, r.status, res.sum);
+        else text_len += format_result(st, &res, text + text_len);
+    }
+}
+
+// ======= пакетный режим: child --input <file> =======
+// Файл отображается через mmap и режется по границам строк на куски
+// по CHUNK_SIZE байт. Потоки разбирают куски параллельно, каждый в свой
+// буфер вывода; главный поток выводит буферы строго по порядку кусков.
+// Кусков «в работе» не больше числа слотов, так что память ограничена.
+#define CHUNK_SIZE (1 << 20)
+#define SLOTS_PER_THREAD 4
+
+struct chunk_res {
+    int32_t status;
+    long long sum;
+};
+
+struct chunk {
+    const char* beg;
+    const char* end;
+    char* out;              // ответы на строки куска (mmap, растёт по мере надобности)
+    size_t out_len, out_cap;
+    struct chunk_res* res;  // итоги строк для журнала (только при --binlog)
+    size_t nres, res_cap;
+    int stop;               // в куске встретилась пустая строка — дальше не идём
+    int done;
+};
+
+struct batch {
+    const char* data;
+    size_t size;
+    size_t next_off;        // откуда начнётся следующий кусок
+    size_t claimed;         // номер следующего куска
+    size_t emitted;         // сколько кусков уже выведено
+    size_t nslots;
+    int quit;
+    struct chunk* slots;    // кусок i живёт в slots[i % nslots]
+    pthread_mutex_t mu;
+    pthread_cond_t cv_done; // кусок готов
+    pthread_cond_t cv_free; // освободился слот
+};
+
+static void chunk_put(struct chunk* c, const char* s, size_t n) {
+    if (c->out_len + n > c->out_cap) {
+        size_t ncap = c->out_cap * 2;
+        void* p = mremap(c->out, c->out_cap, ncap, MREMAP_MAYMOVE);
+        if (p == MAP_FAILED) die("child: mremap failed");
+        c->out = (char*)p;
+        c->out_cap = ncap;
+    }
+    memcpy(c->out + c->out_len, s, n);
+    c->out_len += n;
+}
+
+// Разобрать кусок. Строки режутся ровно так же, как это делает lr_next
+// в построчном режиме (куски по LR_BUF_SIZE байт), чтобы вывод совпадал
+// байт в байт.
+static void process_chunk(struct chunk* c) {
+    static __thread char tmp[LR_BUF_SIZE + 1];
+    char out[REPLY_MAX];
+    const char* p = c->beg;
+    while (p < c->end) {
+        size_t left = (size_t)(c->end - p);
+        size_t lim = left < LR_BUF_SIZE ? left : LR_BUF_SIZE;
+        const char* nl = memchr(p, '\n', lim);
+        size_t n = nl ? (size_t)(nl - p) + 1 : lim;
+        if (p[0] == '\n' || p[0] == '\0') { // пустая строка — конец
+            c->stop = 1;
+            return;
+        }
+        const char* line = p;
+        if (p[n - 1] != '\n') { // разбору нужен '\n' или '\0' в конце
+            memcpy(tmp, p, n);
+            tmp[n] = '\0';
+            line = tmp;
+        }
+        struct agg_res r;
+        int st = eval_line(line, &r);
+        chunk_put(c, out, format_result(st, &r, out));
+        if (c->res_cap) {
+            if (c->nres == c->res_cap) {
+                size_t ncap = c->res_cap * 2;
+                void* r = mremap(c->res, c->res_cap * sizeof(*c->res), ncap * sizeof(*c->res), MREMAP_MAYMOVE);
+                if (r == MAP_FAILED) die("child: mremap failed");
+                c->res = (struct chunk_res*)r;
+                c->res_cap = ncap;
+            }
+            c->res[c->nres].status = rs_status(st);
+            c->res[c->nres++].sum = r.sum;
+        }
+        p += n;
     }
-    buf[i] = '\0';
-    return (ssize_t)i;
 }
 
-// простой парсер long long (десятичный)
-static int parse_ll(const char* s, size_t* i, long long* out) {
-    while (s[*i] == ' ' || s[*i] == '\t' || s[*i] == '\r') (*i)++;
+static void* batch_worker(void* arg) {
+    struct batch* b = (struct batch*)arg;
+    pthread_mutex_lock(&b->mu);
+    for (;;) {
+        while (!b->quit && b->next_off < b->size && b->claimed >= b->emitted + b->nslots)
+            pthread_cond_wait(&b->cv_free, &b->mu);
+        if (b->quit || b->next_off >= b->size) break;
+
+        // отрезать следующий кусок по границе строки
+        struct chunk* c = &b->slots[b->claimed % b->nslots];
+        b->claimed++;
+        c->beg = b->data + b->next_off;
+        size_t end = b->next_off + CHUNK_SIZE;
+        if (end < b->size) {
+            const char* nl = memchr(b->data + end, '\n', b->size - end);
+            end = nl ? (size_t)(nl - b->data) + 1 : b->size;
+        } else {
+            end = b->size;
+        }
+        c->end = b->data + end;
+        b->next_off = end;
+        pthread_mutex_unlock(&b->mu);
+
+        process_chunk(c);
 
-    int sign = 1;
-    if (s[*i] == '+' || s[*i] == '-') {
-        if (s[*i] == '-') sign = -1;
-        (*i)++;
+        pthread_mutex_lock(&b->mu);
+        c->done = 1;
+        pthread_cond_broadcast(&b->cv_done);
     }
+    pthread_mutex_unlock(&b->mu);
+    return NULL;
+}
 
-    if (s[*i] < '0' || s[*i] > '9') return 0;
+static void run_batch(const char* inputName, int fd, struct reslog* log, size_t nthreads) {
+    int in_fd = open(inputName, O_RDONLY);
+    if (in_fd < 0) die("child: open(input) failed");
+    struct stat st;
+    if (fstat(in_fd, &st) < 0) die("child: fstat(input) failed");
+    size_t size = (size_t)st.st_size;
+    if (size == 0) { close(in_fd); return; }
 
-    long long val = 0;
-    int found_digit = 0;
-    while (s[*i] >= '0' && s[*i] <= '9') {
-        int d = s[*i] - '0';
-        val = val * 10 + d;
-        (*i)++;
-        found_digit = 1;
+    void* data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, in_fd, 0);
+    if (data == MAP_FAILED) die("child: mmap(input) failed");
+    close(in_fd);
+    madvise(data, size, MADV_SEQUENTIAL);
+
+    struct batch b;
+    b.data = (const char*)data;
+    b.size = size;
+    b.next_off = 0;
+    b.claimed = 0;
+    b.emitted = 0;
+    b.nslots = nthreads * SLOTS_PER_THREAD;
+    b.quit = 0;
+    b.slots = mmap(NULL, b.nslots * sizeof(struct chunk), PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (b.slots == MAP_FAILED) die("child: mmap(slots) failed");
+    for (size_t s = 0; s < b.nslots; ++s) {
+        struct chunk* c = &b.slots[s];
+        c->out_cap = CHUNK_SIZE;
+        c->out = mmap(NULL, c->out_cap, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (c->out == MAP_FAILED) die("child: mmap(out) failed");
+        c->res = NULL;
+        c->res_cap = 0;
+        if (log) {
+            c->res_cap = CHUNK_SIZE / 16;
+            c->res = mmap(NULL, c->res_cap * sizeof(*c->res), PROT_READ | PROT_WRITE,
+                          MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (c->res == MAP_FAILED) die("child: mmap(res) failed");
+        }
+        c->nres = 0;
+        c->out_len = 0;
+        c->stop = 0;
+        c->done = 0;
     }
+    pthread_mutex_init(&b.mu, NULL);
+    pthread_cond_init(&b.cv_done, NULL);
+    pthread_cond_init(&b.cv_free, NULL);
 
-    // проверка на . или ,
-    if (s[*i] == '.' || s[*i] == ',') {
-        *out = 0;
-        while (s[*i] && s[*i] != ' ' && s[*i] != '\n') (*i)++;
-        errno = EINVAL;
-        return -1;
+    pthread_t* threads = mmap(NULL, nthreads * sizeof(pthread_t), PROT_READ | PROT_WRITE,
+                              MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (threads == MAP_FAILED) die("child: mmap(threads) failed");
+    for (size_t t = 0; t < nthreads; ++t)
+        if (pthread_create(&threads[t], NULL, batch_worker, &b) != 0) die("child: pthread_create failed");
+
+    // вывод кусков по порядку
+    for (size_t idx = 0;; ++idx) {
+        struct chunk* c = &b.slots[idx % b.nslots];
+        pthread_mutex_lock(&b.mu);
+        while (!c->done && !(b.next_off >= b.size && idx >= b.claimed))
+            pthread_cond_wait(&b.cv_done, &b.mu);
+        int have = c->done;
+        pthread_mutex_unlock(&b.mu);
+        if (!have) break; // кусков больше нет
+
+        write_all(1, c->out, c->out_len);   // в parent
+        if (log) {                          // в файл
+            for (size_t k = 0; k < c->nres; ++k) rl_add(log, c->res[k].status, c->res[k].sum);
+        } else {
+            write_all(fd, c->out, c->out_len);
+        }
+        int stop = c->stop;
+
+        pthread_mutex_lock(&b.mu);
+        c->done = 0;
+        c->out_len = 0;
+        c->nres = 0;
+        c->stop = 0;
+        b.emitted++;
+        if (stop) b.quit = 1;
+        pthread_cond_broadcast(&b.cv_free);
+        pthread_mutex_unlock(&b.mu);
+        if (stop) break;
     }
 
-    if (!found_digit) return 0;
-    *out = val * sign;
-    return 1;
+    for (size_t t = 0; t < nthreads; ++t) pthread_join(threads[t], NULL);
+
+    for (size_t s = 0; s < b.nslots; ++s) {
+        munmap(b.slots[s].out, b.slots[s].out_cap);
+        if (b.slots[s].res_cap) munmap(b.slots[s].res, b.slots[s].res_cap * sizeof(*b.slots[s].res));
+    }
+    munmap(b.slots, b.nslots * sizeof(struct chunk));
+    munmap(threads, nthreads * sizeof(pthread_t));
+    pthread_mutex_destroy(&b.mu);
+    pthread_cond_destroy(&b.cv_done);
+    pthread_cond_destroy(&b.cv_free);
+    munmap(data, size);
 }
 
-// целое -> строка; пишет прямо в buf, возвращает длину
-static int ll_to_buf(long long v, char* buf) {
-    char tmp[32];
-    int neg = v < 0;
-    unsigned long long x = neg ? (unsigned long long)(-(v+1)) + 1ULL : (unsigned long long)v;
-    int n = 0;
-    do {
-        tmp[n++] = (char)('0' + (x % 10ULL));
-        x /= 10ULL;
-    } while (x);
-    int k = 0;
-    if (neg) buf[k++] = '-';
-    for (int i = n - 1; i >= 0; --i) buf[k++] = tmp[i];
-    return k;
+// ======= вывод через tee/splice: child --tee =======
+// Ответы копятся в буфере и пачкой пишутся в свой канал; tee() дублирует
+// пачку в stdout (канал к родителю), а splice() переносит её в файл. Из
+// памяти процесса ответ копируется один раз, а не дважды. Пачка уходит,
+// когда во входном буфере не осталось целой строки (родитель может ждать
+// ответ) или буфер полон.
+// splice не пишет в файл с O_APPEND, поэтому флаг снимается, а позиция
+// ставится в конец файла: писатель у файла всё равно один.
+#define TEE_BUF (1 << 16)
+
+static void tee_flush(const int p[2], int fd, const char* buf, size_t n) {
+    if (!n) return;
+    if (write_all(p[1], buf, n) < 0) die("child: write(pipe) failed");
+    while (n) {
+        ssize_t t = tee(p[0], 1, n, 0);
+        if (t < 0 && errno == EINTR) continue;
+        if (t <= 0) die("child: tee failed");
+        // продублированное — в файл; splice заодно убирает его из канала,
+        // и следующий tee начнёт с ещё не отданного
+        for (size_t left = (size_t)t; left;) {
+            ssize_t sp = splice(p[0], NULL, fd, NULL, left, SPLICE_F_MOVE);
+            if (sp < 0 && errno == EINTR) continue;
+            if (sp <= 0) die("child: splice(file) failed");
+            left -= (size_t)sp;
+        }
+        n -= (size_t)t;
+    }
 }
 
-int main(int argc, char** argv) {
-    if (argc < 2) die("дочь: требуется аргумент имени файла");
-    const char* fileName = argv[1];
+// Возвращает -1, если stdout не канал или канал не завести (тогда main
+// работает как раньше).
+static int run_tee(struct line_reader* in, int fd) {
+    struct stat st;
+    if (fstat(1, &st) < 0 || !S_ISFIFO(st.st_mode)) return -1;
+    int p[2];
+    if (pipe2(p, O_CLOEXEC) < 0) return -1;
+    // Пачка пишется в свой же канал до tee, поэтому обязана целиком в него
+    // помещаться, иначе write_all встанет навсегда. F_SETPIPE_SZ может не
+    // дать TEE_BUF (pipe-max-size, pipe-user-pages-soft) — пачку режем по
+    // тому, что дали, а если не влезает и один ответ, работаем как раньше.
+    fcntl(p[1], F_SETPIPE_SZ, TEE_BUF);
+    int cap = fcntl(p[1], F_GETPIPE_SZ);
+    int fl = fcntl(fd, F_GETFL);
+    if (cap < REPLY_MAX || fl < 0 || fcntl(fd, F_SETFL, fl & ~O_APPEND) < 0 ||
+        lseek(fd, 0, SEEK_END) < 0) {
+        if (fl >= 0) fcntl(fd, F_SETFL, fl);
+        close(p[0]);
+        close(p[1]);
+        return -1;
+    }
 
-    int fd = open(fileName, O_WRONLY | O_CREAT | O_APPEND, 0644);
-    if (fd < 0) die("child: open(file) failed");
+    static char out[TEE_BUF];
+    size_t limit = (size_t)cap < sizeof(out) ? (size_t)cap : sizeof(out);
+    size_t out_len = 0;
+    for (;;) {
+        const char* line;
+        size_t n = lr_take(in, LR_BUF_SIZE, &line);
+        int stop = n ? line[0] == '\n' || line[0] == '\0' : in->eof; // пустая строка или EOF
+        if (n && !stop) {
+            out_len += process_line(line, n, out + out_len);
+            if (out_len + REPLY_MAX <= limit) continue;
+        }
+        tee_flush(p, fd, out, out_len);
+        out_len = 0;
+        if (stop) break;
+        if (!n && lr_fill(in) < 0) die("дочь: не удалось прочитать строку");
+    }
+
+    close(p[0]);
+    close(p[1]);
+    return 0;
+}
 
-    char line[2048];
+// ======= движок на io_uring: child --uring [--batch N] [--flush-us U] =======
+// Вместо read и двух write на каждую строку чтение stdin, ответы в stdout
+// и дозапись в файл идут через одно кольцо io_uring (сырые syscalls, без
+// liburing). Ответы копятся в буфере и уходят парой WRITE, когда набралось
+// batch ответов, буфер заполнен или вход опустел: при flush-us = 0 — сразу,
+// иначе не позже чем через flush-us микросекунд. Держать ответ дольше нельзя:
+// построчный родитель ждёт его, прежде чем прислать следующую строку.
+// Буферов вывода два: пока один пишется, в другой копятся новые ответы.
+// Если io_uring недоступен (старое ядро, seccomp), main работает как раньше.
+#define URING_ENTRIES 8
+#define URING_OUT_SIZE (1 << 16)
 
+enum { UD_READ = 1, UD_TIMEOUT, UD_WRITE_OUT, UD_WRITE_FILE }; // user_data заявок
+
+struct uring {
+    int fd;
+    unsigned sq_entries;
+    unsigned* sq_head;
+    unsigned* sq_tail;
+    unsigned* sq_mask;
+    unsigned* sq_array;
+    unsigned* cq_head;
+    unsigned* cq_tail;
+    unsigned* cq_mask;
+    struct io_uring_sqe* sqes;
+    struct io_uring_cqe* cqes;
+    unsigned to_submit;     // заявки в SQ, ещё не отданные ядру
+    void* ring;
+    size_t ring_size;
+};
+
+// 0 — кольцо готово, -1 — io_uring недоступен
+static int uring_init(struct uring* u) {
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    int fd = (int)syscall(__NR_io_uring_setup, URING_ENTRIES, &p);
+    if (fd < 0) return -1;
+    // IORING_OP_READ/WRITE есть с 5.6; FAST_POLL (5.7) — признак, что они на месте
+    if (!(p.features & IORING_FEAT_SINGLE_MMAP) || !(p.features & IORING_FEAT_FAST_POLL)) {
+        close(fd);
+        return -1;
+    }
+
+    size_t sq_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    size_t cq_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    u->ring_size = sq_size > cq_size ? sq_size : cq_size;
+    u->ring = mmap(NULL, u->ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                   fd, IORING_OFF_SQ_RING);
+    if (u->ring == MAP_FAILED) { close(fd); return -1; }
+    u->sqes = mmap(NULL, p.sq_entries * sizeof(struct io_uring_sqe), PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+    if (u->sqes == MAP_FAILED) { munmap(u->ring, u->ring_size); close(fd); return -1; }
+
+    char* r = (char*)u->ring;
+    u->fd = fd;
+    u->sq_entries = p.sq_entries;
+    u->sq_head = (unsigned*)(r + p.sq_off.head);
+    u->sq_tail = (unsigned*)(r + p.sq_off.tail);
+    u->sq_mask = (unsigned*)(r + p.sq_off.ring_mask);
+    u->sq_array = (unsigned*)(r + p.sq_off.array);
+    u->cq_head = (unsigned*)(r + p.cq_off.head);
+    u->cq_tail = (unsigned*)(r + p.cq_off.tail);
+    u->cq_mask = (unsigned*)(r + p.cq_off.ring_mask);
+    u->cqes = (struct io_uring_cqe*)(r + p.cq_off.cqes);
+    u->to_submit = 0;
+    return 0;
+}
+
+static void uring_close(struct uring* u) {
+    munmap(u->sqes, u->sq_entries * sizeof(struct io_uring_sqe));
+    munmap(u->ring, u->ring_size);
+    close(u->fd);
+}
+
+// положить заявку в SQ; ядро увидит её при следующем io_uring_enter
+static void uring_prep(struct uring* u, int op, int fd, const void* addr, unsigned len,
+                       unsigned long long ud) {
+    unsigned tail = *u->sq_tail;
+    if (tail - __atomic_load_n(u->sq_head, __ATOMIC_ACQUIRE) >= u->sq_entries)
+        die("child: io_uring SQ overflow");
+    unsigned idx = tail & *u->sq_mask;
+    struct io_uring_sqe* sqe = &u->sqes[idx];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = (unsigned char)op;
+    sqe->fd = fd;
+    sqe->addr = (unsigned long long)(uintptr_t)addr;
+    sqe->len = len;
+    // READ/WRITE: -1 — текущая позиция (pipe, O_APPEND); TIMEOUT: 0 — только по времени
+    sqe->off = op == IORING_OP_TIMEOUT ? 0 : (unsigned long long)-1;
+    sqe->user_data = ud;
+    u->sq_array[idx] = idx;
+    __atomic_store_n(u->sq_tail, tail + 1, __ATOMIC_RELEASE);
+    u->to_submit++;
+}
+
+// отдать ядру накопленные заявки и забрать одно завершение (ждать, если нет)
+static void uring_wait(struct uring* u, struct io_uring_cqe* out) {
     for (;;) {
-        ssize_t n = read_line(0, line, sizeof(line));
-        if (n < 0) die("дочь: не удалось прочитать строку");
-        if (n == 0) break;                 // EOF
-        if (line[0] == '\n' || line[0] == '\0') break; // пустая строка — конец
+        unsigned head = *u->cq_head;
+        int ready = head != __atomic_load_n(u->cq_tail, __ATOMIC_ACQUIRE);
+        if (ready && !u->to_submit) {
+            *out = u->cqes[head & *u->cq_mask];
+            __atomic_store_n(u->cq_head, head + 1, __ATOMIC_RELEASE);
+            return;
+        }
+        int r = (int)syscall(__NR_io_uring_enter, u->fd, u->to_submit, ready ? 0 : 1,
+                             ready ? 0 : IORING_ENTER_GETEVENTS, NULL, 0);
+        if (r < 0) {
+            if (errno == EINTR) continue;
+            die("child: io_uring_enter failed");
+        }
+        u->to_submit -= (unsigned)r;
+    }
+}
+
+// Построчный режим через io_uring. in может уже держать прочитанные данные,
+// дальше их в буфер кладёт READ из кольца. Возвращает -1, если io_uring
+// недоступен (тогда in не тронут и main идёт обычным путём).
+static int run_uring(struct line_reader* in, int fd, size_t batch, size_t flush_us) {
+    struct uring u;
+    if (uring_init(&u) < 0) return -1;
+
+    static char out[2][URING_OUT_SIZE];
 
-        size_t i = 0;
-        int found_any = 0;
-        long long sum = 0;
-        long long val;
-
-        while (1) {
-            int st = parse_ll(line, &i, &val);
-            if (st == 1) {
-                found_any = 1;
-                sum += val;
-            } else if (st == -1) {
-                const char* msg = "ERR: invalid number format\n";
-                write_all(1, msg, strlen(msg));
-                write_all(fd, msg, strlen(msg));
-                found_any = 0; // сбросим, чтобы не писать результат
+    struct __kernel_timespec ts;
+    ts.tv_sec = (long long)(flush_us / 1000000);
+    ts.tv_nsec = (long long)(flush_us % 1000000) * 1000;
+
+    int cur = 0;            // буфер, куда копятся ответы
+    size_t out_len = 0, pending = 0;
+    int reading = 0, timer = 0, expired = 0, stop = 0;
+    int busy = 0;           // WRITE в полёте (0..2), пишут буфер cur ^ 1
+    size_t wr_len = 0, wr_done[2] = { 0, 0 };
+
+    for (;;) {
+        // разобрать всё, что уже прочитано
+        while (!stop && pending < batch && out_len + REPLY_MAX <= URING_OUT_SIZE) {
+            const char* line;
+            size_t n = lr_take(in, LR_BUF_SIZE, &line);
+            if (!n) {
+                if (in->eof) stop = 1;          // EOF
                 break;
-            } else {
-                break; // st == 0 → конец строки
             }
+            if (line[0] == '\n' || line[0] == '\0') { stop = 1; break; } // пустая строка — конец
+            out_len += process_line(line, n, out[cur] + out_len);
+            pending++;
         }
 
+        // отправить накопленное: прошлая пара WRITE должна завершиться,
+        // иначе ядро может переставить записи местами
+        int full = pending >= batch || out_len + REPLY_MAX > URING_OUT_SIZE;
+        if (pending && !busy && (full || stop || expired || flush_us == 0)) {
+            uring_prep(&u, IORING_OP_WRITE, 1, out[cur], (unsigned)out_len, UD_WRITE_OUT);
+            uring_prep(&u, IORING_OP_WRITE, fd, out[cur], (unsigned)out_len, UD_WRITE_FILE);
+            busy = 2;
+            wr_len = out_len;
+            wr_done[0] = wr_done[1] = 0;
+            cur ^= 1;
+            out_len = 0;
+            pending = 0;
+            expired = 0;
+            continue;       // в свободный буфер можно разбирать дальше
+        }
+        if (stop && !pending && !busy) break;
 
-        if (!found_any) {
-            const char* msg = "Бро, ошибка, тут числа нет либо что-то чужеродное\n";
-            write_all(1, msg, strlen(msg));
-            write_all(fd, msg, strlen(msg));
-            continue;
+        if (!stop && !reading && !in->eof && in->len - in->pos < LR_BUF_SIZE) {
+            lr_compact(in);
+            uring_prep(&u, IORING_OP_READ, 0, in->buf + in->len,
+                       (unsigned)(LR_BUF_SIZE - in->len), UD_READ);
+            reading = 1;
+        }
+        if (pending && flush_us && !timer) {
+            uring_prep(&u, IORING_OP_TIMEOUT, -1, &ts, 1, UD_TIMEOUT);
+            timer = 1;
         }
 
-        char out[128];
-        int k = 0;
-        memcpy(out + k, "sum=", 4);  k += 4;
-        k += ll_to_buf(sum, out + k);
-        out[k++] = '\n';
+        struct io_uring_cqe cqe;
+        uring_wait(&u, &cqe);
+        switch (cqe.user_data) {
+        case UD_READ:
+            reading = 0;
+            if (cqe.res < 0 && cqe.res != -EINTR && cqe.res != -EAGAIN)
+                die("дочь: не удалось прочитать строку");
+            if (cqe.res == 0) in->eof = 1;
+            if (cqe.res > 0) in->len += (size_t)cqe.res;
+            break;
+        case UD_TIMEOUT:
+            timer = 0;
+            expired = pending > 0;
+            break;
+        case UD_WRITE_OUT:
+        case UD_WRITE_FILE: {
+            int k = cqe.user_data == UD_WRITE_FILE;
+            if (cqe.res < 0 && cqe.res != -EINTR && cqe.res != -EAGAIN)
+                die("child: write failed");
+            if (cqe.res > 0) wr_done[k] += (size_t)cqe.res;
+            if (wr_done[k] < wr_len) // недописали — дописать хвост
+                uring_prep(&u, IORING_OP_WRITE, k ? fd : 1, out[cur ^ 1] + wr_done[k],
+                           (unsigned)(wr_len - wr_done[k]), cqe.user_data);
+            else
+                busy--;
+            break;
+        }
+        }
+    }
+
+    uring_close(&u);
+    return 0;
+}
+
+// закрыть файл результатов; с --cache — счётчики кэша в stderr
+static void finish(int fd, struct reslog* log) {
+    if (cache.b) {
+        char buf[160];
+        write_all(2, buf, rc_stats(&cache, buf));
+    }
+    if (log) rl_close(log);
+    else close(fd);
+}
+
+int main(int argc, char** argv) {
+    // child [--input <file>] [-t N] [--uring [--batch N] [--flush-us U]] [--tee] [--binlog]
+    //       [--cache N] [--aggs] [--proto] <fileName>
+    // --aggs, --proto: родитель начнёт с PROTO_AGGS (parent -a) и PROTO_HELLO
+    // (parent -b); без ключей такие строки — обычные данные
+    const char* inputName = NULL;
+    const char* fileName = NULL;
+    int uring = 0, tee_out = 0, binlog = 0, hello = 0, want_aggs = 0;
+    size_t batch = 256, flush_us = 0, cache_size = 0;
+    long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+    size_t nthreads = ncpu > 0 ? (size_t)ncpu : 1;
+    for (int a = 1; a < argc; ++a) {
+        if (strcmp(argv[a], "--input") == 0 && a + 1 < argc) {
+            inputName = argv[++a];
+        } else if (strcmp(argv[a], "-t") == 0 && a + 1 < argc) {
+            nthreads = parse_count(argv[++a], 1024);
+            if (nthreads == 0) die("дочь: -t ожидает число от 1 до 1024");
+        } else if (strcmp(argv[a], "--uring") == 0) {
+            uring = 1;
+        } else if (strcmp(argv[a], "--tee") == 0) {
+            tee_out = 1;
+        } else if (strcmp(argv[a], "--binlog") == 0) {
+            binlog = 1;
+        } else if (strcmp(argv[a], "--proto") == 0) {
+            hello = 1;
+        } else if (strcmp(argv[a], "--aggs") == 0) {
+            want_aggs = 1;
+        } else if (strcmp(argv[a], "--batch") == 0 && a + 1 < argc) {
+            batch = parse_count(argv[++a], 4096);
+            if (batch == 0) die("дочь: --batch ожидает число от 1 до 4096");
+        } else if (strcmp(argv[a], "--cache") == 0 && a + 1 < argc) {
+            cache_size = parse_count(argv[++a], RC_MAX);
+            if (cache_size == 0) die("дочь: --cache ожидает число от 1 до 1048576");
+        } else if (strcmp(argv[a], "--flush-us") == 0 && a + 1 < argc) {
+            const char* v = argv[++a];
+            flush_us = strcmp(v, "0") == 0 ? 0 : parse_count(v, 1000000);
+            if (flush_us == 0 && strcmp(v, "0") != 0) die("дочь: --flush-us ожидает число от 0 до 1000000");
+        } else if (!fileName) {
+            fileName = argv[a];
+        } else {
+            die("usage: child [--input <file>] [-t N] [--uring [--batch N] [--flush-us U]] [--tee] [--binlog]\n"
+                "             [--cache N] [--aggs] [--proto] <fileName>");
+        }
+    }
+    if (!fileName) die("дочь: требуется аргумент имени файла");
+    // --uring и --tee отдают в файл тот же текст, что и родителю
+    if (binlog && (uring || tee_out)) die("дочь: --binlog не сочетается с --uring и --tee");
+    // кэш — на один поток; пакетный режим разбирает куски параллельно
+    if (cache_size && inputName) die("дочь: --cache не сочетается с --input");
+    if (cache_size && !rc_init(&cache, cache_size)) die("дочь: mmap(cache) failed");
+    parse_init();
+
+    // с --binlog файл — двоичный журнал (reslog.h), иначе текст
+    static struct reslog logw;
+    struct reslog* log = NULL;
+    int fd = -1;
+    if (binlog) {
+        rl_open(&logw, fileName);
+        log = &logw;
+    } else {
+        fd = open(fileName, O_WRONLY | O_CREAT | O_APPEND, 0644);
+        if (fd < 0) die("child: open(file) failed");
+    }
+
+    if (inputName) {
+        run_batch(inputName, fd, log, nthreads);
+        finish(fd, log);
+        return 0;
+    }
+
+    static struct line_reader in;
+    lr_init(&in, 0);
+
+    // с --aggs первой строкой родитель задаёт набор агрегатов (agg.h)
+    const char* first;
+    ssize_t fn = lr_next(&in, LR_BUF_SIZE, &first);
+    if (fn < 0) die("дочь: не удалось прочитать строку");
+    size_t ap = sizeof(PROTO_AGGS) - 1;
+    if (want_aggs && (size_t)fn > ap && memcmp(first, PROTO_AGGS, ap) == 0) {
+        if (agg_parse(first + ap, (size_t)fn - ap, &aggs))
+            write_all(1, PROTO_AGGS_OK, sizeof(PROTO_AGGS_OK) - 1);
+        else
+            write_all(1, PROTO_AGGS_BAD, sizeof(PROTO_AGGS_BAD) - 1);
+        fn = lr_next(&in, LR_BUF_SIZE, &first);
+        if (fn < 0) die("дочь: не удалось прочитать строку");
+    }
+
+    // затем — предложить двоичный протокол (proto.h), если родитель об этом
+    // предупредил (--proto); движок io_uring работает только с текстом —
+    // тогда отказываемся
+    if (hello && (size_t)fn == sizeof(PROTO_HELLO) - 1 && memcmp(first, PROTO_HELLO, (size_t)fn) == 0) {
+        if (!uring) {
+            write_all(1, PROTO_HELLO_OK, sizeof(PROTO_HELLO_OK) - 1);
+            run_binary(&in, fd, log);
+            finish(fd, log);
+            return 0;
+        }
+        write_all(1, PROTO_DECLINE, sizeof(PROTO_DECLINE) - 1);
+    } else {
+        in.pos -= (size_t)fn; // обычная строка — вернуть её в буфер
+    }
 
-        write_all(1, out, (size_t)k);   // в parent
-        write_all(fd, out, (size_t)k);  // в файл
+    if (uring && run_uring(&in, fd, batch, flush_us) == 0) {
+        finish(fd, NULL);
+        return 0;
+    }
+    if (tee_out && !uring && run_tee(&in, fd) == 0) {
+        finish(fd, NULL);
+        return 0;
     }
 
+    for (;;) {
+        const char* line;
+        ssize_t n = lr_next(&in, LR_BUF_SIZE, &line);
+        if (n < 0) die("дочь: не удалось прочитать строку");
+        if (n == 0) break;                 // EOF
+        if (line[0] == '\n' || line[0] == '\0') break; // пустая строка — конец
+
+        char out[REPLY_MAX];
+        struct agg_res r;
+        int st = eval_cached(line, (size_t)n, &r);
+        size_t k = format_result(st, &r, out);
+        write_all(1, out, k);   // в parent
+        if (log) rl_add(log, rs_status(st), r.sum); // в файл
+        else write_all(fd, out, k);
+    }
 
-    close(fd);
+    finish(fd, log);
     return 0;
 }
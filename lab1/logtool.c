@@ -0,0 +1,254 @@
+// Чтение двоичного журнала результатов (reslog.h).
+//   logtool info  <log>
+//   logtool total <log> [--seq A B | --time T1 T2]
+//   logtool text  <log> [--seq A B | --time T1 T2]
+// Диапазоны включают оба конца; время — наносекунды CLOCK_REALTIME, как
+// в записях (их показывает info). text печатает ответы в том же виде, что
+// и текстовый файл ребёнка.
+// Журнал отображается через mmap целиком; total по полным блокам берёт
+// сводки индекса и читает записи только в двух крайних блоках, поэтому
+// время почти не зависит от размера журнала.
+#define _GNU_SOURCE
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "proto.h"
+#include "reslog.h"
+#include "agg.h"
+#include "../ipc/ipc.h"
+
+// целое (128 бит) -> строка; пишет прямо в buf, возвращает длину
+static int i128_to_buf(__int128 v, char* buf) {
+    char tmp[48]; int n = 0;
+    unsigned __int128 u = v < 0 ? -(unsigned __int128)v : (unsigned __int128)v;
+    do { tmp[n++] = (char)('0' + (int)(u % 10)); u /= 10; } while (u);
+    int k = 0;
+    if (v < 0) buf[k++] = '-';
+    while (n) buf[k++] = tmp[--n];
+    return k;
+}
+
+// целое со знаком из аргумента командной строки; 0 — ошибка
+static int parse_i64(const char* s, int64_t* out) {
+    int neg = *s == '-';
+    if (neg) ++s;
+    if (!*s) return 0;
+    uint64_t v = 0;
+    for (; *s; ++s) {
+        if (*s < '0' || *s > '9') return 0;
+        if (v > (UINT64_MAX - 9) / 10) return 0;
+        v = v * 10 + (uint64_t)(*s - '0');
+    }
+    if (v > (uint64_t)INT64_MAX) return 0;
+    *out = neg ? -(int64_t)v : (int64_t)v;
+    return 1;
+}
+
+// ---- вывод через буфер ----
+static char obuf[1 << 16];
+static size_t olen;
+
+static void out_flush(void) {
+    if (write_all(1, obuf, olen) < 0) die("logtool: write failed");
+    olen = 0;
+}
+
+static void out_put(const char* s, size_t n) {
+    if (olen + n > sizeof(obuf)) out_flush();
+    memcpy(obuf + olen, s, n);
+    olen += n;
+}
+
+static void out_str(const char* s) { out_put(s, strlen(s)); }
+
+static void out_num(__int128 v) {
+    char b[48];
+    out_put(b, (size_t)i128_to_buf(v, b));
+}
+
+// ---- журнал ----
+struct log {
+    const char* map;
+    size_t size;
+    const struct rl_record* rec;
+    uint64_t nrec;
+    const struct rl_index* idx;   // NULL — индекса нет (журнал не закрыт)
+    uint64_t nblocks;
+};
+
+static void log_open(struct log* L, const char* name) {
+    int fd = open(name, O_RDONLY);
+    if (fd < 0) die("logtool: open failed");
+    struct stat st;
+    if (fstat(fd, &st) < 0) die("logtool: fstat failed");
+    L->size = (size_t)st.st_size;
+    if (L->size < RL_HDR_SIZE) die("logtool: файл не является журналом результатов");
+    L->map = mmap(NULL, L->size, PROT_READ, MAP_SHARED, fd, 0);
+    if (L->map == MAP_FAILED) die("logtool: mmap failed");
+    close(fd);
+
+    const struct rl_header* h = (const struct rl_header*)L->map;
+    if (memcmp(h->magic, RL_MAGIC, sizeof(h->magic)) != 0 || h->version != RL_VERSION
+        || h->rec_size != RL_REC_SIZE || h->block != RL_BLOCK)
+        die("logtool: файл не является журналом результатов");
+
+    L->rec = (const struct rl_record*)(L->map + RL_HDR_SIZE);
+    L->idx = NULL;
+    L->nblocks = 0;
+    uint64_t body = L->size - RL_HDR_SIZE;
+    const struct rl_trailer* t = (const struct rl_trailer*)(L->map + L->size - sizeof(*t));
+    if (body >= sizeof(*t) && memcmp(t->magic, RL_IDX_MAGIC, sizeof(t->magic)) == 0
+        && t->nblocks == (t->nrec + RL_BLOCK - 1) / RL_BLOCK
+        && t->nrec <= body / RL_REC_SIZE
+        && t->nrec * RL_REC_SIZE + t->nblocks * sizeof(struct rl_index) + sizeof(*t) == body) {
+        L->nrec = t->nrec;
+        L->nblocks = t->nblocks;
+        L->idx = (const struct rl_index*)(L->map + RL_HDR_SIZE + t->nrec * RL_REC_SIZE);
+        return;
+    }
+    // без хвоста: берём записи, пока номер совпадает с позицией
+    // (в конце может оказаться недописанная пачка)
+    L->nrec = body / RL_REC_SIZE;
+    while (L->nrec && L->rec[L->nrec - 1].seq != L->nrec) L->nrec--;
+}
+
+// первая запись из [lo, hi) со временем >= ts (strict: > ts)
+static uint64_t lower_ts(const struct log* L, uint64_t lo, uint64_t hi, int64_t ts, int strict) {
+    while (lo < hi) {
+        uint64_t mid = lo + (hi - lo) / 2;
+        int64_t v = L->rec[mid].ts_ns;
+        if (strict ? v <= ts : v < ts) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+// то же, но сначала по сводкам индекса выбирается нужный блок —
+// двоичный поиск касается меньшего числа страниц
+static uint64_t find_ts(const struct log* L, int64_t ts, int strict) {
+    if (!L->idx) return lower_ts(L, 0, L->nrec, ts, strict);
+    uint64_t lo = 0, hi = L->nblocks;
+    while (lo < hi) {
+        uint64_t mid = lo + (hi - lo) / 2;
+        int64_t v = L->idx[mid].ts_last;
+        if (strict ? v <= ts : v < ts) lo = mid + 1;
+        else hi = mid;
+    }
+    if (lo == L->nblocks) return L->nrec;
+    uint64_t end = (lo + 1) * RL_BLOCK;
+    return lower_ts(L, lo * RL_BLOCK, end < L->nrec ? end : L->nrec, ts, strict);
+}
+
+struct totals {
+    uint64_t n_ok, n_err;
+    __int128 sum;
+};
+
+static void scan(const struct log* L, uint64_t lo, uint64_t hi, struct totals* t) {
+    for (uint64_t i = lo; i < hi; ++i) {
+        if (L->rec[i].status == RS_OK) { t->n_ok++; t->sum += L->rec[i].sum; }
+        else t->n_err++;
+    }
+}
+
+// итоги по записям [lo, hi): полные блоки — из индекса, края — по записям
+static void total(const struct log* L, uint64_t lo, uint64_t hi, struct totals* t) {
+    memset(t, 0, sizeof(*t));
+    if (!L->idx) {
+        madvise((void*)((uintptr_t)(L->rec + lo) & ~(uintptr_t)4095),
+                (hi - lo) * RL_REC_SIZE + 4096, MADV_SEQUENTIAL);
+        scan(L, lo, hi, t);
+        return;
+    }
+    uint64_t b0 = (lo + RL_BLOCK - 1) / RL_BLOCK, b1 = hi / RL_BLOCK;
+    if (b0 >= b1) { scan(L, lo, hi, t); return; }
+    scan(L, lo, b0 * RL_BLOCK, t);
+    for (uint64_t b = b0; b < b1; ++b) {
+        const struct rl_index* x = &L->idx[b];
+        t->n_ok += x->n_ok;
+        t->n_err += x->n_err;
+        t->sum += ((__int128)x->sum_hi << 64) + x->sum_lo;
+    }
+    scan(L, b1 * RL_BLOCK, hi, t);
+}
+
+static void text(const struct log* L, uint64_t lo, uint64_t hi) {
+    struct agg_spec a;
+    agg_default(&a); // в журнале только сумма
+    for (uint64_t i = lo; i < hi; ++i) {
+        const struct rl_record* r = &L->rec[i];
+        struct agg_res res;
+        char buf[REPLY_MAX];
+        res.sum = r->sum;
+        out_put(buf, format_reply(&a, r->status, &res, buf));
+    }
+}
+
+static void usage(void) {
+    die("usage: logtool info <log>\n"
+        "       logtool total <log> [--seq A B | --time T1 T2]\n"
+        "       logtool text  <log> [--seq A B | --time T1 T2]");
+}
+
+int main(int argc, char** argv) {
+    if (argc < 3) usage();
+    const char* cmd = argv[1];
+    static struct log L;
+    log_open(&L, argv[2]);
+
+    // диапазон записей [lo, hi)
+    uint64_t lo = 0, hi = L.nrec;
+    if (argc == 6) {
+        int64_t a, b;
+        if (!parse_i64(argv[4], &a) || !parse_i64(argv[5], &b)) usage();
+        if (strcmp(argv[3], "--seq") == 0) {
+            // номер s лежит на позиции s - 1
+            lo = a < 1 ? 0 : (uint64_t)a - 1;
+            hi = b < 0 ? 0 : (uint64_t)b;
+            if (lo > L.nrec) lo = L.nrec;
+            if (hi > L.nrec) hi = L.nrec;
+        } else if (strcmp(argv[3], "--time") == 0) {
+            lo = find_ts(&L, a, 0);
+            hi = find_ts(&L, b, 1);
+        } else {
+            usage();
+        }
+        if (hi < lo) hi = lo;
+    } else if (argc != 3) {
+        usage();
+    }
+
+    if (strcmp(cmd, "info") == 0 && argc == 3) {
+        out_str("records=");  out_num(L.nrec);
+        out_str("\nindex=");
+        if (L.idx) { out_str("yes blocks="); out_num(L.nblocks); }
+        else out_str("no (журнал не закрыт)");
+        if (L.nrec) {
+            out_str("\nfirst_ts="); out_num(L.rec[0].ts_ns);
+            out_str("\nlast_ts=");  out_num(L.rec[L.nrec - 1].ts_ns);
+        }
+        out_str("\n");
+    } else if (strcmp(cmd, "total") == 0) {
+        struct totals t;
+        total(&L, lo, hi, &t);
+        out_str("records="); out_num(hi - lo);
+        out_str(" ok=");     out_num(t.n_ok);
+        out_str(" err=");    out_num(t.n_err);
+        out_str(" sum=");    out_num(t.sum);
+        out_str("\n");
+    } else if (strcmp(cmd, "text") == 0) {
+        madvise((void*)((uintptr_t)(L.rec + lo) & ~(uintptr_t)4095),
+                (hi - lo) * RL_REC_SIZE + 4096, MADV_SEQUENTIAL);
+        text(&L, lo, hi);
+    } else {
+        usage();
+    }
+    out_flush();
+    munmap((void*)L.map, L.size);
+    return 0;
+}
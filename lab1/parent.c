@@ -3,152 +3,633 @@
 #include <fcntl.h>
 #include <sys/types.h>
 #include <sys/wait.h>
+#include <spawn.h>
+#include <sys/mman.h>
+#include <poll.h>
+#include <signal.h>
 #include <errno.h>
 #include <string.h>
 #include <stdlib.h>
 
-static void die(const char* msg) {
-    ssize_t _ __attribute__((unused)) = write(2, msg, strlen(msg));
-    ssize_t __ __attribute__((unused)) = write(2, "\n", 1);
-    _exit(1);
+#include "proto.h"
+#include "agg.h"
+#include "../ipc/ipc.h"
+
+// набор агрегатов (-a), согласованный с детьми
+static struct agg_spec aggs = { AGG_SUM, 0, 0, 0, 0 };
+
+static void set_nonblock(int fd) {
+    int fl = fcntl(fd, F_GETFL);
+    if (fl < 0 || fcntl(fd, F_SETFL, fl | O_NONBLOCK) < 0) die("fcntl(O_NONBLOCK) failed");
+}
+
+static void* map_anon(size_t n) {
+    void* p = mmap(NULL, n, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED) die("mmap failed");
+    return p;
+}
+
+#define MAX_WORKERS 64
+
+// один дочерний процесс ./child со своей парой каналов
+struct worker {
+    pid_t pid;
+    int to_child;               // p1[1]; -1 после закрытия
+    size_t send_pos, send_len;  // неотправленная часть sendbuf
+    size_t inflight;            // строк отдано ребёнку без ответа
+    int bin;                    // ребёнок согласился на двоичный протокол
+    struct line_reader rep;     // ответы ребёнка (p2[0])
+    char sendbuf[2 * LR_BUF_SIZE + sizeof(struct frame_hdr) + 1];
+};
+
+// Поставить строку в sendbuf: как есть или кадром FR_TEXT. Строка без '\n'
+// дополняется им, иначе ребёнок будет ждать её конца вечно.
+static void queue_line(struct worker* w, const char* line, size_t n) {
+    char* dst = w->sendbuf + w->send_len;
+    size_t hdr = 0;
+    if (w->bin) {
+        struct frame_hdr h = { FR_TEXT, (uint32_t)(n + (line[n - 1] != '\n')) };
+        memcpy(dst, &h, sizeof(h));
+        hdr = sizeof(h);
+    }
+    memcpy(dst + hdr, line, n);
+    w->send_len += hdr + n;
+    if (line[n - 1] != '\n') w->sendbuf[w->send_len++] = '\n';
+}
+
+// Взять из буфера готовый ответ ребёнка, без read(): строку как есть или
+// двоичный ответ, переведённый в текст в tmp (REPLY_MAX байт). 0 — ответа нет.
+static size_t take_reply(struct worker* w, const char** text, char* tmp) {
+    if (!w->bin) return lr_take(&w->rep, LR_BUF_SIZE, text);
+    size_t nextra = agg_nvals(&aggs);
+    if (w->rep.len - w->rep.pos < sizeof(struct frame_reply) + nextra * sizeof(int64_t)) return 0;
+    struct frame_reply r;
+    int64_t extra[AGG_VALS_MAX];
+    memcpy(&r, w->rep.buf + w->rep.pos, sizeof(r));
+    memcpy(extra, w->rep.buf + w->rep.pos + sizeof(r), nextra * sizeof(int64_t));
+    w->rep.pos += sizeof(r) + nextra * sizeof(int64_t);
+    *text = tmp;
+    return format_frame(&aggs, &r, extra, tmp); // тот же текст, что у ребёнка в текстовом режиме
+}
+
+// то же с ожиданием; 0 — ребёнок закрыл канал
+static size_t next_reply(struct worker* w, const char** text, char* tmp) {
+    for (;;) {
+        size_t n = take_reply(w, text, tmp);
+        if (n) return n;
+        if (w->rep.eof) return 0;
+        if (lr_fill(&w->rep) < 0) die("не удалось выполнить чтение из дочернего файла");
+    }
+}
+
+// передать ребёнку набор агрегатов; не понял — дальше работать нельзя
+static void negotiate_aggs(struct worker* w, const char* list) {
+    size_t n = strlen(list);
+    char msg[600];
+    if (sizeof(PROTO_AGGS) + n + 1 > sizeof(msg)) die("parent: слишком длинный список -a");
+    memcpy(msg, PROTO_AGGS, sizeof(PROTO_AGGS) - 1);
+    memcpy(msg + sizeof(PROTO_AGGS) - 1, list, n);
+    msg[sizeof(PROTO_AGGS) - 1 + n] = '\n';
+    if (write_all(w->to_child, msg, sizeof(PROTO_AGGS) + n) < 0)
+        die("не удалось выполнить запись в дочерний файл");
+    const char* line;
+    ssize_t r = lr_next(&w->rep, LR_BUF_SIZE, &line);
+    if (r < 0) die("не удалось выполнить чтение из дочернего файла");
+    if ((size_t)r != sizeof(PROTO_AGGS_OK) - 1 || memcmp(line, PROTO_AGGS_OK, (size_t)r) != 0)
+        die("parent: ребёнок не принял набор агрегатов (-a)");
+}
+
+// предложить ребёнку двоичный протокол и дождаться ответа
+static void negotiate(struct worker* w) {
+    if (write_all(w->to_child, PROTO_HELLO, sizeof(PROTO_HELLO) - 1) < 0)
+        die("не удалось выполнить запись в дочерний файл");
+    const char* line;
+    ssize_t n = lr_next(&w->rep, LR_BUF_SIZE, &line);
+    if (n < 0) die("не удалось выполнить чтение из дочернего файла");
+    w->bin = (size_t)n == sizeof(PROTO_HELLO_OK) - 1 && memcmp(line, PROTO_HELLO_OK, (size_t)n) == 0;
+}
+
+// порядок раздачи строк по детям: по нему склеиваются их сегменты файла
+struct order_log {
+    unsigned char* v;
+    size_t len, cap;
+};
+
+static void order_log_push(struct order_log* log, unsigned char k) {
+    if (log->len == log->cap) {
+        size_t ncap = log->cap ? log->cap * 2 : (size_t)1 << 20;
+        void* p = log->cap ? mremap(log->v, log->cap, ncap, MREMAP_MAYMOVE) : map_anon(ncap);
+        if (p == MAP_FAILED) die("mremap(order log) failed");
+        log->v = (unsigned char*)p;
+        log->cap = ncap;
+    }
+    log->v[log->len++] = k;
+}
+
+// имя сегмента k: <fileName>.part<k>
+static void seg_name(char* dst, const char* fileName, size_t k) {
+    size_t n = strlen(fileName);
+    memcpy(dst, fileName, n);
+    memcpy(dst + n, ".part", 5); n += 5;
+    if (k >= 10) dst[n++] = (char)('0' + k / 10);
+    dst[n++] = (char)('0' + k % 10);
+    dst[n] = '\0';
 }
 
-static ssize_t write_all(int fd, const void* buf, size_t n) {
-    const char* p = (const char*)buf;
-    size_t left = n;
-    while (left) {
-        ssize_t w = write(fd, p, left);
-        if (w < 0) {
+// запустить ./child, пишущий результаты в outName
+#define MAX_CHILD_OPTS 16
+
+// opts — ключи для ./child (хвост argv после "--", завершён NULL)
+static void spawn_child(struct worker* w, char* outName, char** opts, char** envp) {
+    int p1[2], p2[2];
+    // O_CLOEXEC: концы каналов других детей не утекут в этот execve,
+    // иначе те не увидят EOF на своём stdin
+    if (pipe2(p1, O_CLOEXEC) < 0) die("pipe1 failed");
+    if (pipe2(p2, O_CLOEXEC) < 0) die("pipe2 failed");
+
+    // argv для execve: child [opts...] fileName
+    char* args[MAX_CHILD_OPTS + 3];
+    int na = 0;
+    args[na++] = (char*)"child";
+    for (int k = 0; opts[k]; ++k) args[na++] = opts[k];
+    args[na++] = outName;
+    args[na] = NULL;
+
+    // posix_spawn вместо fork+execve: ребёнок стартует через vfork-подобный
+    // clone, без копирования таблиц страниц родителя (а у него большие
+    // буферы). Перенаправление каналов — file actions:
+    // p1: parent->child (stdin ребёнка), p2: child->parent (stdout ребёнка)
+    posix_spawn_file_actions_t fa;
+    if (posix_spawn_file_actions_init(&fa) != 0
+        || posix_spawn_file_actions_adddup2(&fa, p1[0], 0) != 0
+        || posix_spawn_file_actions_adddup2(&fa, p2[1], 1) != 0) die("posix_spawn_file_actions failed");
+    // запускаем исполняемый файл "child" из текущего каталога
+    pid_t pid;
+    int err = posix_spawn(&pid, "./child", &fa, NULL, args, envp);
+    posix_spawn_file_actions_destroy(&fa);
+    if (err != 0) die("posix_spawn ./child failed");
+
+    // parent
+    close(p1[0]); // не читаем из pipe1
+    close(p2[1]); // не пишем в pipe2
+    w->pid = pid;
+    w->to_child = p1[1];
+    w->send_pos = w->send_len = 0;
+    w->inflight = 0;
+    w->bin = 0;
+    lr_init(&w->rep, p2[0]);
+}
+
+// наименее загруженный ребёнок, у которого есть место в окне и в sendbuf
+static struct worker* least_loaded(struct worker* ws, size_t nw, size_t window) {
+    struct worker* best = NULL;
+    for (size_t k = 0; k < nw; ++k) {
+        struct worker* w = &ws[k];
+        if (w->to_child < 0 || w->inflight >= window || w->send_len > LR_BUF_SIZE) continue;
+        if (!best || w->inflight < best->inflight) best = w;
+    }
+    return best;
+}
+
+// Конвейерный режим: строки уходят детям, не дожидаясь ответа на
+// предыдущую, у каждого ребёнка в полёте не больше window строк. Строка
+// достаётся наименее загруженному ребёнку. Ввод, отправка и приём ответов
+// мультиплексируются через poll(). Каждый ребёнок отвечает по порядку,
+// а кольцо ring помнит, чей ответ печатать следующим, — так вывод идёт
+// в порядке ввода. Если log != NULL, в него пишется вся раздача строк.
+static void run_pool(struct line_reader* in, struct worker* ws, size_t nw,
+                     size_t window, struct order_log* log) {
+    size_t ring_cap = nw * window;
+    unsigned char* ring = (unsigned char*)map_anon(ring_cap);
+    size_t ring_head = 0, ring_len = 0;
+    struct pollfd* pfd = (struct pollfd*)map_anon((2 * nw + 1) * sizeof(struct pollfd));
+    int* pk = (int*)map_anon(2 * nw * sizeof(int)); // pfd[i + 1] -> ребёнок
+    static char outbuf[LR_BUF_SIZE];
+    char tmp[REPLY_MAX];
+    int in_done = 0;        // ввод закончился: EOF или пустая строка
+    size_t open_reps = nw;  // дети, ещё не закрывшие вывод
+
+    for (size_t k = 0; k < nw; ++k) {
+        set_nonblock(ws[k].to_child);
+        set_nonblock(ws[k].rep.fd);
+    }
+
+    while (open_reps) {
+        // 1) напечатать готовые ответы в порядке ввода
+        size_t out_len = 0;
+        while (ring_len) {
+            struct worker* w = &ws[ring[ring_head]];
+            const char* line;
+            size_t n = take_reply(w, &line, tmp);
+            if (!n) {
+                if (w->rep.eof) { // ребёнок умер, не ответив
+                    write_all(1, outbuf, out_len);
+                    write_all(1, "(child closed pipe)\n", 20);
+                    goto out;
+                }
+                break;
+            }
+            if (out_len + n > sizeof(outbuf)) {
+                write_all(1, outbuf, out_len);
+                out_len = 0;
+            }
+            memcpy(outbuf + out_len, line, n);
+            out_len += n;
+            w->inflight--;
+            ring_head = (ring_head + 1) % ring_cap;
+            ring_len--;
+        }
+        if (out_len) write_all(1, outbuf, out_len);
+
+        // 2) готовые строки из буфера ввода -> в sendbuf детей
+        int need_input = 0;
+        while (!in_done) {
+            struct worker* w = least_loaded(ws, nw, window);
+            if (!w) break; // все окна заполнены — ввод не читаем
+            const char* line;
+            size_t n = lr_take(in, w->bin ? FRAME_MAX - 1 : LR_BUF_SIZE, &line);
+            if (n == 0) {
+                if (in->eof) in_done = 1;
+                else need_input = 1;
+                break;
+            }
+            if (line[0] == '\n' || line[0] == '\0') { // пустая строка — завершить
+                in_done = 1;
+                break;
+            }
+            queue_line(w, line, n);
+            w->inflight++;
+            unsigned char k = (unsigned char)(w - ws);
+            ring[(ring_head + ring_len++) % ring_cap] = k;
+            if (log) order_log_push(log, k);
+        }
+
+        // 3) ввод кончился и всё отправлено — дети увидят EOF
+        if (in_done) {
+            for (size_t k = 0; k < nw; ++k) {
+                struct worker* w = &ws[k];
+                if (w->to_child >= 0 && w->send_pos == w->send_len) {
+                    close(w->to_child);
+                    w->to_child = -1;
+                }
+            }
+        }
+
+        // 4) ждать событий
+        nfds_t npfd = 0;
+        if (need_input) { pfd[npfd].fd = in->fd; pfd[npfd].events = POLLIN; npfd++; }
+        nfds_t first_child = npfd;
+        for (size_t k = 0; k < nw; ++k) {
+            struct worker* w = &ws[k];
+            if (w->send_pos < w->send_len) {
+                pk[npfd - first_child] = (int)k;
+                pfd[npfd].fd = w->to_child; pfd[npfd].events = POLLOUT; npfd++;
+            }
+            if (!w->rep.eof && w->rep.len - w->rep.pos < LR_BUF_SIZE) {
+                pk[npfd - first_child] = (int)k;
+                pfd[npfd].fd = w->rep.fd; pfd[npfd].events = POLLIN; npfd++;
+            }
+        }
+        if (npfd == 0) break;
+
+        if (poll(pfd, npfd, -1) < 0) {
             if (errno == EINTR) continue;
-            return -1;
+            die("poll failed");
         }
-        left -= (size_t)w;
-        p += w;
+
+        // 5) дочитать ввод пользователя
+        if (first_child && pfd[0].revents) {
+            if (lr_fill(in) < 0) die("read(user line) failed");
+        }
+
+        for (nfds_t i = first_child; i < npfd; ++i) {
+            if (!pfd[i].revents) continue;
+            struct worker* w = &ws[pk[i - first_child]];
+            if (pfd[i].events == POLLOUT) {
+                // 6) отправить сколько влезет в канал (backpressure — через POLLOUT)
+                ssize_t wr = write(w->to_child, w->sendbuf + w->send_pos, w->send_len - w->send_pos);
+                if (wr < 0 && errno != EAGAIN && errno != EINTR)
+                    die("не удалось выполнить запись в дочерний файл");
+                if (wr > 0) w->send_pos += (size_t)wr;
+                if (w->send_pos == w->send_len) w->send_pos = w->send_len = 0;
+                else if (w->send_pos > LR_BUF_SIZE) {
+                    memmove(w->sendbuf, w->sendbuf + w->send_pos, w->send_len - w->send_pos);
+                    w->send_len -= w->send_pos;
+                    w->send_pos = 0;
+                }
+            } else {
+                // 7) принять ответы; печатаются они на следующем круге
+                ssize_t r = lr_fill(&w->rep);
+                if (r < 0 && errno != EAGAIN) die("не удалось выполнить чтение из дочернего файла");
+                if (r == 0) open_reps--;
+            }
+        }
+    }
+
+    // дети закрыли вывод — допечатать то, что осталось в буферах
+    while (ring_len) {
+        struct worker* w = &ws[ring[ring_head]];
+        const char* line;
+        size_t n = take_reply(w, &line, tmp);
+        if (!n) {
+            write_all(1, "(child closed pipe)\n", 20);
+            break;
+        }
+        write_all(1, line, n);
+        ring_head = (ring_head + 1) % ring_cap;
+        ring_len--;
     }
-    return (ssize_t)n;
+
+out:
+    for (size_t k = 0; k < nw; ++k) {
+        if (ws[k].to_child >= 0) close(ws[k].to_child);
+        ws[k].to_child = -1;
+    }
+    munmap(ring, ring_cap);
+    munmap(pfd, (2 * nw + 1) * sizeof(struct pollfd));
+    munmap(pk, 2 * nw * sizeof(int));
 }
 
-// читает одну строку (заканчивается '\n' или EOF). Возвращает длину, 0 при EOF.
-static ssize_t read_line(int fd, char* buf, size_t cap) {
-    size_t i = 0;
-    while (i + 1 < cap) {
-        char c;
-        ssize_t r = read(fd, &c, 1);
-        if (r == 0) break;         // EOF
-        if (r < 0) {
+// Режим -z: ввод идёт ребёнку через splice() (stdin -> канал), ответы
+// ребёнка — так же в stdout; данные не проходят через память процесса.
+// Строк родитель не видит: пустую строку замечает сам ребёнок и выходит.
+// Если stdin или stdout не умеют splice (EINVAL), этот конец работает
+// через буфер in / w->rep, как обычно.
+static void run_splice(struct line_reader* in, struct worker* w) {
+    signal(SIGPIPE, SIG_IGN); // ребёнок вышел на пустой строке — увидим EPIPE
+    set_nonblock(w->to_child);
+    set_nonblock(w->rep.fd);
+    int in_open = 1, out_open = 1;
+    int in_copy = 0, out_copy = 0;  // splice не поддерживается — копировать
+    int child_full = 0;             // канал к ребёнку был полон
+
+    while (out_open) {
+        // в буфере in то, что прочитано вместе с именем файла (или копированием)
+        int pending = in->len > in->pos;
+        if (in_open && !pending && in->eof) {
+            close(w->to_child);
+            w->to_child = -1;
+            in_open = 0;
+        }
+
+        struct pollfd pfd[2];
+        nfds_t npfd = 0;
+        if (in_open) {
+            pfd[npfd].fd = pending || child_full ? w->to_child : in->fd;
+            pfd[npfd].events = pending || child_full ? POLLOUT : POLLIN;
+            npfd++;
+        }
+        pfd[npfd].fd = w->rep.fd;
+        pfd[npfd].events = POLLIN;
+        npfd++;
+        if (poll(pfd, npfd, -1) < 0) {
             if (errno == EINTR) continue;
-            return -1;
+            die("poll failed");
+        }
+
+        if (in_open && pfd[0].revents) {
+            ssize_t r;
+            if (pfd[0].events == POLLOUT && pending) {
+                r = write(w->to_child, in->buf + in->pos, in->len - in->pos);
+                if (r > 0) in->pos += (size_t)r;
+            } else if (pfd[0].events == POLLOUT) {
+                child_full = 0;
+                r = 1;
+            } else if (!in_copy) {
+                r = splice(in->fd, NULL, w->to_child, NULL, 1 << 20, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+                if (r == 0) in->eof = 1;
+                if (r < 0 && errno == EAGAIN) child_full = 1;
+                if (r < 0 && errno == EINVAL) { in_copy = 1; r = 1; }
+            } else {
+                r = lr_fill(in);
+            }
+            if (r < 0 && errno == EPIPE) { // ребёнок уже завершился
+                close(w->to_child);
+                w->to_child = -1;
+                in_open = 0;
+            } else if (r < 0 && errno != EAGAIN && errno != EINTR) {
+                die("не удалось выполнить запись в дочерний файл");
+            }
+        }
+
+        if (pfd[npfd - 1].revents) {
+            ssize_t r;
+            if (!out_copy) {
+                r = splice(w->rep.fd, NULL, 1, NULL, 1 << 20, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+                if (r < 0 && errno == EINVAL) { out_copy = 1; r = 1; }
+            } else {
+                r = lr_fill(&w->rep);
+                if (r > 0) {
+                    write_all(1, w->rep.buf + w->rep.pos, w->rep.len - w->rep.pos);
+                    w->rep.pos = w->rep.len;
+                }
+            }
+            if (r == 0) out_open = 0;
+            if (r < 0 && errno != EAGAIN && errno != EINTR)
+                die("не удалось выполнить чтение из дочернего файла");
         }
-        buf[i++] = c;
-        if (c == '\n') break;
     }
-    buf[i] = '\0';
-    return (ssize_t)i;
+
+    if (w->to_child >= 0) close(w->to_child);
+    w->to_child = -1;
 }
 
-// обрезать завершающий \n, если есть
-static void chomp(char* s) {
-    size_t n = strlen(s);
-    if (n && s[n-1] == '\n') s[n-1] = '\0';
+// склеить сегменты детей в итоговый файл в порядке ввода и удалить их
+static void merge_segments(const char* fileName, struct worker* ws, size_t nw,
+                           const struct order_log* log) {
+    int fd = open(fileName, O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if (fd < 0) die("parent: open(file) failed");
+
+    char seg[600];
+    for (size_t k = 0; k < nw; ++k) {
+        seg_name(seg, fileName, k);
+        int sfd = open(seg, O_RDONLY);
+        if (sfd < 0) die("parent: open(segment) failed");
+        lr_init(&ws[k].rep, sfd); // каналы уже закрыты — буфер свободен
+    }
+
+    static char outbuf[LR_BUF_SIZE];
+    size_t out_len = 0;
+    for (size_t i = 0; i < log->len; ++i) {
+        const char* line;
+        ssize_t n = lr_next(&ws[log->v[i]].rep, LR_BUF_SIZE, &line);
+        if (n < 0) die("parent: read(segment) failed");
+        if (n == 0) break; // ребёнок не дописал свой сегмент
+        if (out_len + (size_t)n > sizeof(outbuf)) {
+            if (write_all(fd, outbuf, out_len) < 0) die("parent: write(file) failed");
+            out_len = 0;
+        }
+        memcpy(outbuf + out_len, line, (size_t)n);
+        out_len += (size_t)n;
+    }
+    if (out_len && write_all(fd, outbuf, out_len) < 0) die("parent: write(file) failed");
+
+    for (size_t k = 0; k < nw; ++k) {
+        close(ws[k].rep.fd);
+        seg_name(seg, fileName, k);
+        unlink(seg);
+    }
+    close(fd);
 }
 
 int main(int argc, char** argv, char** envp) {
-    (void)argc; (void)argv;
+    // -w N: конвейерный режим, до N строк в полёте на ребёнка (0 — построчный обмен)
+    // -j N: N детей; каждый пишет свой сегмент, в конце они склеиваются
+    // -b: предложить детям двоичный протокол (proto.h)
+    // -a LIST: набор агрегатов на строку (agg.h), например -a sum,min,max,mean
+    // -z: ввод и ответы без копирования через splice (один ребёнок, с --tee)
+    // -- ...: всё дальше передаётся ./child (например, -- --uring --batch 64)
+    size_t window = 0, jobs = 1;
+    int binary = 0, zero_copy = 0;
+    const char* agg_list = NULL;
+    char** child_opts = argv + argc; // argv[argc] == NULL
+    for (int a = 1; a < argc; ++a) {
+        if (strcmp(argv[a], "-w") == 0 && a + 1 < argc) {
+            window = parse_count(argv[++a], 1000000);
+            if (window == 0) die("parent: -w ожидает число от 1 до 1000000");
+        } else if (strcmp(argv[a], "-j") == 0 && a + 1 < argc) {
+            jobs = parse_count(argv[++a], 1000000);
+            if (jobs == 0 || jobs > MAX_WORKERS) die("parent: -j ожидает число от 1 до 64");
+        } else if (strcmp(argv[a], "-b") == 0) {
+            binary = 1;
+        } else if (strcmp(argv[a], "-a") == 0 && a + 1 < argc) {
+            agg_list = argv[++a];
+            if (!agg_parse(agg_list, strlen(agg_list), &aggs))
+                die("parent: -a ожидает список из sum,min,max,count,mean,hist=LO:HI:N (корзин до 16)");
+        } else if (strcmp(argv[a], "-z") == 0) {
+            zero_copy = 1;
+        } else if (strcmp(argv[a], "--") == 0) {
+            // три места оставлены под --tee (режим -z), --aggs (-a) и --proto (-b)
+            if (argc - a - 1 > MAX_CHILD_OPTS - 3) die("parent: слишком много ключей для child");
+            child_opts = argv + a + 1;
+            break;
+        } else {
+            die("usage: parent [-w N] [-j N] [-b] [-a LIST] [-z] [-- child options]");
+        }
+    }
+    if (jobs > 1 && window == 0) window = 64;
+    if (zero_copy && (jobs > 1 || window || binary))
+        die("parent: -z не сочетается с -w, -j и -b");
+    // сегменты склеиваются построчно, а двоичный журнал так не склеить:
+    // номера записей, индекс и хвост у каждого сегмента свои
+    for (int k = 0; jobs > 1 && child_opts[k]; ++k)
+        if (strcmp(child_opts[k], "--binlog") == 0)
+            die("parent: -j не сочетается с -- --binlog");
+
+    // свои ключи — перед остальными: в режиме -z ребёнок выводит через tee,
+    // с -a и -b ждёт PROTO_AGGS и PROTO_HELLO первыми сообщениями (иначе
+    // это обычные строки)
+    static char* zopts[MAX_CHILD_OPTS + 1];
+    if (zero_copy || binary || agg_list) {
+        int n = 0;
+        if (zero_copy) zopts[n++] = (char*)"--tee";
+        if (agg_list) zopts[n++] = (char*)"--aggs";
+        if (binary) zopts[n++] = (char*)"--proto";
+        for (int k = 0; child_opts[k]; ++k) zopts[n++] = child_opts[k];
+        zopts[n] = NULL;
+        child_opts = zopts;
+    }
 
     const char* prompt1 = "Введите имя файла: ";
     write_all(1, prompt1, strlen(prompt1));
+    static struct line_reader in;   // stdin пользователя
+    lr_init(&in, 0);
+
     char fileName[512];
-    ssize_t fnlen = read_line(0, fileName, sizeof(fileName));
+    const char* line;
+    ssize_t fnlen = lr_next(&in, sizeof(fileName) - 1, &line);
     if (fnlen < 0) die("не удалось выполнить чтение (fileName)");
     if (fnlen == 0) die("имя файла не указано");
+    memcpy(fileName, line, (size_t)fnlen);
+    fileName[fnlen] = '\0';
     chomp(fileName);
 
-    int p1[2], p2[2];
-    if (pipe(p1) < 0) die("pipe1 failed");
-    if (pipe(p2) < 0) die("pipe2 failed");
-
-    pid_t pid = fork();
-    if (pid < 0) die("fork failed");
-
-    if (pid == 0) {
-        // child (запустит отдельную программу ./child)
-        // p1: parent->child (stdin ребёнка)  => читаем с p1[0]
-        // p2: child->parent (stdout ребёнка) => пишем в p2[1]
-        if (dup2(p1[0], 0) < 0) die("dup2 p1->stdin failed");
-        if (dup2(p2[1], 1) < 0) die("dup2 p2->stdout failed");
-
-        // закрыть лишнее
-        close(p1[0]); close(p1[1]);
-        close(p2[0]); close(p2[1]);
-
-        // argv для execve: child fileName
-        char* args[3];
-        args[0] = (char*)"child";
-        args[1] = fileName;
-        args[2] = NULL;
-
-        // запускаем исполняемый файл "child" из текущего каталога
-        execve("./child", args, envp);
-        // если вернулись — ошибка
-        die("execve ./child failed");
+    struct worker* ws = (struct worker*)map_anon(jobs * sizeof(struct worker));
+    if (jobs == 1) {
+        spawn_child(&ws[0], fileName, child_opts, envp);
+    } else {
+        char seg[600];
+        for (size_t k = 0; k < jobs; ++k) {
+            seg_name(seg, fileName, k);
+            int t = open(seg, O_WRONLY | O_CREAT | O_TRUNC, 0644); // сегмент с нуля
+            if (t < 0) die("parent: open(segment) failed");
+            close(t);
+            spawn_child(&ws[k], seg, child_opts, envp);
+        }
     }
 
-    // parent
-    close(p1[0]); // не читаем из pipe1
-    close(p2[1]); // не пишем в pipe2
+    if (agg_list)
+        for (size_t k = 0; k < jobs; ++k) negotiate_aggs(&ws[k], agg_list);
+    if (binary)
+        for (size_t k = 0; k < jobs; ++k) negotiate(&ws[k]);
 
     const char* prompt2 =
         "Введите строку, например: \"12 -3 7\" и нажмите Ентер.\n"
         "Пустая строка для завершения.\n";
     write_all(1, prompt2, strlen(prompt2));
 
-    char inbuf[2048];
-    char outbuf[2048];
+    struct order_log log = { NULL, 0, 0 };
+    if (window) run_pool(&in, ws, jobs, window, jobs > 1 ? &log : NULL);
+    if (zero_copy) run_splice(&in, &ws[0]);
 
-    for (;;) {
+    struct worker* w0 = &ws[0];
+    int to_child = w0->to_child;
+    char tmp[REPLY_MAX];
+    while (to_child >= 0) {
         write_all(1, "> ", 2);
-        ssize_t n = read_line(0, inbuf, sizeof(inbuf));
+        ssize_t n = lr_next(&in, w0->bin ? FRAME_MAX - 1 : LR_BUF_SIZE, &line);
         if (n < 0) die("read(user line) failed");
         if (n == 0) { // EOF
             // закрываем запись — ребёнок увидит EOF
-            close(p1[1]);
+            close(to_child);
+            to_child = -1;
             break;
         }
 
         // пустая строка — завершить
-        if (inbuf[0] == '\n' || inbuf[0] == '\0') {
-            close(p1[1]);
+        if (line[0] == '\n' || line[0] == '\0') {
+            close(to_child);
+            to_child = -1;
             break;
         }
 
-        // отправляем строку ребёнку
-        if (write_all(p1[1], inbuf, (size_t)n) < 0) die("не удалось выполнить запись в дочерний файл");
+        // отправляем строку ребёнку (текстом или кадром) одной записью
+        queue_line(w0, line, (size_t)n);
+        if (write_all(to_child, w0->sendbuf, w0->send_len) < 0) die("не удалось выполнить запись в дочерний файл");
+        w0->send_len = 0;
 
-        // ждём ответ одной строкой и печатаем пользователю
-        ssize_t m = read_line(p2[0], outbuf, sizeof(outbuf));
-        if (m < 0) die("не удалось выполнить чтение из дочернего файла");
+        // ждём ответ и печатаем пользователю
+        const char* reply;
+        size_t m = next_reply(w0, &reply, tmp);
         if (m == 0) {
             write_all(1, "(child closed pipe)\n", 20);
             break;
         }
-        write_all(1, outbuf, (size_t)m);
+        write_all(1, reply, m);
     }
 
-    // дочитать всё, что осталось у ребёнка (на случай буфера)
-    for (;;) {
-        ssize_t m = read(p2[0], outbuf, sizeof(outbuf));
-        if (m < 0) {
-            if (errno == EINTR) continue;
-            break;
+    if (!window) {
+        // дочитать всё, что осталось у ребёнка (на случай буфера)
+        for (;;) {
+            const char* reply;
+            size_t m = next_reply(w0, &reply, tmp);
+            if (m == 0) break;
+            write_all(1, reply, m);
         }
-        if (m == 0) break;
-        write_all(1, outbuf, (size_t)m);
+        if (to_child >= 0) close(to_child);
     }
 
-    close(p2[0]);
-    close(p1[1]);
+    int rc = 0;
+    for (size_t k = 0; k < jobs; ++k) {
+        close(ws[k].rep.fd);
+        int status = 0;
+        waitpid(ws[k].pid, &status, 0);
+        int st = WIFEXITED(status) ? WEXITSTATUS(status) : 1;
+        if (st) rc = st;
+    }
 
-    int status = 0;
-    waitpid(pid, &status, 0);
-    return WIFEXITED(status) ? WEXITSTATUS(status) : 1;
+    if (jobs > 1) merge_segments(fileName, ws, jobs, &log);
+    munmap(ws, jobs * sizeof(struct worker));
+    if (log.cap) munmap(log.v, log.cap);
+    return rc;
 }
@@ -0,0 +1,81 @@
+// Двоичный протокол parent <-> child (включается ключом parent -b).
+// Согласование: родитель запускает ребёнка с ключом --proto и первой
+// строкой шлёт PROTO_HELLO; без --proto такая строка — обычные данные.
+// Ребёнок, который умеет двоичный режим, отвечает PROTO_HELLO_OK, и дальше обе стороны
+// обмениваются кадрами; любой другой ответ — остаёмся в текстовом режиме.
+// Кадры читаются по длине из заголовка, без поиска '\n', а ответ —
+// фиксированные 16 байт: текст из него делает только тот, кто показывает
+// результат пользователю.
+#ifndef LAB1_PROTO_H
+#define LAB1_PROTO_H
+
+#include <stdint.h>
+
+#define PROTO_HELLO    "#proto bin1\n"
+#define PROTO_HELLO_OK "#proto bin1 ok\n"
+#define PROTO_DECLINE  "#proto text\n"
+
+// Набор агрегатов (agg.h): если нужен не только sum, родитель запускает
+// ребёнка с ключом --aggs и самой первой строкой шлёт PROTO_AGGS и список,
+// например "#aggs sum,max,hist=0:100:10\n"; без --aggs такая строка —
+// обычные данные. Демону (parent_shm -D) клиент шлёт PROTO_AGGS всегда,
+// сразу после PROTO_FILE (без -a — "#aggs sum\n").
+// Ответ — PROTO_AGGS_OK или PROTO_AGGS_BAD (список непонятен); ребёнок,
+// который агрегатов не знает, ответит как на обычную строку.
+#define PROTO_AGGS     "#aggs "
+#define PROTO_AGGS_OK  "#aggs ok\n"
+#define PROTO_AGGS_BAD "#aggs bad\n"
+
+// Ребёнок, запущенный заранее (parent_shm -W), ещё не знает файла
+// результатов: вместо имени файла он получает ключ PROTO_FILE_LATER, а самым
+// первым сообщением — PROTO_FILE и имя, например "#file out.txt\n". Имя,
+// которое начинается с '-', родитель передаёт как "./<имя>": с ключом его
+// не спутать.
+// Ответ — PROTO_FILE_OK; если файл не открылся — PROTO_FILE_BAD, и ребёнок
+// завершается.
+#define PROTO_FILE_LATER "--file-later"
+#define PROTO_FILE       "#file "
+#define PROTO_FILE_OK    "#file ok\n"
+#define PROTO_FILE_BAD   "#file bad\n"
+
+// Пакетный режим (parent_shm -B): ввод — обычный файл, и вместо строк
+// родитель шлёт одно сообщение PROTO_BULK — унаследованный ребёнком
+// дескриптор файла, смещение первой строки и дескриптор memfd под ответы,
+// например "#bulk 32 17 33\n". Ребёнка он запускает с ключом
+// --bulk <fd файла> <fd ответов>: только тогда и только с этими
+// дескрипторами ребёнок примет PROTO_BULK — первым сообщением после
+// PROTO_AGGS (если он есть). Ребёнок разбирает строки прямо в
+// отображении файла (до пустой строки или конца файла) и кладёт ответ на
+// строку i в memfd по смещению i * (sizeof(frame_reply) + agg_nvals * 8):
+// frame_reply и значения агрегатов, как в двоичном протоколе. Ответ на
+// сообщение — PROTO_BULK_OK и число строк ("#bulk ok 1000\n") или
+// PROTO_BULK_BAD (файл не отобразился).
+#define PROTO_BULK       "#bulk "
+#define PROTO_BULK_OK    "#bulk ok "
+#define PROTO_BULK_BAD   "#bulk bad\n"
+
+// запрос: заголовок, за ним len байт
+#define FR_TEXT 1   // строка вместе с завершающим '\n'
+#define FR_INTS 2   // уже разобранные числа: len / 8 значений int64
+#define FRAME_MAX 65536
+
+struct frame_hdr {
+    uint32_t type;
+    uint32_t len;
+};
+
+// ответ
+#define RS_OK          0
+#define RS_NO_NUMBERS  1
+#define RS_BAD_FORMAT  2
+#define RS_OVERFLOW    3
+
+// При согласованном наборе агрегатов за каждым ответом идут agg_nvals()
+// значений int64 (agg.h: agg_pack) — при ошибке нули.
+struct frame_reply {
+    int32_t status;
+    int32_t reserved;
+    int64_t value;  // сумма при RS_OK
+};
+
+#endif
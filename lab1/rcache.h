@@ -0,0 +1,143 @@
+// Кэш результатов по содержимому строки (child --cache N, child_shm ... --cache N).
+// Одни и те же строки приходят часто; вместо повторного разбора результат
+// (код разбора и агрегаты, agg.h) берётся по ключу — байтам строки без
+// завершающего '\n'.
+//
+// Раскладка плоская: таблица корзин по 64 байта (одна кэш-линия), в корзине
+// RC_WAYS 64-битных меток — хешей строк (0 — слот пуст). Строка ищется
+// только в своей корзине: одна кэш-линия меток, затем сравнение байтов
+// в найденном слоте. Вытеснение — CLOCK внутри корзины: у слота бит
+// «использовался», стрелка пропускает слоты с битом (снимая его) и
+// вытесняет первый без бита. И поиск, и вставка — O(RC_WAYS), то есть O(1).
+// Строки длиннее RC_KEY_MAX в кэш не попадают (считаются в skipped).
+#ifndef LAB1_RCACHE_H
+#define LAB1_RCACHE_H
+
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "agg.h"
+
+#define RC_WAYS     7
+#define RC_KEY_MAX  120
+#define RC_MAX      (1u << 20)   // предел --cache N (записей)
+
+struct rc_bucket {
+    uint64_t tag[RC_WAYS];
+    uint8_t  ref;       // биты «использовался», по слоту
+    uint8_t  hand;      // стрелка CLOCK
+    uint8_t  pad[6];
+};
+
+struct rc_entry {
+    int32_t st;         // код разбора (PARSE_*)
+    uint32_t len;
+    struct agg_res r;
+    char key[RC_KEY_MAX];
+};
+
+struct rcache {
+    struct rc_bucket* b;    // NULL — кэш выключен
+    struct rc_entry* e;     // слот k корзины i — e[i * RC_WAYS + k]
+    size_t mask;            // корзин — mask + 1 (степень двойки)
+    uint64_t hits, misses, evictions, skipped;
+};
+
+// 64-битный хеш байтов строки: по 8 байт за шаг, в конце — перемешивание
+// из MurmurHash3 (fmix64)
+static inline uint64_t rc_hash(const char* s, size_t n) {
+    uint64_t h = 0x9E3779B97F4A7C15ULL ^ n;
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        uint64_t w;
+        memcpy(&w, s + i, 8);
+        h = (h ^ w) * 0xff51afd7ed558ccdULL;
+        h ^= h >> 32;
+    }
+    if (i < n) {
+        uint64_t w = 0;
+        memcpy(&w, s + i, n - i);
+        h = (h ^ w) * 0xff51afd7ed558ccdULL;
+    }
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+// не меньше entries записей (округляется вверх до степени двойки корзин);
+// 0 — ошибка mmap
+static inline int rc_init(struct rcache* c, size_t entries) {
+    memset(c, 0, sizeof(*c));
+    size_t nb = 1;
+    while (nb * RC_WAYS < entries) nb *= 2;
+    void* b = mmap(NULL, nb * sizeof(struct rc_bucket), PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    void* e = mmap(NULL, nb * RC_WAYS * sizeof(struct rc_entry), PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (b == MAP_FAILED || e == MAP_FAILED) return 0;
+    c->b = (struct rc_bucket*)b;
+    c->e = (struct rc_entry*)e;
+    c->mask = nb - 1;
+    return 1;
+}
+
+// Найти строку line[0..n) (завершающий '\n' не в счёт). Есть — *hit = 1 и
+// её запись; нет — *hit = 0 и слот, уже отданный под неё: вызывающий
+// заполняет st и r. NULL — кэш выключен или строка слишком длинная.
+static inline struct rc_entry* rc_lookup(struct rcache* c, const char* line, size_t n, int* hit) {
+    if (!c->b) return NULL;
+    if (n && line[n - 1] == '\n') n--;
+    if (n > RC_KEY_MAX) {
+        c->skipped++;
+        return NULL;
+    }
+    uint64_t h = rc_hash(line, n);
+    uint64_t tag = h | 1;
+    size_t i = (size_t)h & c->mask;
+    struct rc_bucket* b = &c->b[i];
+    struct rc_entry* slots = &c->e[i * RC_WAYS];
+    int empty = -1;
+    for (int k = 0; k < RC_WAYS; ++k) {
+        if (b->tag[k] == tag && slots[k].len == n && memcmp(slots[k].key, line, n) == 0) {
+            b->ref |= (uint8_t)(1u << k);
+            c->hits++;
+            *hit = 1;
+            return &slots[k];
+        }
+        if (!b->tag[k] && empty < 0) empty = k;
+    }
+
+    c->misses++;
+    int k = empty;
+    if (k < 0) { // CLOCK: не больше RC_WAYS + 1 шагов
+        while (b->ref & (1u << b->hand)) {
+            b->ref &= (uint8_t)~(1u << b->hand);
+            b->hand = (uint8_t)((b->hand + 1) % RC_WAYS);
+        }
+        k = b->hand;
+        b->hand = (uint8_t)((b->hand + 1) % RC_WAYS);
+        c->evictions++;
+    }
+    b->tag[k] = tag;
+    b->ref &= (uint8_t)~(1u << k);
+    slots[k].len = (uint32_t)n;
+    memcpy(slots[k].key, line, n);
+    *hit = 0;
+    return &slots[k];
+}
+
+// строка счётчиков для stderr: "cache: hits=.. misses=.. evictions=.. skipped=..\n"
+static inline size_t rc_stats(const struct rcache* c, char* out) {
+    size_t k = 6;
+    memcpy(out, "cache:", 6);
+    k = agg_put(out, k, "hits=", (long long)c->hits);
+    k = agg_put(out, k, "misses=", (long long)c->misses);
+    k = agg_put(out, k, "evictions=", (long long)c->evictions);
+    k = agg_put(out, k, "skipped=", (long long)c->skipped);
+    out[k++] = '\n';
+    return k;
+}
+
+#endif
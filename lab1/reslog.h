@@ -0,0 +1,238 @@
+// Двоичный журнал результатов (child --binlog, child_shm ... --binlog).
+// Вместо текстовых строк в файл пишутся записи фиксированного размера:
+// номер, время, статус и сумма. Номера идут подряд с 1, поэтому запись
+// с номером s лежит по смещению RL_HDR_SIZE + (s - 1) * RL_REC_SIZE, а время
+// не убывает — диапазон по времени ищется двоичным поиском.
+//
+// Файл: заголовок | записи | индекс | хвост.
+// Индекс — по одной сводке на каждые RL_BLOCK записей (последний блок может
+// быть неполным): время первой и последней записи, число удачных и
+// ошибочных ответов и сумма удачных (128 бит, чтобы не переполниться).
+// Индекс и хвост дописываются при закрытии и отрезаются при следующем
+// открытии на запись. Нет хвоста — журнал ещё пишется или писатель упал:
+// читатель тогда обходится одними записями.
+// Здесь же запись журнала (rl_open ... rl_close) — общая для child и
+// child_shm; чтение — logtool.c.
+#ifndef LAB1_RESLOG_H
+#define LAB1_RESLOG_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "proto.h"
+#include "../ipc/ipc.h"
+
+#define RL_MAGIC      "RESLOG1"   // 8 байт вместе с '\0'
+#define RL_IDX_MAGIC  "RESIDX1"
+#define RL_VERSION    1
+#define RL_BLOCK      4096        // записей на одну сводку индекса
+#define RL_HDR_SIZE   64
+#define RL_REC_SIZE   32
+
+struct rl_header {
+    char     magic[8];
+    uint32_t version;
+    uint32_t rec_size;
+    uint32_t block;
+    uint32_t reserved[11];
+};
+
+// status — коды RS_* из proto.h; sum имеет смысл только при RS_OK
+struct rl_record {
+    uint64_t seq;
+    int64_t  ts_ns;     // CLOCK_REALTIME, нс
+    int32_t  status;
+    int32_t  reserved;
+    int64_t  sum;
+};
+
+struct rl_index {
+    int64_t  ts_first;
+    int64_t  ts_last;
+    uint64_t sum_lo;    // сумма удачных ответов блока, младшие 64 бита
+    int64_t  sum_hi;    // и старшие (со знаком)
+    uint32_t n_ok;
+    uint32_t n_err;
+};
+
+// последние байты файла
+struct rl_trailer {
+    char     magic[8];
+    uint64_t nrec;
+    uint64_t nblocks;
+    uint64_t reserved;
+};
+
+_Static_assert(sizeof(struct rl_header) == RL_HDR_SIZE, "rl_header");
+_Static_assert(sizeof(struct rl_record) == RL_REC_SIZE, "rl_record");
+
+// ======= запись: child --binlog, child_shm --binlog =======
+// Нужен _GNU_SOURCE до первого #include (fallocate, mremap). Записи копятся в буфере и уходят одним write(). Место в файле заранее
+// выделяется fallocate кусками по RL_PREALLOC, чтобы файловая система не
+// наращивала файл на каждой пачке; лишнее отдаётся при закрытии. Сводки
+// индекса считаются на лету и пишутся в конец файла при закрытии.
+#define RL_BUF_RECS 2048
+#define RL_PREALLOC (64 << 20)
+
+struct reslog {
+    int fd;
+    uint64_t nrec;          // записей всего, вместе с ещё не записанными
+    int64_t last_ts;
+    struct rl_index* idx;   // сводки блоков (mmap, растёт)
+    size_t idx_cap;
+    off_t alloc_end;        // до этого смещения место уже выделено
+    size_t nbuf;
+    struct rl_record buf[RL_BUF_RECS];
+};
+
+static inline void rl_idx_grow(struct reslog* w, size_t need) {
+    if (need <= w->idx_cap) return;
+    size_t ncap = w->idx_cap ? w->idx_cap : 1024;
+    while (ncap < need) ncap *= 2;
+    void* p = w->idx_cap
+        ? mremap(w->idx, w->idx_cap * sizeof(*w->idx), ncap * sizeof(*w->idx), MREMAP_MAYMOVE)
+        : mmap(NULL, ncap * sizeof(*w->idx), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED) die("child: mmap(index) failed");
+    w->idx = (struct rl_index*)p;
+    w->idx_cap = ncap;
+}
+
+// учесть запись в сводке её блока
+static inline void rl_idx_add(struct reslog* w, uint64_t i, int64_t ts, int32_t status, int64_t sum) {
+    struct rl_index* x = &w->idx[i / RL_BLOCK];
+    if (i % RL_BLOCK == 0) {
+        memset(x, 0, sizeof(*x));
+        x->ts_first = ts;
+    }
+    x->ts_last = ts;
+    if (status == RS_OK) {
+        __int128 s = ((__int128)x->sum_hi << 64) + x->sum_lo + sum;
+        x->sum_lo = (uint64_t)s;
+        x->sum_hi = (int64_t)(s >> 64);
+        x->n_ok++;
+    } else {
+        x->n_err++;
+    }
+}
+
+// Открыть журнал на дозапись (нет — создать). Индекс берётся из хвоста
+// файла; если хвоста нет (прошлый писатель не закрыл журнал), он строится
+// заново по записям, а недописанный конец отрезается.
+static inline void rl_open(struct reslog* w, const char* name) {
+    memset(w, 0, offsetof(struct reslog, buf));
+    w->fd = open(name, O_RDWR | O_CREAT, 0644);
+    if (w->fd < 0) die("child: open(binlog) failed");
+    struct stat st;
+    if (fstat(w->fd, &st) < 0) die("child: fstat(binlog) failed");
+
+    struct rl_header h;
+    if (st.st_size == 0) {
+        memset(&h, 0, sizeof(h));
+        memcpy(h.magic, RL_MAGIC, sizeof(h.magic));
+        h.version = RL_VERSION;
+        h.rec_size = RL_REC_SIZE;
+        h.block = RL_BLOCK;
+        if (write_all(w->fd, &h, sizeof(h)) < 0) die("child: write(binlog) failed");
+        w->alloc_end = RL_HDR_SIZE;
+        return;
+    }
+    if (pread(w->fd, &h, sizeof(h), 0) != (ssize_t)sizeof(h) || memcmp(h.magic, RL_MAGIC, sizeof(h.magic)) != 0
+        || h.version != RL_VERSION || h.rec_size != RL_REC_SIZE || h.block != RL_BLOCK)
+        die("дочь: файл не является журналом результатов (reslog)");
+
+    uint64_t body = (uint64_t)st.st_size - RL_HDR_SIZE;
+    struct rl_trailer t;
+    int indexed = 0;
+    if (body >= sizeof(t) && pread(w->fd, &t, sizeof(t), st.st_size - (off_t)sizeof(t)) == (ssize_t)sizeof(t)
+        && memcmp(t.magic, RL_IDX_MAGIC, sizeof(t.magic)) == 0
+        && t.nblocks == (t.nrec + RL_BLOCK - 1) / RL_BLOCK
+        && t.nrec <= body / RL_REC_SIZE
+        && t.nrec * RL_REC_SIZE + t.nblocks * sizeof(struct rl_index) + sizeof(t) == body) {
+        rl_idx_grow(w, t.nblocks);
+        size_t n = t.nblocks * sizeof(struct rl_index);
+        if (pread(w->fd, w->idx, n, RL_HDR_SIZE + (off_t)(t.nrec * RL_REC_SIZE)) != (ssize_t)n)
+            die("child: read(binlog index) failed");
+        w->nrec = t.nrec;
+        indexed = 1;
+    }
+    if (!indexed) {
+        // восстановление: записи идут подряд, пока номер совпадает с позицией
+        uint64_t cnt = body / RL_REC_SIZE;
+        if (cnt) {
+            void* m = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, w->fd, 0);
+            if (m == MAP_FAILED) die("child: mmap(binlog) failed");
+            madvise(m, (size_t)st.st_size, MADV_SEQUENTIAL);
+            const struct rl_record* r = (const struct rl_record*)((const char*)m + RL_HDR_SIZE);
+            rl_idx_grow(w, (cnt + RL_BLOCK - 1) / RL_BLOCK);
+            uint64_t i = 0;
+            for (; i < cnt && r[i].seq == i + 1; ++i)
+                rl_idx_add(w, i, r[i].ts_ns, r[i].status, r[i].sum);
+            w->nrec = i;
+            munmap(m, (size_t)st.st_size);
+        }
+    }
+
+    off_t end = RL_HDR_SIZE + (off_t)(w->nrec * RL_REC_SIZE);
+    if (ftruncate(w->fd, end) < 0 || lseek(w->fd, end, SEEK_SET) < 0) die("child: ftruncate(binlog) failed");
+    w->alloc_end = end;
+    if (w->nrec) w->last_ts = w->idx[(w->nrec - 1) / RL_BLOCK].ts_last;
+}
+
+static inline void rl_flush(struct reslog* w) {
+    if (!w->nbuf) return;
+    size_t n = w->nbuf * sizeof(struct rl_record);
+    off_t off = RL_HDR_SIZE + (off_t)((w->nrec - w->nbuf) * RL_REC_SIZE);
+    if (off + (off_t)n > w->alloc_end) {
+        // ошибку не проверяем: не все файловые системы умеют fallocate,
+        // место тогда просто выделится при записи
+        if (fallocate(w->fd, FALLOC_FL_KEEP_SIZE, w->alloc_end, RL_PREALLOC) == 0)
+            w->alloc_end += RL_PREALLOC;
+        else
+            w->alloc_end = off + (off_t)n;
+    }
+    if (write_all(w->fd, w->buf, n) < 0) die("child: write(binlog) failed");
+    w->nbuf = 0;
+}
+
+static inline void rl_add(struct reslog* w, int32_t status, long long sum) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    int64_t now = (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+    if (now < w->last_ts) now = w->last_ts; // время в журнале не убывает
+    w->last_ts = now;
+
+    rl_idx_grow(w, w->nrec / RL_BLOCK + 1);
+    rl_idx_add(w, w->nrec, now, status, sum);
+    struct rl_record* r = &w->buf[w->nbuf++];
+    r->seq = ++w->nrec;
+    r->ts_ns = now;
+    r->status = status;
+    r->reserved = 0;
+    r->sum = status == RS_OK ? sum : 0;
+    if (w->nbuf == RL_BUF_RECS) rl_flush(w);
+}
+
+// дописать остаток, индекс и хвост; заранее выделенное сверх этого — отдать
+static inline void rl_close(struct reslog* w) {
+    rl_flush(w);
+    struct rl_trailer t;
+    memset(&t, 0, sizeof(t));
+    memcpy(t.magic, RL_IDX_MAGIC, sizeof(t.magic));
+    t.nrec = w->nrec;
+    t.nblocks = (w->nrec + RL_BLOCK - 1) / RL_BLOCK;
+    if (write_all(w->fd, w->idx, t.nblocks * sizeof(struct rl_index)) < 0
+        || write_all(w->fd, &t, sizeof(t)) < 0)
+        die("child: write(binlog index) failed");
+    off_t end = lseek(w->fd, 0, SEEK_CUR);
+    if (end >= 0 && ftruncate(w->fd, end) < 0) die("child: ftruncate(binlog) failed");
+    if (w->idx_cap) munmap(w->idx, w->idx_cap * sizeof(*w->idx));
+    close(w->fd);
+}
+
+#endif
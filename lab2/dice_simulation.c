@@ -1,6 +1,7 @@
 #include <pthread.h>
 #include <unistd.h>
 #include <time.h>
+#include <stdint.h>
 #include <string.h>
 #include <sys/mman.h>  // Для mmap/munmap
 
@@ -82,7 +83,9 @@ static void print_double(double num, int precision) {
 
 typedef struct {
     size_t thread_id;
+    size_t first_experiment;    // номер первого эксперимента потока
     size_t experiments_per_thread;
+    uint64_t seed;
     int K;
     int current_round;
     int player1_score;
@@ -92,26 +95,86 @@ typedef struct {
     size_t local_draws;
 } ThreadArgs;
 
-// Простой линейный конгруэнтный генератор вместо rand_r
-static unsigned int my_rand(unsigned int *seed) {
-    *seed = (*seed * 1103515245 + 12345) & 0x7fffffff;
-    return *seed;
+// Генератор xoshiro256++. У каждого эксперимента свой поток чисел:
+// состояние получается из (seed, номер эксперимента) через SplitMix64.
+// Поэтому эксперимент i видит одни и те же числа при любом числе потоков,
+// и результат при том же --seed совпадает до бита.
+typedef struct {
+    uint64_t s[4];
+    uint64_t dice;      // ещё не использованные кости: цифры в системе по основанию 6
+    int dice_left;
+} Rng;
+
+#define DICE_PER_DRAW 20                        // 6^20 < 2^64
+#define DICE_POW 3656158440062976ULL            // 6^20
+#define DICE_LIM (DICE_POW * (UINT64_MAX / DICE_POW))
+
+static uint64_t splitmix64(uint64_t *x) {
+    uint64_t z = (*x += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+static void rng_init(Rng *r, uint64_t seed, uint64_t experiment) {
+    uint64_t x = seed;
+    uint64_t key = splitmix64(&x) ^ experiment;
+    x = key;
+    splitmix64(&x);                             // перемешать соседние номера
+    for (int k = 0; k < 4; k++) r->s[k] = splitmix64(&x);
+    r->dice_left = 0;
+}
+
+static inline uint64_t rotl(uint64_t x, int k) {
+    return (x << k) | (x >> (64 - k));
+}
+
+static inline uint64_t rng_next(Rng *r) {
+    uint64_t *s = r->s;
+    uint64_t result = rotl(s[0] + s[3], 23) + s[0];
+    uint64_t t = s[1] << 17;
+    s[2] ^= s[0];
+    s[3] ^= s[1];
+    s[1] ^= s[2];
+    s[0] ^= s[3];
+    s[2] ^= t;
+    s[3] = rotl(s[3], 45);
+    return result;
+}
+
+// Бросок одной кости: 20 костей из одного 64-битного числа. Числа от
+// DICE_LIM и выше отбрасываются (вероятность ~1e-4), так что остаток
+// по модулю 6^20 равномерен и кости без смещения.
+static inline int roll_die(Rng *r) {
+    if (r->dice_left == 0) {
+        uint64_t x;
+        while ((x = rng_next(r)) >= DICE_LIM) {}
+        r->dice = x % DICE_POW;
+        r->dice_left = DICE_PER_DRAW;
+    }
+    int d = (int)(r->dice % 6);
+    r->dice /= 6;
+    r->dice_left--;
+    return d + 1;
 }
 
 // Функция броска двух костей
-static int roll_two_dice(unsigned int *seed) {
-    return (my_rand(seed) % 6 + 1) + (my_rand(seed) % 6 + 1);
+static inline int roll_two_dice(Rng *r) {
+    return roll_die(r) + roll_die(r);
 }
 
-// Функция симуляции одной игры
+// Функция симуляции одной игры (эксперимент номер experiment)
 static void simulate_game(int K, int current_round, int p1_score, int p2_score,
-                   int *p1_wins, int *p2_wins, int *draws, unsigned int *seed) {
+                   int *p1_wins, int *p2_wins, int *draws,
+                   uint64_t seed, uint64_t experiment) {
     int player1 = p1_score;
     int player2 = p2_score;
+    Rng rng;
+    rng_init(&rng, seed, experiment);
     
     for (int round = current_round; round < K; round++) {
-        player1 += roll_two_dice(seed);
-        player2 += roll_two_dice(seed);
+        player1 += roll_two_dice(&rng);
+        player2 += roll_two_dice(&rng);
     }
     
     if (player1 > player2) (*p1_wins)++;
@@ -122,13 +185,13 @@ static void simulate_game(int K, int current_round, int p1_score, int p2_score,
 // Рабочая функция потока
 static void *worker_thread(void *_args) {
     ThreadArgs *args = (ThreadArgs *)_args;
-    unsigned int seed = (unsigned int)time(NULL) ^ (args->thread_id << 16);
     
     for (size_t i = 0; i < args->experiments_per_thread; i++) {
         int p1_wins = 0, p2_wins = 0, draws = 0;
         simulate_game(args->K, args->current_round, 
                      args->player1_score, args->player2_score,
-                     &p1_wins, &p2_wins, &draws, &seed);
+                     &p1_wins, &p2_wins, &draws,
+                     args->seed, args->first_experiment + i);
         
         args->local_player1_wins += p1_wins;
         args->local_player2_wins += p2_wins;
@@ -140,16 +203,15 @@ static void *worker_thread(void *_args) {
 
 // Последовательная версия
 static double sequential_monte_carlo(int K, int current_round, int p1_score, 
-                             int p2_score, size_t num_experiments) {
+                             int p2_score, size_t num_experiments, uint64_t seed) {
     struct timespec start, end;
     clock_gettime(CLOCK_MONOTONIC, &start);
     
-    unsigned int seed = (unsigned int)time(NULL);
     size_t p1_wins = 0, p2_wins = 0, draws = 0;
     
     for (size_t i = 0; i < num_experiments; i++) {
         int p1 = 0, p2 = 0, d = 0;
-        simulate_game(K, current_round, p1_score, p2_score, &p1, &p2, &d, &seed);
+        simulate_game(K, current_round, p1_score, p2_score, &p1, &p2, &d, seed, i);
         p1_wins += p1;
         p2_wins += p2;
         draws += d;
@@ -177,7 +239,7 @@ static double sequential_monte_carlo(int K, int current_round, int p1_score,
 // Параллельная версия
 static double parallel_monte_carlo(int K, int current_round, int p1_score, 
                            int p2_score, size_t num_experiments, 
-                           size_t num_threads) {
+                           size_t num_threads, uint64_t seed) {
     struct timespec start, end;
     clock_gettime(CLOCK_MONOTONIC, &start);
     
@@ -192,9 +254,13 @@ static double parallel_monte_carlo(int K, int current_round, int p1_score,
     size_t experiments_per_thread = num_experiments / num_threads;
     size_t remainder = num_experiments % num_threads;
     
+    size_t first = 0;
     for (size_t i = 0; i < num_threads; i++) {
         args[i].thread_id = i;
+        args[i].first_experiment = first;
         args[i].experiments_per_thread = experiments_per_thread + (i < remainder ? 1 : 0);
+        first += args[i].experiments_per_thread;
+        args[i].seed = seed;
         args[i].K = K;
         args[i].current_round = current_round;
         args[i].player1_score = p1_score;
@@ -237,8 +303,15 @@ static double parallel_monte_carlo(int K, int current_round, int p1_score,
 }
 
 int main(int argc, char **argv) {
+    // --seed N: тот же N — те же результаты при любом числе потоков
+    uint64_t seed = (uint64_t)time(NULL);
+    if (argc > 2 && strcmp(argv[1], "--seed") == 0) {
+        seed = (uint64_t)str_to_long(argv[2]);
+        argv += 2;
+        argc -= 2;
+    }
     if (argc < 6) {
-        print_str("Usage: <K> <current_round> <p1_score> <p2_score> <experiments> [threads]\n");
+        print_str("Usage: [--seed N] <K> <current_round> <p1_score> <p2_score> <experiments> [threads]\n");
         return 1;
     }
     
@@ -257,12 +330,15 @@ int main(int argc, char **argv) {
     print_str("\n--- Running with ");
     print_num(num_threads);
     print_str(" threads ---\n");
+    print_str("Seed: ");
+    print_num((long)seed);
+    print_str("\n");
     
     double time_ms;
     if (num_threads == 1) {
-        time_ms = sequential_monte_carlo(K, current_round, p1_score, p2_score, experiments);
+        time_ms = sequential_monte_carlo(K, current_round, p1_score, p2_score, experiments, seed);
     } else {
-        time_ms = parallel_monte_carlo(K, current_round, p1_score, p2_score, experiments, num_threads);
+        time_ms = parallel_monte_carlo(K, current_round, p1_score, p2_score, experiments, num_threads, seed);
     }
     
     print_str("Time: ");
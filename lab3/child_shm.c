@@ -1,188 +1,637 @@
+#define _GNU_SOURCE
 #include <unistd.h>
 #include <fcntl.h>
 #include <sys/types.h>
 #include <sys/mman.h>
 #include <sys/stat.h>
-#include <semaphore.h>
+#include <sys/uio.h>
+#include <signal.h>
+#include <pthread.h>
 #include <errno.h>
 #include <string.h>
-#include <stdlib.h>
+#include <stddef.h>
+#include <time.h>
+#include <stdint.h>
 
-#define BUF_IN_SIZE  2048
-#define BUF_OUT_SIZE 2048
+#include "../lab1/proto.h"
+#include "../lab1/reslog.h"
+#include "../lab1/agg.h"
+#include "../lab1/rcache.h"
+#include "../ipc/ipc.h"
 
-// ===== утилиты I/O (как в ЛР1) =====
-static void die(const char* msg) {
-    ssize_t _ __attribute__((unused)) = write(2, msg, strlen(msg));
-    ssize_t __ __attribute__((unused)) = write(2, "\n", 1);
-    _exit(1);
+// ===== набор агрегатов (как в ЛР1, ../lab1/agg.h) =====
+// по умолчанию — только sum; родитель может задать другой первым сообщением
+static struct agg_spec aggs = { AGG_SUM, 0, 0, 0, 0 };
+
+// числа строки для агрегатов: их не больше len / 2 + 1 ("1 1 1 ...");
+// длинные запросы (shm, memfd, ring, eventfd) бывают какой угодно длины — массив растёт
+static long long* vals_buf;
+static size_t vals_cap;
+
+static void vals_grow(size_t need) {
+    if (need <= vals_cap) return;
+    size_t ncap = vals_cap ? vals_cap : LR_BUF_SIZE / 2 + 1;
+    while (ncap < need) ncap *= 2;
+    void* p = vals_cap
+        ? mremap(vals_buf, vals_cap * sizeof(*vals_buf), ncap * sizeof(*vals_buf), MREMAP_MAYMOVE)
+        : mmap(NULL, ncap * sizeof(*vals_buf), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED) die("child: mmap(vals) failed");
+    vals_buf = (long long*)p;
+    vals_cap = ncap;
+}
+
+// ===== кэш результатов (как в ЛР1, ../lab1/rcache.h): child_shm ... --cache N =====
+static struct rcache cache;
+// у демона кэш общий для всех клиентов, а набор агрегатов у каждого свой:
+// в кэше — только ответы без -a
+static int cache_sum_only;
+
+// разбор строки line[0..len): код sum_line, сумма и, если заказаны,
+// остальные агрегаты; строка, что уже встречалась, берётся из кэша
+static int eval_line(const char* line, size_t len, struct agg_res* res) {
+    int hit;
+    struct rc_entry* e = cache_sum_only && aggs.mask != AGG_SUM ? NULL : rc_lookup(&cache, line, len, &hit);
+    if (e && hit) {
+        *res = e->r;
+        return e->st;
+    }
+    struct agg_res* r = e ? &e->r : res;
+    int st;
+    if (aggs.mask == AGG_SUM) {
+        st = sum_line(line, &r->sum);
+    } else {
+        size_t n;
+        vals_grow(len / 2 + 1);
+        st = vals_line(line, &r->sum, vals_buf, &n);
+        if (st == PARSE_OK) agg_values(&aggs, vals_buf, n, r->sum, r);
+    }
+    if (e) {
+        e->st = st;
+        *res = e->r;
+    }
+    return st;
+}
+
+// ответ на строку (текст в out, не больше REPLY_MAX): сумма или строка
+// агрегатов, либо сообщение об ошибке; *rs и *res — для двоичного журнала
+// и пакетного режима (при ошибке в *res нули)
+static size_t respond(const char* line, size_t len, char* out, int32_t* rs, struct agg_res* res) {
+    // разбор строки: сумма и, если заказаны, остальные агрегаты
+    int st = eval_line(line, len, res);
+
+    *rs = rs_status(st);
+    if (*rs != RS_OK) memset(res, 0, sizeof(*res));
+    // "sum=<value>\n" (или строка агрегатов), либо сообщение об ошибке
+    return format_reply(&aggs, *rs, res, out);
+}
+
+// ===== запись файла результатов отдельным потоком: child_shm ... [--sync none|batch|<мс>] =====
+// Ответ родителю не ждёт диска. Рабочий цикл копирует текст ответа в
+// кольцо в памяти процесса (один писатель, один читатель, без блокировок),
+// поток записи забирает всё накопленное одним writev. Будить его на каждую
+// строку — тот же системный вызов, что и запись: пока строки идут, он
+// просыпается сам раз в WR_PERIOD_MS или когда набралось WR_BATCH байт;
+// если за время дрёмы ничего не пришло — спит, пока не придёт строка.
+// Надёжность (--sync): none — как раньше, данные у ядра; batch — fdatasync
+// после каждой пачки; <мс> — fdatasync не реже раза в столько миллисекунд.
+// При завершении кольцо дописывается до конца и (кроме none) — fdatasync.
+#define WR_RING      (1 << 20)
+#define WR_BATCH     (64 << 10)
+#define WR_PERIOD_MS 10
+#define WR_SYNC_MAX  3600000    // предел --sync <мс>
+#define WR_SYNC_NONE (-1)
+#define WR_SYNC_BATCH 0
+
+#define W_RUN  0                // работает
+#define W_NAP  1                // дремлет до WR_PERIOD_MS: будить, если набралось WR_BATCH
+#define W_IDLE 2                // спит без срока: будить на любую строку
+
+struct writer {
+    uint64_t head __attribute__((aligned(64)));   // сколько байт записано (пишет поток записи)
+    uint64_t tail __attribute__((aligned(64)));   // сколько положено (пишет рабочий цикл)
+    uint32_t state __attribute__((aligned(64)));
+    uint32_t want_space;        // рабочий цикл ждёт места
+    uint32_t stop;
+    struct ipc_fsem kick;       // разбудить поток записи
+    struct ipc_fsem space;      // место освободилось
+    int fd;
+    long sync_ms;               // WR_SYNC_NONE, WR_SYNC_BATCH или период
+    char* buf;                  // кольцо WR_RING байт (mmap)
+    pthread_t th;
+};
+
+// --sync: none, batch или период в мс; 0 — не разобрать
+static int parse_sync(const char* v, long* ms) {
+    if (strcmp(v, "none") == 0) *ms = WR_SYNC_NONE;
+    else if (strcmp(v, "batch") == 0) *ms = WR_SYNC_BATCH;
+    else if (!(*ms = (long)parse_count(v, WR_SYNC_MAX))) return 0;
+    return 1;
+}
+
+static int64_t mono_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+// записать байты кольца [from, to): не больше двух кусков (кольцо
+// заворачивается). Ошибку записи, как и раньше, родитель не видит.
+static void wr_write(struct writer* w, uint64_t from, uint64_t to) {
+    while (from < to) {
+        size_t pos = from % WR_RING, n = to - from;
+        struct iovec iov[2];
+        iov[0].iov_base = w->buf + pos;
+        iov[0].iov_len = n < WR_RING - pos ? n : WR_RING - pos;
+        iov[1].iov_base = w->buf;
+        iov[1].iov_len = n - iov[0].iov_len;
+        ssize_t r = writev(w->fd, iov, iov[1].iov_len ? 2 : 1);
+        if (r < 0 && errno == EINTR) continue;
+        if (r <= 0) return;
+        from += (uint64_t)r;
+    }
 }
 
-static ssize_t write_all(int fd, const void* buf, size_t n) {
-    const char* p = (const char*)buf;
-    size_t left = n;
-    while (left) {
-        ssize_t w = write(fd, p, left);
-        if (w < 0) { if (errno == EINTR) continue; return -1; }
-        left -= (size_t)w; p += w;
+static void* wr_main(void* arg) {
+    struct writer* w = (struct writer*)arg;
+    int64_t synced = mono_ms();
+    int dirty = 0, idle = 0;    // idle — прошлая дрёма прошла впустую
+    for (;;) {
+        uint64_t tail = __atomic_load_n(&w->tail, __ATOMIC_ACQUIRE);
+        if (tail != w->head) {
+            wr_write(w, w->head, tail);
+            __atomic_store_n(&w->head, tail, __ATOMIC_RELEASE);
+            if (__atomic_exchange_n(&w->want_space, 0, __ATOMIC_SEQ_CST)) ipc_fsem_post(&w->space);
+            if (w->sync_ms == WR_SYNC_BATCH) fdatasync(w->fd);
+            else dirty = 1;
+            idle = 0;
+            continue;
+        }
+        int64_t now = mono_ms();
+        if (dirty && w->sync_ms > 0 && now - synced >= w->sync_ms) {
+            fdatasync(w->fd);
+            synced = now;
+            dirty = 0;
+        }
+        if (__atomic_load_n(&w->stop, __ATOMIC_ACQUIRE)) break;
+
+        // пусто: флаг сна — до последней проверки (как у ring)
+        uint32_t st = idle ? W_IDLE : W_NAP;
+        __atomic_store_n(&w->state, st, __ATOMIC_SEQ_CST);
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+        if (__atomic_load_n(&w->tail, __ATOMIC_ACQUIRE) != w->head || __atomic_load_n(&w->stop, __ATOMIC_ACQUIRE)) {
+            __atomic_store_n(&w->state, W_RUN, __ATOMIC_RELAXED);
+            continue;
+        }
+        long ms = st == W_NAP ? WR_PERIOD_MS : dirty && w->sync_ms > 0 ? (long)(synced + w->sync_ms - now) : -1;
+        int woken = ipc_fsem_timedwait(&w->kick, ms);
+        __atomic_store_n(&w->state, W_RUN, __ATOMIC_RELAXED);
+        idle = !woken && __atomic_load_n(&w->tail, __ATOMIC_ACQUIRE) == w->head;
     }
-    return (ssize_t)n;
+    if (w->sync_ms != WR_SYNC_NONE) fdatasync(w->fd);
+    return NULL;
 }
 
-// ---- парсер целых и int -> строка (как в твоей child.c) ----
-static int parse_ll(const char* s, size_t* i, long long* out) {
-    while (s[*i] == ' ' || s[*i] == '\t' || s[*i] == '\r') (*i)++;
+static void wr_start(struct writer* w, int fd, long sync_ms) {
+    memset(w, 0, sizeof(*w));
+    w->fd = fd;
+    w->sync_ms = sync_ms;
+    void* p = mmap(NULL, WR_RING, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED) die("child: mmap(writer) failed");
+    w->buf = (char*)p;
+    if (pthread_create(&w->th, NULL, wr_main, w) != 0) die("child: pthread_create failed");
+}
+
+static void wr_kick(struct writer* w) {
+    if (__atomic_exchange_n(&w->state, W_RUN, __ATOMIC_SEQ_CST) != W_RUN) ipc_fsem_post(&w->kick);
+}
 
-    int sign = 1;
-    if (s[*i] == '+' || s[*i] == '-') {
-        if (s[*i] == '-') sign = -1;
-        (*i)++;
+// положить ответ в кольцо (n <= REPLY_MAX); места нет — дождаться
+static void wr_put(struct writer* w, const char* s, size_t n) {
+    uint64_t tail = w->tail;
+    while (tail + n - __atomic_load_n(&w->head, __ATOMIC_ACQUIRE) > WR_RING) {
+        __atomic_store_n(&w->want_space, 1, __ATOMIC_SEQ_CST);
+        wr_kick(w);
+        // поток записи снимает want_space после каждой пачки — повторить проверку
+        if (tail + n - __atomic_load_n(&w->head, __ATOMIC_SEQ_CST) > WR_RING)
+            ipc_fsem_timedwait(&w->space, WR_PERIOD_MS);
     }
+    size_t pos = tail % WR_RING, k = n < WR_RING - pos ? n : WR_RING - pos;
+    memcpy(w->buf + pos, s, k);
+    memcpy(w->buf, s + k, n - k);
+    __atomic_store_n(&w->tail, tail + n, __ATOMIC_RELEASE);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST); // tail виден до проверки state
+    uint32_t st = __atomic_load_n(&w->state, __ATOMIC_RELAXED);
+    if (st == W_IDLE || (st == W_NAP && tail + n - __atomic_load_n(&w->head, __ATOMIC_RELAXED) >= WR_BATCH))
+        wr_kick(w);
+}
+
+// дописать всё из кольца и остановить поток записи
+static void wr_stop(struct writer* w) {
+    __atomic_store_n(&w->stop, 1, __ATOMIC_RELEASE);
+    wr_kick(w);
+    pthread_join(w->th, NULL);
+    munmap(w->buf, WR_RING);
+}
+
+// ===== канал к родителю: свой (ipc_chan) или общий пул (child_shm - --pool) =====
+static struct ipc_chan ch;
+static struct ipc_pool pool;
+static int pooled;
+static struct reslog* rlog;   // --binlog
+static int fd = -1;
+static struct writer wr;      // пишет файл результатов (не в пуле и не с --binlog)
+static struct ipc_stats* stats; // счётчики для shmstat; NULL — IPC_STATS=0
+
+// время получения строки — у каждой IPC_STATS_SAMPLE-й, иначе 0
+static int64_t line_start(void) {
+    static unsigned seq;
+    return stats && seq++ % IPC_STATS_SAMPLE == 0 ? ipc_now_ns() : 0;
+}
 
-    if (s[*i] < '0' || s[*i] > '9') return 0;
+// учесть строку len байт с кодом rs (RS_*), принятую в t0
+static void count_line(size_t len, int32_t rs, int64_t t0) {
+    static const int by_rs[] = { IPC_ST_OK, IPC_ST_NO_NUMBERS, IPC_ST_BAD_FORMAT, IPC_ST_OVERFLOW };
+    if (!stats) return;
+    ipc_stat_add(stats, IPC_ST_LINES, 1);
+    ipc_stat_add(stats, IPC_ST_BYTES, len);
+    ipc_stat_add(stats, by_rs[rs], 1);
+    if (t0) ipc_stat_lat(stats, t0);
+}
 
-    long long val = 0;
-    int found_digit = 0;
-    while (s[*i] >= '0' && s[*i] <= '9') {
-        int d = s[*i] - '0';
-        val = val * 10 + d;
-        (*i)++;
-        found_digit = 1;
+// ответ на строку — в файл результатов (или журнал)
+static void to_file(int32_t rs, long long sum, const char* msg, size_t n) {
+    if (rlog) rl_add(rlog, rs, sum);
+    else wr_put(&wr, msg, n);
+}
+
+// ответ на строку: в файл и родителю; в пуле файл дописывает
+// ipc_pool_reply — по порядку строк, а не ответов
+static void answer(int32_t rs, long long sum, const char* msg, size_t n) {
+    if (pooled) {
+        ipc_pool_reply(&pool, msg, n);
+        return;
     }
+    to_file(rs, sum, msg, n);
+    ipc_reply(&ch, msg, n);
+}
+
+// ===== пакетный режим: весь файл ввода одним сообщением (PROTO_BULK, parent_shm -B) =====
+// Файл отображается только для чтения, строки разбираются прямо в нём: за
+// отображением — ещё страница анонимных нулей, так что за последней
+// строкой без '\n' всегда '\0' (как в буфере line_reader), и векторный
+// разбор не выходит за отображение. Массив ответов — memfd родителя —
+// растёт вдвое (ftruncate + mremap).
+#define BULK_START 65536        // записей в массиве ответов сначала
 
-    // запрет дробных: если . или , — считаем ошибкой, как в ЛР1
-    if (s[*i] == '.' || s[*i] == ',') {
-        *out = 0;
-        while (s[*i] && s[*i] != ' ' && s[*i] != '\n') (*i)++;
-        errno = EINVAL;
+// "#bulk <fd файла> <смещение> <fd ответов>\n" -> строк разобрано; -1 — не
+// вышло. Дескрипторы — только те, что родитель назвал при запуске (--bulk):
+// числам из канала не верим.
+static long long bulk(const char* msg, size_t len, int in_fd, int res_fd) {
+    size_t i = sizeof(PROTO_BULK) - 1;
+    long long mi, off, mr;
+    if (!agg_parse_ll(msg, len, &i, &mi) || i >= len || msg[i++] != ' '
+        || !agg_parse_ll(msg, len, &i, &off) || i >= len || msg[i++] != ' '
+        || !agg_parse_ll(msg, len, &i, &mr) || mi != in_fd || mr != res_fd)
+        return -1;
+    struct stat st, rst;
+    if (fstat(in_fd, &st) < 0 || !S_ISREG(st.st_mode) || off < 0 || off > st.st_size
+        || fstat(res_fd, &rst) < 0 || !S_ISREG(rst.st_mode) || rst.st_size != 0)
+        return -1;
+    size_t size = (size_t)st.st_size, page = (size_t)sysconf(_SC_PAGESIZE);
+    size_t span = ((size + page - 1) & ~(page - 1)) + page;
+    char* base = (char*)mmap(NULL, span, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (base == MAP_FAILED) return -1;
+    if (size && mmap(base, size, PROT_READ, MAP_SHARED | MAP_FIXED, in_fd, 0) == MAP_FAILED) {
+        munmap(base, span);
         return -1;
     }
+    madvise(base, size, MADV_SEQUENTIAL);
 
-    if (!found_digit) return 0;
-    *out = val * sign;
-    return 1;
+    size_t stride = sizeof(struct frame_reply) + agg_nvals(&aggs) * sizeof(int64_t);
+    char* res = NULL;
+    size_t cap = 0;
+    long long n = 0;
+    for (size_t pos = (size_t)off; pos < size; n++) {
+        const char* line = base + pos;
+        const char* nl = (const char*)memchr(line, '\n', size - pos);
+        size_t k = nl ? (size_t)(nl - line) + 1 : size - pos;
+        if (line[0] == '\n' || line[0] == '\0') break; // пустая строка — конец, как у родителя
+        int64_t t0 = line_start();
+        if ((size_t)n == cap) {
+            size_t ncap = cap ? cap * 2 : BULK_START;
+            if (ftruncate(res_fd, (off_t)(ncap * stride)) < 0) die("child: ftruncate(bulk) failed");
+            void* p = cap ? mremap(res, cap * stride, ncap * stride, MREMAP_MAYMOVE)
+                          : mmap(NULL, ncap * stride, PROT_READ | PROT_WRITE, MAP_SHARED, res_fd, 0);
+            if (p == MAP_FAILED) die("child: mmap(bulk) failed");
+            res = (char*)p;
+            cap = ncap;
+        }
+        char out[REPLY_MAX];
+        int32_t rs;
+        struct agg_res r;
+        size_t m = respond(line, k, out, &rs, &r);
+        to_file(rs, r.sum, out, m);
+        struct frame_reply* fr = (struct frame_reply*)(res + (size_t)n * stride);
+        fr->status = rs;
+        fr->reserved = 0;
+        fr->value = r.sum;
+        agg_pack(&aggs, &r, (int64_t*)(fr + 1));
+        count_line(k, rs, t0);
+        pos += k;
+    }
+    if (cap) munmap(res, cap * stride);
+    munmap(base, span);
+    return n;
+}
+
+static void on_term(int sig) {
+    (void)sig;
+    ipc_pool_leave();
+}
+
+static void on_stop(int sig) {
+    (void)sig;
+    ipc_daemon_stop();
+}
+
+// открыть файл результатов на дозапись (как в ЛР1); с binlog — двоичный
+// журнал. 0 — не открылся.
+static int open_results(const char* name, int binlog, struct reslog* logw, int* fd) {
+    if (binlog) {
+        // rl_open при ошибке завершает процесс — сначала проверить, что файл доступен
+        int t = open(name, O_RDWR | O_CREAT, 0644);
+        if (t < 0) return 0;
+        close(t);
+        rl_open(logw, name);
+        return 1;
+    }
+    *fd = open(name, O_WRONLY | O_CREAT | O_APPEND, 0644);
+    return *fd >= 0;
+}
+
+// Сообщение, о котором родитель предупредил ключом (PROTO_FILE_LATER,
+// --aggs, --bulk): должно начинаться с prefix, иначе — die(what). 0 — родитель
+// закончил, не прислав его.
+static size_t expect(const char* prefix, const char* what, const char** msg) {
+    size_t len = ipc_recv(&ch, msg), n = strlen(prefix);
+    if (len == 0) return 0;
+    if (len <= n || memcmp(*msg, prefix, n) != 0) die(what);
+    return len;
 }
 
-static int ll_to_buf(long long v, char* buf) {
-    char tmp[32];
-    int neg = v < 0;
-    unsigned long long x = neg ? (unsigned long long)(-(v+1)) + 1ULL : (unsigned long long)v;
-    int n = 0;
-    do {
-        tmp[n++] = (char)('0' + (x % 10ULL));
-        x /= 10ULL;
-    } while (x);
-    int k = 0;
-    if (neg) buf[k++] = '-';
-    for (int i = n - 1; i >= 0; --i) buf[k++] = tmp[i];
-    return k;
-}
-
-// ===== структура shared memory =====
-struct shm_data {
-    char in_buf[BUF_IN_SIZE];
-    char out_buf[BUF_OUT_SIZE];
+// ===== демон: child_shm --daemon [--cache N] (../ipc/ipc.h, ipc_daemon) =====
+// Один процесс на много родителей (parent_shm -D). У каждого клиента своё
+// место: файл результатов, набор агрегатов и где он в разговоре — как у
+// ребёнка, запущенного заранее (-W): сначала PROTO_FILE, затем, может быть,
+// PROTO_AGGS, затем строки.
+struct client {
+    int fd;                 // файл результатов; -1 — ещё не назван
+    int phase;              // 0 — ждём PROTO_FILE, 1 — PROTO_AGGS, 2 — строки
+    struct agg_spec aggs;
 };
 
-int main(int argc, char** argv) {
-    if (argc < 5) die("usage: child_shm <fileName> <shm_name> <sem_p_name> <sem_c_name>");
+static int serve_daemon(void) {
+    static struct ipc_daemon dm;
+    static struct client clients[IPC_DAEMON_SLOTS];
+    if (!ipc_daemon_open(&dm)) return 0; // уже запущен — этот не нужен
+    // SIGTERM, SIGINT — закрыть файлы и реестр
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_stop; // без SA_RESTART: сон в ожидании запроса прервётся
+    sigaction(SIGTERM, &sa, NULL);
+    sigaction(SIGINT, &sa, NULL);
+    for (int k = 0; k < IPC_DAEMON_SLOTS; ++k) clients[k].fd = -1;
+    cache_sum_only = 1;
+    stats = ipc_stats_open(IPC_ROLE_DAEMON, "daemon");
 
-    const char* fileName   = argv[1];
-    const char* shm_name   = argv[2];
-    const char* sem_p_name = argv[3];
-    const char* sem_c_name = argv[4];
+    for (;;) {
+        int slot;
+        const char* line;
+        ssize_t len = ipc_daemon_recv(&dm, &slot, &line);
+        if (len < 0) break;
+        int64_t t0 = line_start();
+        struct client* c = &clients[slot];
+        if (len == 0) { // клиент закончил или пропал: место освобождается
+            if (c->fd >= 0) close(c->fd);
+            c->fd = -1;
+            c->phase = 0;
+            continue;
+        }
 
-    // открыть файл на дозапись (как в ЛР1)
-    int fd = open(fileName, O_WRONLY | O_CREAT | O_APPEND, 0644);
-    if (fd < 0) die("child: open(file) failed");
+        size_t fp = sizeof(PROTO_FILE) - 1, ap = sizeof(PROTO_AGGS) - 1;
+        if (c->phase == 0) {
+            const char* r = PROTO_FILE_BAD;
+            if ((size_t)len > fp && memcmp(line, PROTO_FILE, fp) == 0) {
+                char name[IPC_MSG_MAX];
+                memcpy(name, line + fp, (size_t)len - fp);
+                name[len - fp] = '\0';
+                chomp(name);
+                c->fd = open(name, O_WRONLY | O_CREAT | O_APPEND, 0644);
+                if (c->fd >= 0) {
+                    r = PROTO_FILE_OK;
+                    c->phase = 1;
+                    agg_default(&c->aggs);
+                }
+            }
+            ipc_daemon_reply(&dm, slot, r, strlen(r));
+            continue;
+        }
+        if (c->phase == 1) { // клиент шлёт набор агрегатов всегда, даже "sum"
+            const char* r = PROTO_AGGS_BAD;
+            if ((size_t)len >= ap && memcmp(line, PROTO_AGGS, ap) == 0
+                && agg_parse(line + ap, (size_t)len - ap, &c->aggs)) {
+                r = PROTO_AGGS_OK;
+                c->phase = 2;
+            }
+            ipc_daemon_reply(&dm, slot, r, strlen(r));
+            continue;
+        }
 
-    // подключиться к shared memory и семафорам
-    int shm_fd = shm_open(shm_name, O_RDWR, 0666);
-    if (shm_fd < 0) die("child: shm_open failed");
+        aggs = c->aggs;
+        char out[REPLY_MAX];
+        int32_t rs;
+        struct agg_res res;
+        size_t k = respond(line, (size_t)len, out, &rs, &res);
+        write_all(c->fd, out, k);
+        ipc_daemon_reply(&dm, slot, out, k);
+        count_line((size_t)len, rs, t0);
+    }
+
+    for (int k = 0; k < IPC_DAEMON_SLOTS; ++k)
+        if (clients[k].fd >= 0) close(clients[k].fd);
+    if (cache.b) {
+        char buf[160];
+        write_all(2, buf, rc_stats(&cache, buf));
+    }
+    ipc_stats_close(stats);
+    ipc_daemon_close(&dm);
+    return 0;
+}
 
-    void* map = mmap(NULL, sizeof(struct shm_data), PROT_READ | PROT_WRITE, MAP_SHARED, shm_fd, 0);
-    if (map == MAP_FAILED) die("child: mmap failed");
-    struct shm_data* shm = (struct shm_data*)map;
+int main(int argc, char** argv) {
+    // child_shm <fileName> <адрес канала> [--binlog] [--cache N] [--sync none|batch|<мс>] [--aggs]
+    //           [--bulk <fd файла> <fd ответов>]
+    // адрес (../ipc/ipc.h): <shm_name> <sem_p_name> <sem_c_name>, --pipe,
+    // --memfd, --seqpacket, --ring <три имени> или --eventfd. Вместо fileName
+    // --file-later (PROTO_FILE_LATER) — ребёнок запущен заранее, имя придёт
+    // первым сообщением.
+    // child_shm - --pool <имя> [--cache N] — один из обработчиков пула
+    // (ipc_pool): имя файла и агрегаты — из сегмента пула, fileName не нужен.
+    // --aggs: первым сообщением (после имени файла) придёт PROTO_AGGS;
+    // без ключа строка "#aggs ..." — обычные данные.
+    // --bulk: родитель передал при запуске файл ввода и memfd под ответы
+    // (parent_shm -B), следующим сообщением придёт PROTO_BULK с ними.
+    // child_shm --daemon [--cache N] — демон для parent_shm -D.
+    if (argc > 1 && strcmp(argv[1], "--daemon") == 0) {
+        size_t n = 0;
+        if (argc == 4 && strcmp(argv[2], "--cache") == 0) n = parse_count(argv[3], RC_MAX);
+        if (argc != 2 && !n) die("usage: child_shm --daemon [--cache N]");
+        if (n && !rc_init(&cache, n)) die("child: mmap(cache) failed");
+        parse_init();
+        return serve_daemon();
+    }
+    pooled = argc > 2 && strcmp(argv[2], "--pool") == 0;
+    int na = argc <= 2 ? -1 : pooled ? ipc_pool_attach(&pool, argv + 2, argc - 2) : ipc_attach(&ch, argv + 2, argc - 2);
+    int binlog = 0, synced = 0, want_aggs = 0, ok = na > 0;
+    int bulk_in = -1, bulk_res = -1;
+    size_t cache_size = 0;
+    long sync_ms = WR_SYNC_NONE;
+    for (int a = 2 + na; ok && a < argc; ++a) {
+        if (strcmp(argv[a], "--binlog") == 0 && !pooled) binlog = 1;
+        else if (strcmp(argv[a], "--aggs") == 0 && !pooled) want_aggs = 1;
+        else if (strcmp(argv[a], "--bulk") == 0 && a + 2 < argc && !pooled) {
+            bulk_in = (int)parse_count(argv[++a], INT32_MAX);
+            bulk_res = (int)parse_count(argv[++a], INT32_MAX);
+            ok = bulk_in > 2 && bulk_res > 2 && bulk_in != bulk_res;
+        }
+        else if (strcmp(argv[a], "--cache") == 0 && a + 1 < argc) ok = (cache_size = parse_count(argv[++a], RC_MAX)) != 0;
+        else if (strcmp(argv[a], "--sync") == 0 && a + 1 < argc && !pooled) ok = synced = parse_sync(argv[++a], &sync_ms);
+        else ok = 0;
+    }
+    if (binlog && synced) ok = 0; // журнал пишется пачками сам, без потока записи
+    if (!ok)
+        die("usage: child_shm <fileName> <shm_name> <sem_p_name> <sem_c_name> [--binlog] [--cache N] [--sync P] [--aggs]\n"
+            "       child_shm <fileName> --pipe|--memfd|--seqpacket|--eventfd [--binlog] [--cache N] [--sync P] [--aggs]\n"
+            "       child_shm <fileName> --ring <shm_name> <sem_p_name> <sem_c_name> [--binlog] [--cache N] [--sync P] [--aggs]\n"
+            "       ... [--aggs] [--bulk <fd> <fd>] — ключи parent_shm -a и -B\n"
+            "       child_shm - --pool <shm_name> [--cache N]\n"
+            "       child_shm --daemon [--cache N]\n"
+            "P: none, batch или период fdatasync в мс");
+    if (cache_size && !rc_init(&cache, cache_size)) die("child: mmap(cache) failed");
 
-    sem_t* sem_parent = sem_open(sem_p_name, 0);
-    if (sem_parent == SEM_FAILED) die("child: sem_open(parent) failed");
-    sem_t* sem_child  = sem_open(sem_c_name, 0);
-    if (sem_child == SEM_FAILED) die("child: sem_open(child) failed");
+    const char* fileName = argv[1];
+    parse_init();
 
-    // рабочий цикл: ждать строку -> посчитать сумму -> отдать ответ
-    for (;;) {
-        if (sem_wait(sem_parent) < 0) die("child: sem_wait(parent) failed");
+    static struct reslog logw;
+    rlog = binlog ? &logw : NULL;
+    if (pooled) {
+        // SIGTERM — досчитать строку и уйти из пула; родитель не заметит
+        struct sigaction sa;
+        memset(&sa, 0, sizeof(sa));
+        sa.sa_handler = on_term; // без SA_RESTART: сон в ожидании строки прервётся
+        sigaction(SIGTERM, &sa, NULL);
+        const char* name = ipc_pool_file(&pool);
+        const char* list = ipc_pool_aggs(&pool);
+        if (!name) {
+            ipc_pool_close(&pool);
+            return 0; // родитель закончил, не назвав файла
+        }
+        if (!open_results(name, 0, &logw, &fd) || (list && !agg_parse(list, strlen(list), &aggs))) {
+            ipc_pool_fail(&pool);
+            die("child: open(file) failed");
+        }
+        pool.fd = fd;
+    } else if (strcmp(fileName, PROTO_FILE_LATER) == 0) {
+        // запущены заранее: всё готово, ждём имя файла
+        const char* msg;
+        size_t len = expect(PROTO_FILE, "child: ожидалось имя файла (" PROTO_FILE "...)", &msg);
+        size_t fp = sizeof(PROTO_FILE) - 1;
+        if (len == 0) {
+            ipc_close(&ch);
+            return 0; // родитель передумал
+        }
+        char name[IPC_MSG_MAX];
+        memcpy(name, msg + fp, len - fp);
+        name[len - fp] = '\0';
+        chomp(name);
+        if (!open_results(name, binlog, &logw, &fd)) {
+            ipc_reply(&ch, PROTO_FILE_BAD, sizeof(PROTO_FILE_BAD) - 1);
+            die("child: open(file) failed");
+        }
+        ipc_reply(&ch, PROTO_FILE_OK, sizeof(PROTO_FILE_OK) - 1);
+    } else if (!open_results(fileName, binlog, &logw, &fd)) {
+        die("child: open(file) failed");
+    }
+    if (!pooled && !rlog) wr_start(&wr, fd, sync_ms);
+    stats = ipc_stats_open(pooled ? IPC_ROLE_WORKER : IPC_ROLE_CHILD, pooled ? "pool" : ipc_name(&ch));
 
-        // сигнал на завершение: пустая строка
-        if (shm->in_buf[0] == '\0' || shm->in_buf[0] == '\n') {
-            break;
+    // с --aggs первым сообщением приходит набор агрегатов (PROTO_AGGS из ../lab1/proto.h)
+    int done = 0;
+    if (want_aggs) {
+        const char* msg;
+        size_t len = expect(PROTO_AGGS, "child: ожидался набор агрегатов (" PROTO_AGGS "...)", &msg);
+        size_t ap = sizeof(PROTO_AGGS) - 1;
+        if (len == 0) done = 1;
+        else {
+            const char* r = agg_parse(msg + ap, len - ap, &aggs) ? PROTO_AGGS_OK : PROTO_AGGS_BAD;
+            ipc_reply(&ch, r, strlen(r));
         }
+    }
 
-        // разбор строки и сумма
-        size_t i = 0;
-        int found_any = 0;
-        long long sum = 0;
-        long long val;
-
-        while (1) {
-            int st = parse_ll(shm->in_buf, &i, &val);
-            if (st == 1) {
-                found_any = 1;
-                sum += val;
-            } else if (st == -1) {
-                const char* msg = "ERR: invalid number format\n";
-                // вернуть ответ в shared memory
-                size_t L = strlen(msg);
-                memcpy(shm->out_buf, msg, L+1);
-                // продублировать в файл (как в ЛР1)
-                write_all(fd, msg, L);
-                // сообщить родителю
-                sem_post(sem_child);
-                found_any = 0;
-                goto next_iter;
+    // с --bulk — весь файл ввода разом (parent_shm -B), потом только конец работы
+    if (!done && bulk_in >= 0) {
+        const char* msg;
+        size_t len = expect(PROTO_BULK, "child: ожидался файл ввода (" PROTO_BULK "...)", &msg);
+        if (len == 0) done = 1;
+        else {
+            long long n = bulk(msg, len, bulk_in, bulk_res);
+            if (n < 0) {
+                ipc_reply(&ch, PROTO_BULK_BAD, sizeof(PROTO_BULK_BAD) - 1);
             } else {
-                break; // конец токенов
+                char r[64] = PROTO_BULK_OK;
+                size_t k = sizeof(PROTO_BULK_OK) - 1;
+                k += (size_t)ll_to_buf(n, r + k);
+                r[k++] = '\n';
+                ipc_reply(&ch, r, k);
             }
         }
+        close(bulk_in);
+        close(bulk_res);
+    }
 
-        if (!found_any) {
-            const char* msg = "Бро, ошибка, тут числа нет либо что-то чужеродное\n";
-            size_t L = strlen(msg);
-            memcpy(shm->out_buf, msg, L+1);
-            write_all(fd, msg, L);
-            sem_post(sem_child);
-            goto next_iter;
-        }
+    // рабочий цикл: ждать строку -> посчитать сумму -> отдать ответ
+    while (!done) {
+        const char* line;
+        size_t len = pooled ? ipc_pool_recv(&pool, &line) : ipc_recv(&ch, &line);
+        int64_t t0 = line_start();
 
-        // подготовить "sum=<value>\n"
-        {
-            char out[128];
-            int k = 0;
-            memcpy(out + k, "sum=", 4); k += 4;
-            k += ll_to_buf(sum, out + k);
-            out[k++] = '\n';
-
-            // в shared memory
-            if ((size_t)k >= BUF_OUT_SIZE) k = (int)BUF_OUT_SIZE - 1;
-            memcpy(shm->out_buf, out, (size_t)k);
-            shm->out_buf[k] = '\0';
-
-            // в файл
-            write_all(fd, out, (size_t)k);
+        // сигнал на завершение: пустая строка (или конец канала)
+        if (len == 0 || line[0] == '\n') {
+            break;
         }
 
-        // отдать сигнал родителю: ответ готов
-        sem_post(sem_child);
-
-    next_iter:
-        ;
+        // посчитать; ответ (и ошибку — как в ЛР1) — в файл и родителю
+        char out[REPLY_MAX];
+        int32_t rs;
+        struct agg_res res;
+        size_t k = respond(line, len, out, &rs, &res);
+        answer(rs, res.sum, out, k);
+        count_line(len, rs, t0);
     }
 
     // финал
-    munmap(shm, sizeof(struct shm_data));
-    close(shm_fd);
-    sem_close(sem_parent);
-    sem_close(sem_child);
-    close(fd);
+    if (cache.b) {
+        char buf[160];
+        write_all(2, buf, rc_stats(&cache, buf));
+    }
+    ipc_stats_close(stats);
+    if (pooled) ipc_pool_close(&pool);
+    else ipc_close(&ch);
+    if (rlog) {
+        rl_close(rlog);
+    } else {
+        if (!pooled) wr_stop(&wr);
+        close(fd);
+    }
     return 0;
 }
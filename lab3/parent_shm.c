@@ -3,182 +3,542 @@
 #include <fcntl.h>
 #include <sys/types.h>
 #include <sys/wait.h>
-#include <sys/mman.h>
 #include <sys/stat.h>
-#include <semaphore.h>
+#include <sys/mman.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <sys/syscall.h>
 #include <errno.h>
 #include <string.h>
-#include <stdlib.h>
 
-#define BUF_IN_SIZE  2048
-#define BUF_OUT_SIZE 2048
+#include "../lab1/proto.h"
+#include "../lab1/agg.h"
+#include "../lab1/rcache.h"
+#include "../ipc/ipc.h"
+
+// канал к ребёнку или, с -P, пул обработчиков (../ipc/ipc.h)
+static struct ipc_chan ch;
+static struct ipc_pool pool;
+static int workers;
+static size_t inflight;     // строк отдано, ответ на них ещё не выведен
 
-// ======= утилиты I/O (как в ЛР1) =======
-static void die(const char* msg) {
-    ssize_t _ __attribute__((unused)) = write(2, msg, strlen(msg));
-    ssize_t __ __attribute__((unused)) = write(2, "\n", 1);
-    _exit(1);
+// счётчики для shmstat (NULL — IPC_STATS=0) и время отдачи строк, на
+// которые ещё нет ответа (каждой IPC_STATS_SAMPLE-й): ответы приходят по
+// порядку строк. Больше SENT_MAX строк в полёте не бывает (у ring — не
+// больше 8192).
+#define SENT_MAX 16384
+static struct ipc_stats* stats;
+static int64_t sent_at[SENT_MAX];
+static uint64_t nsent, nreplied;
+
+static int send_line(const char* line, size_t n) {
+    int64_t t = stats && nsent % IPC_STATS_SAMPLE == 0 ? ipc_now_ns() : 0;
+    int ok = workers ? ipc_pool_send(&pool, line, n) : ipc_send(&ch, line, n);
+    if (ok && stats) {
+        sent_at[nsent++ % SENT_MAX] = t;
+        ipc_stat_add(stats, IPC_ST_LINES, 1);
+        ipc_stat_add(stats, IPC_ST_BYTES, n);
+        ipc_stat_set(stats, IPC_ST_INFLIGHT, nsent - nreplied);
+    }
+    return ok;
 }
 
-static ssize_t write_all(int fd, const void* buf, size_t n) {
-    const char* p = (const char*)buf;
-    size_t left = n;
-    while (left) {
-        ssize_t w = write(fd, p, left);
-        if (w < 0) {
-            if (errno == EINTR) continue;
-            return -1;
-        }
-        left -= (size_t)w; p += w;
+// Вывод: сразу или, в цикле событий (event_loop), через буфер — он уходит,
+// когда нужен ввод от человека, когда полон или по таймеру flush_timer.
+static char obuf[1 << 16];
+static size_t olen;
+static int buffered;
+static int flush_timer = -1;
+
+#define FLUSH_MS 50
+
+static void out_flush(void) {
+    if (olen) write_all(1, obuf, olen);
+    olen = 0;
+}
+
+static void out(const char* s, size_t n) {
+    if (!buffered) {
+        write_all(1, s, n);
+        return;
+    }
+    if (olen + n > sizeof(obuf)) out_flush();
+    if (n > sizeof(obuf)) {
+        write_all(1, s, n);
+        return;
     }
-    return (ssize_t)n;
+    if (!olen && flush_timer >= 0) { // первое в буфере — уйдёт не позже чем через FLUSH_MS
+        struct itimerspec t = { { 0, 0 }, { 0, FLUSH_MS * 1000000L } };
+        if (timerfd_settime(flush_timer, 0, &t, NULL) < 0) die("timerfd_settime failed");
+    }
+    memcpy(obuf + olen, s, n);
+    olen += n;
 }
 
-// читает одну строку (заканчивается '\n' или EOF). Возвращает длину, 0 при EOF.
-static ssize_t read_line(int fd, char* buf, size_t cap) {
-    size_t i = 0;
-    while (i + 1 < cap) {
-        char c;
-        ssize_t r = read(fd, &c, 1);
-        if (r == 0) break;         // EOF
-        if (r < 0) {
-            if (errno == EINTR) continue;
-            return -1;
-        }
-        buf[i++] = c;
-        if (c == '\n') break;
+// вывести ответ ребёнка; "> " перед ним, если приглашение ещё не
+// выведено. Возвращает новое значение prompted (0).
+static int show_reply(int prompted, const char* rep, size_t k) {
+    if (stats) {
+        if (nreplied % IPC_STATS_SAMPLE == 0) ipc_stat_lat(stats, sent_at[nreplied % SENT_MAX]);
+        nreplied++;
+        ipc_stat_add(stats, IPC_ST_REPLIES, 1);
+        ipc_stat_set(stats, IPC_ST_INFLIGHT, nsent - nreplied);
     }
-    buf[i] = '\0';
-    return (ssize_t)i;
+    if (!prompted) out("> ", 2);
+    out(rep, k);
+    return 0;
+}
+
+// дождаться следующего ответа ребёнка и вывести его
+static int print_reply(int prompted) {
+    const char* rep;
+    size_t k = workers ? ipc_pool_take(&pool, &rep) : ipc_take(&ch, &rep);
+    if (k == 0) die("ребёнок закрыл канал");
+    return show_reply(prompted, rep, k);
+}
+
+// строка пропущена (long_line вернул 0): вывести ответы на прошлые и ошибку
+static int too_long(int prompted) {
+    const char* err = "ERR: line too long\n";
+    if (stats) ipc_stat_add(stats, IPC_ST_TOO_LONG, 1);
+    for (; inflight; inflight--) prompted = print_reply(prompted);
+    if (!prompted) out("> ", 2);
+    out(err, strlen(err));
+    return 0;
 }
 
-static void chomp(char* s) {
-    size_t n = strlen(s);
-    if (n && s[n-1] == '\n') s[n-1] = '\0';
+// Строка длиннее IPC_MSG_MAX - 1 байт; если она и буфер ввода длиннее,
+// *line — только её начало (n байт). Собрать её целиком в канале
+// (ipc_big): остаток читается с ввода прямо туда, ребёнок разбирает её на
+// месте. Возвращает длину, *line — на строку в канале; 0 — транспорт
+// (или пул, или демон) длинных строк не умеет: строка пропущена.
+// Ответы на прошлые строки к этому времени выведены (ipc_big).
+static size_t long_line(struct line_reader* in, const char** line, size_t n) {
+    static char skip[LR_BUF_SIZE];
+    int done = (*line)[n - 1] == '\n' || in->eof;
+    size_t cap = done ? n : 2 * n;
+    char* big = workers ? NULL : ipc_big(&ch, cap);
+    if (big) memcpy(big, *line, n);
+    while (!done) {
+        if (big && n == cap) big = ipc_big(&ch, cap *= 2);
+        ssize_t k = big ? lr_read_rest(in, big + n, cap - n, &done)
+                        : lr_read_rest(in, skip, sizeof(skip), &done);
+        if (k < 0) die("read(user line) failed");
+        if (big) n += (size_t)k;
+    }
+    *line = big;
+    return big ? n : 0;
+}
+
+// ======= цикл событий (-T eventfd) =======
+// Один epoll на всё: ввод, ответы ребёнка (ipc_event_fd), таймер сброса
+// вывода и pidfd ребёнка. Ответы забираются, как только приходят, и пока
+// ждём ввода, и пока ждём места в канале; ребёнок будит нас одним eventfd
+// на всё, что успел положить, пока мы не спали. Вывод тот же, что у
+// основного цикла в main. Возвращает prompted; в полёте могут остаться строки.
+// Ждать fd или нет. Не EPOLL_CTL_MOD с пустой маской: EPOLLHUP (ввод
+// кончился) приходит и без неё, а читать ввод, пока строка ещё не ушла, нельзя.
+static void watch(int ep, int fd, int on, int* state) {
+    if (on == *state) return;
+    struct epoll_event ev = { EPOLLIN, { .fd = fd } };
+    if (epoll_ctl(ep, on ? EPOLL_CTL_ADD : EPOLL_CTL_DEL, fd, &ev) < 0) die("epoll_ctl failed");
+    *state = on;
+}
+
+static int event_loop(struct line_reader* in, int prompted) {
+    int ep = epoll_create1(EPOLL_CLOEXEC);
+    if (ep < 0) die("epoll_create1 failed");
+    int efd = ipc_event_fd(&ch), pfd = -1;
+    flush_timer = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+    if (flush_timer < 0) die("timerfd_create failed");
+#ifdef SYS_pidfd_open
+    pfd = (int)syscall(SYS_pidfd_open, ch.pid, 0); // ядро без pidfd — обойдёмся
+#endif
+    // ввод и канал в наборе, только пока их ждём (watch); обычный файл
+    // epoll не берёт (EPERM) — из него читать можно всегда
+    struct epoll_event ev = { EPOLLIN, { .fd = 0 } };
+    int in_on = 1, ch_on = 0, gone = 0, in_file = 0;
+    if (epoll_ctl(ep, EPOLL_CTL_ADD, 0, &ev) < 0) {
+        if (errno != EPERM) die("epoll_ctl(stdin) failed");
+        in_file = 1;
+        in_on = 0;
+    }
+    ev.data.fd = flush_timer;
+    if (epoll_ctl(ep, EPOLL_CTL_ADD, flush_timer, &ev) < 0) die("epoll_ctl(timerfd) failed");
+    ev.data.fd = pfd;
+    if (pfd >= 0 && epoll_ctl(ep, EPOLL_CTL_ADD, pfd, &ev) < 0) die("epoll_ctl(pidfd) failed");
+    buffered = 1;
+
+    const char* line = NULL;
+    size_t n = 0; // прочитанная строка, которую канал ещё не принял
+    for (;;) {
+        const char* rep;
+        size_t k;
+        while (inflight && (k = ipc_try_take(&ch, &rep))) {
+            prompted = show_reply(prompted, rep, k);
+            inflight--;
+        }
+        if (gone && inflight) die("ребёнок закрыл канал");
+
+        if (!n) {
+            n = lr_take(in, LR_BUF_SIZE, &line);
+            // EOF или пустая строка — конец работы
+            if (n == 0 && in->eof) break;
+            if (n && (line[0] == '\n' || line[0] == '\0')) break;
+            if (n > IPC_MSG_MAX - 1) {
+                for (; inflight; inflight--) prompted = print_reply(prompted);
+                if (!(n = long_line(in, &line, n))) {
+                    prompted = too_long(prompted);
+                    continue;
+                }
+            }
+        }
+        if (n && send_line(line, n)) {
+            inflight++;
+            n = 0;
+            continue;
+        }
+        if (n && !inflight) die("ребёнок закрыл канал");
+
+        // ждать ввода (строки нет) и ответов (есть в полёте); человеку,
+        // которому отвечать не на что, — всё выведенное и приглашение
+        if (!n && !inflight) {
+            if (!prompted) out("> ", 2);
+            prompted = 1;
+            out_flush();
+        }
+        if (!n && in_file) {
+            if (lr_fill(in) < 0) die("read(user line) failed");
+            continue;
+        }
+        watch(ep, 0, !n, &in_on);
+        if (inflight && !ipc_arm(&ch)) continue; // ответ уже есть
+        watch(ep, efd, inflight > 0, &ch_on);
+        struct epoll_event evs[4];
+        int ne = epoll_wait(ep, evs, 4, -1);
+        if (ne < 0 && errno != EINTR) die("epoll_wait failed");
+        for (int e = 0; e < ne; ++e) {
+            int fd = evs[e].data.fd;
+            if (fd == 0) {
+                if (lr_fill(in) < 0) die("read(user line) failed");
+            } else if (fd == flush_timer) {
+                uint64_t t;
+                if (read(flush_timer, &t, sizeof(t)) < 0 && errno != EAGAIN) die("read(timerfd) failed");
+                out_flush();
+            } else if (fd == pfd) { // ребёнок вышел: ответы, что успел положить, ещё в канале
+                gone = 1;
+                epoll_ctl(ep, EPOLL_CTL_DEL, pfd, NULL);
+            }
+            // eventfd: ответы заберёт начало цикла
+        }
+    }
+    close(ep);
+    close(flush_timer);
+    flush_timer = -1;
+    if (pfd >= 0) close(pfd);
+    return prompted;
 }
 
-// ======= структура обмена через shared memory =======
-struct shm_data {
-    // Родитель пишет в in_buf, ребенок отвечает в out_buf.
-    // Семафоры обеспечивают порядок, поэтому отдельные флаги не нужны.
-    char in_buf[BUF_IN_SIZE];
-    char out_buf[BUF_OUT_SIZE];
-};
+// ======= пакетный режим (-B) =======
+// Ввод — обычный файл: ребёнку уходит одно сообщение PROTO_BULK
+// (../lab1/proto.h) — дескрипторы файла и массива ответов, которые он
+// унаследовал при запуске, и смещение первой ещё не разобранной строки.
+// Ребёнок разбирает строки прямо в отображении файла; ответы родитель
+// берёт из массива по номерам строк и выводит так же, как основной цикл.
+#define BULK_FD 32              // дескрипторы для ребёнка — не ниже: их не заденут file actions транспорта
+
+// набор агрегатов (-a): по нему разбираются записи массива ответов
+static struct agg_spec aggs = { AGG_SUM, 0, 0, 0, 0 };
+
+// Возвращает prompted, как event_loop; ввод после этого не читается.
+static int bulk_run(struct line_reader* in, int in_fd, int res_fd, int prompted) {
+    // файл прочитан до in->len, разобрано до in->pos
+    off_t off = lseek(0, 0, SEEK_CUR);
+    if (off < 0) die("lseek(stdin) failed");
+    off -= (off_t)(in->len - in->pos);
+
+    char msg[96];
+    size_t bp = sizeof(PROTO_BULK) - 1, ok = sizeof(PROTO_BULK_OK) - 1, k = bp;
+    memcpy(msg, PROTO_BULK, bp);
+    k += (size_t)ll_to_buf(in_fd, msg + k);
+    msg[k++] = ' ';
+    k += (size_t)ll_to_buf(off, msg + k);
+    msg[k++] = ' ';
+    k += (size_t)ll_to_buf(res_fd, msg + k);
+    msg[k++] = '\n';
+    const char* rep;
+    size_t rl = ipc_call(&ch, msg, k, &rep), i = ok;
+    long long got;
+    if (rl <= ok || memcmp(rep, PROTO_BULK_OK, ok) != 0 || !agg_parse_ll(rep, rl, &i, &got) || got < 0)
+        die("ребёнок не принял файл ввода (-B)");
+    size_t n = (size_t)got;
+
+    size_t stride = sizeof(struct frame_reply) + agg_nvals(&aggs) * sizeof(int64_t);
+    const char* res = NULL;
+    if (n) {
+        void* p = mmap(NULL, n * stride, PROT_READ, MAP_SHARED, res_fd, 0);
+        if (p == MAP_FAILED) die("mmap(bulk) failed");
+        res = (const char*)p;
+        madvise(p, n * stride, MADV_SEQUENTIAL);
+    }
+    buffered = 1;
+    for (i = 0; i < n; ++i) {
+        const struct frame_reply* r = (const struct frame_reply*)(res + i * stride);
+        char text[REPLY_MAX];
+        if (!prompted) out("> ", 2);
+        out(text, format_frame(&aggs, r, (const int64_t*)(r + 1), text));
+        prompted = 0;
+    }
+    if (stats) {
+        ipc_stat_add(stats, IPC_ST_LINES, n);
+        ipc_stat_add(stats, IPC_ST_REPLIES, n);
+    }
+    if (n) munmap((void*)res, n * stride);
+    close(in_fd);
+    close(res_fd);
+    return prompted;
+}
 
 // ======= main =======
 int main(int argc, char** argv, char** envp) {
-    (void)argc; (void)argv;
+    // parent_shm [--binlog] [-a LIST] [-T pipe|shm|memfd|seqpacket|ring|eventfd] [-W] [-C N] [-P N] [-D] [-S P] [-B]
+    //   --binlog: ребёнок пишет двоичный журнал (../lab1/reslog.h)
+    //   -a LIST: набор агрегатов на строку (../lab1/agg.h), например -a sum,min,max
+    //   -T: транспорт до ребёнка (../ipc/ipc.h), по умолчанию shm; с eventfd
+    //       основной цикл — на epoll (event_loop)
+    //   -W: запустить ребёнка сразу, пока пользователь вводит имя файла
+    //       (имя уйдёт ему первым сообщением, PROTO_FILE)
+    //   -C N: кэш результатов ребёнка на N строк (../lab1/rcache.h)
+    //   -P N: N детей на общей очереди строк (ipc_pool); к ним можно
+    //       подключить ещё (child_shm - --pool <имя>), они уходят по SIGTERM
+    //   -D: работать через демон (child_shm --daemon), запустив его, если
+    //       его ещё нет; -C тогда — размер кэша демона
+    //   -S none|batch|<мс>: когда ребёнок делает fdatasync файла результатов
+    //       (пишет его отдельный поток): никогда, после каждой пачки или не
+    //       реже раза в столько мс; по умолчанию none
+    //   -B: ввод — обычный файл: отдать его ребёнку целиком (bulk_run);
+    //       ввод не из файла — обычная работа по строкам
+    // Строки длиннее IPC_MSG_MAX - 1 байт уходят целиком с shm и memfd
+    // (область длинных запросов) и с ring и eventfd (кусками через кольцо);
+    // с pipe, seqpacket, -P и -D на такую строку ответ — ERR: line too long,
+    // ребёнку она не уходит.
+    int binlog = 0, warm = 0, daemon = 0, bulk = 0;
+    const char* agg_list = NULL;
+    const char* cache = NULL;
+    const char* sync = NULL;
+    const struct ipc_ops* ops = NULL;
+    for (int a = 1; a < argc; ++a) {
+        if (strcmp(argv[a], "--binlog") == 0) binlog = 1;
+        else if (strcmp(argv[a], "-W") == 0) warm = 1;
+        else if (strcmp(argv[a], "-D") == 0) daemon = 1;
+        else if (strcmp(argv[a], "-B") == 0) bulk = 1;
+        else if (strcmp(argv[a], "-a") == 0 && a + 1 < argc) agg_list = argv[++a];
+        else if (strcmp(argv[a], "-T") == 0 && a + 1 < argc) {
+            if (!(ops = ipc_transport(argv[++a]))) die("-T: pipe, shm, memfd, seqpacket, ring или eventfd");
+        }
+        else if (strcmp(argv[a], "-C") == 0 && a + 1 < argc) {
+            // проверить здесь: ребёнок, упавший на разборе ключей, оставит нас ждать ответа
+            if (!parse_count(cache = argv[++a], RC_MAX)) die("-C: число от 1 до 1048576");
+        }
+        else if (strcmp(argv[a], "-P") == 0 && a + 1 < argc) {
+            if (!(workers = (int)parse_count(argv[++a], IPC_POOL_WORKERS))) die("-P: число от 1 до 64");
+        }
+        else if (strcmp(argv[a], "-S") == 0 && a + 1 < argc) {
+            sync = argv[++a];
+            if (strcmp(sync, "none") != 0 && strcmp(sync, "batch") != 0 && !parse_count(sync, 3600000))
+                die("-S: none, batch или период в мс (до 3600000)");
+        }
+        else die("usage: parent_shm [--binlog] [-a LIST] [-T pipe|shm|memfd|seqpacket|ring|eventfd] [-W] [-C N] [-P N] [-D] [-S P] [-B]");
+    }
+    if (agg_list && strlen(agg_list) + sizeof(PROTO_AGGS) + 1 > IPC_MSG_MAX)
+        die("слишком длинный список -a");
+    if (workers) {
+        // журнал один на процесс, а транспорт у пула свой
+        if (binlog || ops) die("-P не сочетается с --binlog и -T");
+        // список агрегатов дети берут из сегмента и ответить на него не могут —
+        // проверить здесь
+        struct agg_spec spec;
+        if (agg_list && !agg_parse(agg_list, strlen(agg_list), &spec)) die("-a: непонятный набор агрегатов");
+    }
+    if (daemon && (binlog || ops || workers)) die("-D не сочетается с --binlog, -T и -P");
+    // поток записи есть только у ребёнка со своим каналом и текстовым файлом
+    if (sync && (binlog || workers || daemon)) die("-S не сочетается с --binlog, -P и -D");
+    if (!ops) ops = &ipc_shm_ops;
+    // файл ввода и массив ответов ребёнок наследует — открыть до его запуска
+    int bulk_in = -1, bulk_res = -1;
+    struct stat ist;
+    if (bulk && (workers || daemon)) die("-B не сочетается с -P и -D");
+    if (bulk && fstat(0, &ist) == 0 && S_ISREG(ist.st_mode)) {
+        if (agg_list && !agg_parse(agg_list, strlen(agg_list), &aggs)) die("-a: непонятный набор агрегатов");
+        int m = memfd_create("bulk_res", 0);
+        if (m < 0) die("memfd_create failed");
+        bulk_in = fcntl(0, F_DUPFD, BULK_FD);
+        bulk_res = fcntl(m, F_DUPFD, BULK_FD);
+        if (bulk_in < 0 || bulk_res < 0) die("fcntl(F_DUPFD) failed");
+        close(m);
+    }
+
+    // argv: child_shm <fileName> <адрес канала> [--binlog] [--cache N] [--sync P] [--aggs]
+    //       [--bulk <fd> <fd>]
+    char* tail[10];
+    char bulk_fds[2][16];
+    int nt = 0;
+    if (binlog) tail[nt++] = (char*)"--binlog";
+    if (agg_list && !workers) tail[nt++] = (char*)"--aggs"; // у пула агрегаты — в сегменте
+    if (cache) {
+        tail[nt++] = (char*)"--cache";
+        tail[nt++] = (char*)cache;
+    }
+    if (sync) {
+        tail[nt++] = (char*)"--sync";
+        tail[nt++] = (char*)sync;
+    }
+    if (bulk_in >= 0) { // ребёнок примет PROTO_BULK только с этими дескрипторами
+        bulk_fds[0][ll_to_buf(bulk_in, bulk_fds[0])] = '\0';
+        bulk_fds[1][ll_to_buf(bulk_res, bulk_fds[1])] = '\0';
+        tail[nt++] = (char*)"--bulk";
+        tail[nt++] = bulk_fds[0];
+        tail[nt++] = bulk_fds[1];
+    }
+    tail[nt] = NULL;
+    char* pool_head[] = { (char*)"child_shm", (char*)"-", NULL }; // имя файла — из сегмента пула
+    char* daemon_argv[] = { (char*)"child_shm", (char*)"--daemon", (char*)"--cache", (char*)cache, NULL };
+    if (!cache) daemon_argv[2] = NULL;
+    if (warm && daemon) {
+        ipc_connect(&ch, "./child_shm", daemon_argv, envp);
+    } else if (warm && workers) {
+        ipc_pool_create(&pool);
+        for (int k = 0; k < workers; ++k) ipc_pool_spawn(&pool, "./child_shm", pool_head, tail, envp);
+    } else if (warm) {
+        // запуск и подключение ребёнка идут, пока человек набирает имя файла
+        char* head[] = { (char*)"child_shm", (char*)PROTO_FILE_LATER, NULL };
+        ipc_spawn(&ch, ops, "./child_shm", head, tail, envp);
+    }
 
     // 1) спросить имя выходного файла (как в ЛР1)
     const char* prompt1 = "Введите имя файла: ";
     write_all(1, prompt1, strlen(prompt1));
+    static struct line_reader in;
+    lr_init(&in, 0);
+
     char fileName[512];
-    ssize_t fnlen = read_line(0, fileName, sizeof(fileName));
+    const char* line;
+    ssize_t fnlen = lr_next(&in, sizeof(fileName) - 1, &line);
+    if (fnlen <= 0 && warm) { // ребёнок ждёт имя — отпустить его
+        if (workers) ipc_pool_finish(&pool);
+        else ipc_finish(&ch);
+    }
     if (fnlen < 0) die("не удалось выполнить чтение (fileName)");
     if (fnlen == 0) die("имя файла не указано");
+    memcpy(fileName, line, (size_t)fnlen);
+    fileName[fnlen] = '\0';
     chomp(fileName);
 
-    // 2) придумать уникальные имена объектов (обязательно по условию)
-    pid_t pid_self = getpid();
-    char shm_name[128], sem_p_name[128], sem_c_name[128];
-    // POSIX требует, чтобы имя shm/sem начиналось с '/'
-    // Пример: /shm_sum_12345, /sem_p_12345, /sem_c_12345
-    {
-        // простое формирование строк без snprintf из stdio.h
-        char pidbuf[32]; int k = 0;
-        // int -> строка
-        {
-            long long v = pid_self; char tmp[32]; int n = 0;
-            if (v == 0) tmp[n++] = '0';
-            while (v > 0) { tmp[n++] = (char)('0' + (v % 10)); v /= 10; }
-            // reverse
-            if (n == 0) { pidbuf[k++] = '0'; }
-            else { for (int i = n - 1; i >= 0; --i) pidbuf[k++] = tmp[i]; }
-            pidbuf[k] = '\0';
+    // 2) создать канал (по умолчанию shm: сегмент + два семафора с
+    //    уникальными именами — обязательно по условию) и запустить child_shm,
+    //    передав ему имя файла и адрес канала; с -W ребёнок уже ждёт —
+    //    имя файла уходит ему сообщением
+    // с -P имя файла и агрегаты дети берут из сегмента пула; демону имя
+    // уходит сообщением, как с -W. Демон и подключённые вручную обработчики
+    // пула работают в своём каталоге — путь им нужен от нашего
+    if ((daemon || workers) && fileName[0] != '/') {
+        char path[sizeof(fileName)];
+        size_t n = strlen(fileName);
+        if (!getcwd(path, sizeof(path)) || strlen(path) + 1 + n >= sizeof(path)) die("слишком длинный путь к файлу");
+        size_t d = strlen(path);
+        path[d] = '/';
+        memcpy(path + d + 1, fileName, n + 1);
+        memcpy(fileName, path, d + n + 2);
+    }
+    const char* rep;
+    if (workers) {
+        if (!warm) ipc_pool_create(&pool);
+        ipc_pool_start(&pool, fileName, agg_list);
+        for (int k = 0; !warm && k < workers; ++k) ipc_pool_spawn(&pool, "./child_shm", pool_head, tail, envp);
+    } else if (!warm && !daemon) {
+        // имя вроде "-" или "--file-later" — не ключ ребёнку (PROTO_FILE_LATER)
+        char arg[sizeof(fileName) + 2] = "./";
+        memcpy(arg + (fileName[0] == '-' ? 2 : 0), fileName, strlen(fileName) + 1);
+        char* head[] = { (char*)"child_shm", arg, NULL };
+        ipc_spawn(&ch, ops, "./child_shm", head, tail, envp);
+    } else {
+        if (!warm) ipc_connect(&ch, "./child_shm", daemon_argv, envp);
+        char msg[IPC_MSG_MAX];
+        size_t fp = sizeof(PROTO_FILE) - 1, n = strlen(fileName);
+        memcpy(msg, PROTO_FILE, fp);
+        memcpy(msg + fp, fileName, n);
+        msg[fp + n] = '\n';
+        if (ipc_call(&ch, msg, fp + n + 1, &rep) == 0 || strcmp(rep, PROTO_FILE_OK) != 0) {
+            ipc_finish(&ch);
+            die("ребёнок не открыл файл результатов");
         }
-        const char* a = "/shm_sum_";   size_t na = strlen(a);
-        const char* b = "/sem_p_";     size_t nb = strlen(b);
-        const char* c = "/sem_c_";     size_t nc = strlen(c);
-
-        memcpy(shm_name, a, na); memcpy(shm_name + na, pidbuf, k); shm_name[na + k] = '\0';
-        memcpy(sem_p_name, b, nb); memcpy(sem_p_name + nb, pidbuf, k); sem_p_name[nb + k] = '\0';
-        memcpy(sem_c_name, c, nc); memcpy(sem_c_name + nc, pidbuf, k); sem_c_name[nc + k] = '\0';
-    }
-
-    // 3) создать shared memory
-    int shm_fd = shm_open(shm_name, O_CREAT | O_RDWR, 0666);
-    if (shm_fd < 0) die("shm_open failed");
-    if (ftruncate(shm_fd, sizeof(struct shm_data)) < 0) die("ftruncate failed");
-
-    void* map = mmap(NULL, sizeof(struct shm_data), PROT_READ | PROT_WRITE, MAP_SHARED, shm_fd, 0);
-    if (map == MAP_FAILED) die("mmap failed");
-    struct shm_data* shm = (struct shm_data*)map;
-
-    // 4) создать два семафора:
-    //    - sem_parent: родитель -> ребенок (данные готовы к чтению)
-    //    - sem_child : ребенок -> родитель (ответ готов)
-    sem_t* sem_parent = sem_open(sem_p_name, O_CREAT, 0666, 0);
-    if (sem_parent == SEM_FAILED) die("sem_open(sem_parent) failed");
-    sem_t* sem_child  = sem_open(sem_c_name, O_CREAT, 0666, 0);
-    if (sem_child == SEM_FAILED) die("sem_open(sem_child) failed");
-
-    // 5) запустить child через execve и передать имена объектов + имя файла
-    pid_t pid = fork();
-    if (pid < 0) die("fork failed");
-    if (pid == 0) {
-        // argv: child_shm <fileName> <shm_name> <sem_p_name> <sem_c_name>
-        char* args[6];
-        args[0] = (char*)"child_shm";
-        args[1] = fileName;
-        args[2] = shm_name;
-        args[3] = sem_p_name;
-        args[4] = sem_c_name;
-        args[5] = NULL;
-        execve("./child_shm", args, envp);
-        die("execve ./child_shm failed");
-    }
-
-    // 6) основной цикл: читать у пользователя -> в shared memory -> сигнал ребенку -> ждать ответ -> печатать
+    }
+
+    // набор агрегатов ребёнку — первым сообщением (он ждёт его по --aggs);
+    // демону — всегда: ему не скажешь ключом, что придёт дальше
+    if ((agg_list && !workers) || daemon) {
+        const char* list = agg_list ? agg_list : "sum";
+        char msg[IPC_MSG_MAX];
+        size_t ap = sizeof(PROTO_AGGS) - 1, n = strlen(list);
+        memcpy(msg, PROTO_AGGS, ap);
+        memcpy(msg + ap, list, n);
+        msg[ap + n] = '\n';
+        if (ipc_call(&ch, msg, ap + n + 1, &rep) == 0 || strcmp(rep, PROTO_AGGS_OK) != 0)
+            die("ребёнок не принял набор агрегатов (-a)");
+    }
+
+    // 3) основной цикл: читать у пользователя -> отдать ребенку -> ждать ответ -> печатать
     const char* prompt2 =
         "Введите строку, например: \"12 -3 7\" и нажмите Ентер.\n"
         "Пустая строка для завершения.\n";
     write_all(1, prompt2, strlen(prompt2));
 
-    for (;;) {
-        write_all(1, "> ", 2);
-        ssize_t n = read_line(0, shm->in_buf, sizeof(shm->in_buf));
-        if (n < 0) die("read(user line) failed");
-
-        // EOF: посылаем пустую строку как сигнал завершения
-        if (n == 0 || shm->in_buf[0] == '\n' || shm->in_buf[0] == '\0') {
-            shm->in_buf[0] = '\0';
-            sem_post(sem_parent); // дать ребёнку понять, что пора завершаться
-            break;
+    // Строки, которые уже прочитаны (ввод из файла), уходят ребёнку сразу,
+    // не дожидаясь ответов на предыдущие, — сколько примет канал (у ring и
+    // пула — много, у остальных — одна). Перед тем как ждать ввода, все ответы
+    // выводятся: человек ждёт их. Вывод тот же, что при обмене по одной
+    // строке: "> " перед каждым ответом и перед вводом.
+    int prompted = 0;
+    stats = ipc_stats_open(IPC_ROLE_PARENT, workers ? "pool" : daemon ? "daemon" : ops->name);
+    if (bulk_in >= 0) prompted = bulk_run(&in, bulk_in, bulk_res, prompted);
+    else if (!workers && ipc_event_fd(&ch) >= 0) prompted = event_loop(&in, prompted);
+    else for (;;) {
+        size_t n = lr_take(&in, LR_BUF_SIZE, &line);
+        if (n == 0 && !in.eof) {
+            for (; inflight; inflight--) prompted = print_reply(prompted);
+            if (!prompted) write_all(1, "> ", 2);
+            prompted = 1;
+            if (lr_fill(&in) < 0) die("read(user line) failed");
+            continue;
         }
 
-        // отдать строку ребенку
-        if (sem_post(sem_parent) < 0) die("sem_post(parent) failed");
+        // EOF или пустая строка — конец работы
+        if (n == 0 || line[0] == '\n' || line[0] == '\0') break;
 
-        // ждать ответа
-        if (sem_wait(sem_child) < 0) die("sem_wait(child) failed");
+        // длинная строка уходит целиком, не кусками
+        if (n > IPC_MSG_MAX - 1) {
+            for (; inflight; inflight--) prompted = print_reply(prompted);
+            if (!(n = long_line(&in, &line, n))) {
+                prompted = too_long(prompted);
+                continue;
+            }
+        }
 
-        // вывести ответ
-        write_all(1, shm->out_buf, strlen(shm->out_buf));
+        // отдать строку ребенку; нет места — сперва забрать ответ
+        while (!send_line(line, n)) {
+            if (!inflight) die("ребёнок закрыл канал");
+            prompted = print_reply(prompted);
+            inflight--;
+        }
+        inflight++;
     }
+    for (; inflight; inflight--) prompted = print_reply(prompted);
+    if (!prompted) out("> ", 2);
+    out_flush();
 
-    // дочитать финальные сообщения, если ребенок что-то допишет (здесь не требуется)
-
-    int status = 0;
-    waitpid(pid, &status, 0);
-
-    // 7) уборка
-    munmap(shm, sizeof(struct shm_data));
-    close(shm_fd);
-    sem_close(sem_parent);
-    sem_close(sem_child);
-    sem_unlink(sem_p_name);
-    sem_unlink(sem_c_name);
-    shm_unlink(shm_name);
+    // 4) сообщить ребёнку о конце, дождаться его и убрать канал
+    int status = workers ? ipc_pool_finish(&pool) : ipc_finish(&ch);
+    ipc_stats_close(stats);
 
     return WIFEXITED(status) ? WEXITSTATUS(status) : 1;
 }
@@ -0,0 +1,282 @@
+// shmstat — счётчики и задержки parent_shm / child_shm на ходу
+// (../ipc/ipc.h, ipc_stats). Сегменты /shm_stat_<pid> открываются только
+// для чтения: процессы об этом не знают и ни на что не отвлекаются.
+//
+// shmstat [-i MS] [-n N] [-r] [pid ...]
+//   -i MS: период опроса, по умолчанию 1000 мс
+//   -n N:  сколько раз вывести (по умолчанию — пока не прервут)
+//   -r:    убрать сегменты процессов, которых уже нет, и выйти
+// Строка на процесс: строки всего и в секунду, ошибки по видам, строки в
+// полёте (у родителя), МБ/с и процентили задержки за последний период
+// (первый раз — с запуска процесса). У родителя задержка — от отдачи строки
+// до ответа, у ребёнка — от получения строки до ответа.
+#define _GNU_SOURCE
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <signal.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <string.h>
+#include <time.h>
+
+#include "../ipc/ipc.h"
+
+#define MAX_PROCS 128
+
+// прошлый снимок процесса: из разницы — скорости и процентили за период
+struct prev {
+    int32_t pid;
+    int64_t at;
+    uint64_t c[IPC_ST_N];
+    uint64_t hist[IPC_HIST_BUCKETS];
+};
+
+static struct prev prevs[MAX_PROCS];
+static int nprev;
+
+// ======= вывод без stdio =======
+static char out[1 << 16];
+static size_t olen;
+
+static void put(const char* s) {
+    size_t n = strlen(s);
+    if (olen + n > sizeof(out)) n = sizeof(out) - olen;
+    memcpy(out + olen, s, n);
+    olen += n;
+}
+
+static void put_num(long long v) {
+    char b[32];
+    b[ll_to_buf(v, b)] = '\0';
+    put(b);
+}
+
+// v / div с одним знаком после запятой
+static void put_frac(uint64_t v, uint64_t div) {
+    uint64_t t = (v * 10 + div / 2) / div;
+    put_num((long long)(t / 10));
+    if (t < 1000) {
+        char b[3] = { '.', (char)('0' + t % 10), '\0' };
+        put(b);
+    }
+}
+
+static void put_dur(uint64_t ns) {
+    if (ns < 1000) {
+        put_num((long long)ns);
+        put("ns");
+    } else if (ns < 1000000) {
+        put_frac(ns, 1000);
+        put("us");
+    } else if (ns < 1000000000) {
+        put_frac(ns, 1000000);
+        put("ms");
+    } else {
+        put_frac(ns, 1000000000);
+        put("s");
+    }
+}
+
+static void flush_out(void) {
+    write_all(1, out, olen);
+    olen = 0;
+}
+
+// ======= сегменты =======
+static const char* role_name(int r) {
+    switch (r) {
+    case IPC_ROLE_PARENT: return "parent";
+    case IPC_ROLE_CHILD:  return "child";
+    case IPC_ROLE_WORKER: return "worker";
+    case IPC_ROLE_DAEMON: return "daemon";
+    }
+    return "?";
+}
+
+static int alive(pid_t pid) {
+    if (kill(pid, 0) < 0 && errno == ESRCH) return 0;
+    // зомби (статус ещё не забран) — тоже завершён: состояние в
+    // /proc/<pid>/stat — после ") "
+    char path[64] = "/proc/", buf[512];
+    size_t n = 6;
+    n += (size_t)ll_to_buf(pid, path + n);
+    memcpy(path + n, "/stat", 6);
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return 1;
+    ssize_t r = read(fd, buf, sizeof(buf) - 1);
+    close(fd);
+    if (r <= 0) return 1;
+    buf[r] = '\0';
+    char* e = strrchr(buf, ')');
+    return !(e && e[1] == ' ' && e[2] == 'Z');
+}
+
+// отобразить сегмент только для чтения; NULL — не наш или уже убран
+static const struct ipc_stats* attach(const char* name) {
+    int fd = shm_open(name, O_RDONLY, 0);
+    if (fd < 0) return NULL;
+    struct stat st;
+    void* map = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && st.st_size == (off_t)sizeof(struct ipc_stats))
+        map = mmap(NULL, sizeof(struct ipc_stats), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) return NULL;
+    const struct ipc_stats* s = (const struct ipc_stats*)map;
+    if (__atomic_load_n(&s->magic, __ATOMIC_ACQUIRE) != IPC_STATS_MAGIC) {
+        munmap(map, sizeof(struct ipc_stats));
+        return NULL;
+    }
+    return s;
+}
+
+static struct prev* find_prev(int32_t pid) {
+    for (int k = 0; k < nprev; ++k)
+        if (prevs[k].pid == pid) return &prevs[k];
+    if (nprev == MAX_PROCS) return NULL;
+    struct prev* p = &prevs[nprev++];
+    memset(p, 0, sizeof(*p));
+    p->pid = pid;
+    return p;
+}
+
+// процентиль q (из 1000) по гистограмме h из total значений
+static uint64_t percentile(const uint64_t* h, uint64_t total, unsigned q) {
+    uint64_t need = (total * q + 999) / 1000, cum = 0;
+    for (unsigned b = 0; b < IPC_HIST_BUCKETS; ++b)
+        if ((cum += h[b]) >= need && h[b]) return ipc_hist_value(b);
+    return 0;
+}
+
+static void show(const struct ipc_stats* s, int64_t now) {
+    // снимок: каждое поле читается целиком, но не все из одного мгновения
+    uint64_t c[IPC_ST_N], h[IPC_HIST_BUCKETS];
+    for (int k = 0; k < IPC_ST_N; ++k) c[k] = __atomic_load_n(&s->c[k], __ATOMIC_RELAXED);
+    for (unsigned b = 0; b < IPC_HIST_BUCKETS; ++b) h[b] = __atomic_load_n(&s->hist[b], __ATOMIC_RELAXED);
+    int32_t pid = s->pid;
+
+    struct prev* p = find_prev(pid);
+    int64_t since = p && p->at ? p->at : s->started_ns;
+    uint64_t dt = now > since ? (uint64_t)(now - since) : 1;
+    uint64_t d[IPC_ST_N], dh[IPC_HIST_BUCKETS], n = 0;
+    for (int k = 0; k < IPC_ST_N; ++k) d[k] = c[k] - (p ? p->c[k] : 0);
+    for (unsigned b = 0; b < IPC_HIST_BUCKETS; ++b) n += dh[b] = h[b] - (p ? p->hist[b] : 0);
+    if (p) {
+        p->at = now;
+        memcpy(p->c, c, sizeof(c));
+        memcpy(p->hist, h, sizeof(h));
+    }
+
+    put_num(pid);
+    put(" ");
+    put(role_name(s->role));
+    put(" ");
+    put(s->transport);
+    if (!alive(pid)) put(" (завершён)");
+    put(": lines ");
+    put_num((long long)c[IPC_ST_LINES]);
+    put(" (");
+    put_num((long long)(d[IPC_ST_LINES] * 1000000000ULL / dt));
+    put("/s, ");
+    put_frac(d[IPC_ST_BYTES] * 1000000ULL / dt, 1000);
+    put(" MB/s)");
+    if (s->role == IPC_ROLE_PARENT) {
+        put(" replies ");
+        put_num((long long)c[IPC_ST_REPLIES]);
+        put(" inflight ");
+        put_num((long long)c[IPC_ST_INFLIGHT]);
+        put(" too_long ");
+        put_num((long long)c[IPC_ST_TOO_LONG]);
+    } else {
+        put(" ok ");
+        put_num((long long)c[IPC_ST_OK]);
+        put(" bad_format ");
+        put_num((long long)c[IPC_ST_BAD_FORMAT]);
+        put(" overflow ");
+        put_num((long long)c[IPC_ST_OVERFLOW]);
+        put(" no_numbers ");
+        put_num((long long)c[IPC_ST_NO_NUMBERS]);
+    }
+    if (n) {
+        static const unsigned qs[] = { 500, 900, 990, 999 };
+        static const char* const qn[] = { " p50 ", " p90 ", " p99 ", " p99.9 " };
+        for (int k = 0; k < 4; ++k) {
+            put(qn[k]);
+            put_dur(percentile(dh, n, qs[k]));
+        }
+        put(" max ");
+        put_dur(percentile(dh, n, 1000));
+    }
+    put("\n");
+}
+
+static int wanted(int32_t pid, char** pids, int npids) {
+    if (!npids) return 1;
+    for (int k = 0; k < npids; ++k)
+        if ((size_t)pid == parse_count(pids[k], 1u << 30)) return 1;
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    size_t interval = 1000, count = 0;
+    int remove = 0, a = 1;
+    for (; a < argc && argv[a][0] == '-'; ++a) {
+        if (strcmp(argv[a], "-i") == 0 && a + 1 < argc) {
+            if (!(interval = parse_count(argv[++a], 3600000))) die("-i: период в мс");
+        }
+        else if (strcmp(argv[a], "-n") == 0 && a + 1 < argc) {
+            if (!(count = parse_count(argv[++a], 1u << 30))) die("-n: сколько раз вывести");
+        }
+        else if (strcmp(argv[a], "-r") == 0) remove = 1;
+        else die("usage: shmstat [-i MS] [-n N] [-r] [pid ...]");
+    }
+    char** pids = argv + a;
+    int npids = argc - a;
+    size_t pl = strlen(IPC_STATS_PREFIX) - 1; // без '/'
+
+    for (size_t round = 0; !count || round < count; ++round) {
+        if (round) {
+            struct timespec ts = { (time_t)(interval / 1000), (long)(interval % 1000) * 1000000 };
+            while (nanosleep(&ts, &ts) < 0 && errno == EINTR) {}
+        }
+        DIR* dir = opendir("/dev/shm");
+        if (!dir) die("opendir(/dev/shm) failed");
+        int64_t now = ipc_now_ns();
+        int shown = 0;
+        struct dirent* e;
+        while ((e = readdir(dir))) {
+            if (strncmp(e->d_name, IPC_STATS_PREFIX + 1, pl) != 0) continue;
+            char name[300] = "/";
+            size_t n = strlen(e->d_name);
+            if (n >= sizeof(name) - 1) continue;
+            memcpy(name + 1, e->d_name, n + 1);
+            const struct ipc_stats* s = attach(name);
+            if (!s) continue;
+            if (wanted(s->pid, pids, npids)) {
+                if (remove) {
+                    if (!alive(s->pid)) {
+                        shm_unlink(name);
+                        put("убран ");
+                        put(name);
+                        put("\n");
+                    }
+                } else {
+                    show(s, now);
+                    shown++;
+                }
+            }
+            munmap((void*)s, sizeof(struct ipc_stats));
+        }
+        closedir(dir);
+        if (remove) {
+            flush_out();
+            return 0;
+        }
+        if (!shown) put("нет процессов со счётчиками (" IPC_STATS_PREFIX "<pid>)\n");
+        if (!count || count > 1) put("\n");
+        flush_out();
+    }
+    return 0;
+}